@@ -1990,13 +1990,13 @@ bool pkgAcqArchive::QueueNext()
       Desc.ShortDesc = Version.ParentPkg().FullName(true);
 
       // See if we already have the file. (Legacy filenames)
-      FileSize = Version->Size;
+      FileSize = Version.Size();
       string FinalFile = _config->FindDir("Dir::Cache::Archives") + flNotDir(PkgFile);
       struct stat Buf;
       if (stat(FinalFile.c_str(),&Buf) == 0)
       {
 	 // Make sure the size matches
-	 if ((unsigned long long)Buf.st_size == Version->Size)
+	 if ((unsigned long long)Buf.st_size == Version.Size())
 	 {
 	    Complete = true;
 	    Local = true;
@@ -2015,7 +2015,7 @@ bool pkgAcqArchive::QueueNext()
       if (stat(FinalFile.c_str(),&Buf) == 0)
       {
 	 // Make sure the size matches
-	 if ((unsigned long long)Buf.st_size == Version->Size)
+	 if ((unsigned long long)Buf.st_size == Version.Size())
 	 {
 	    Complete = true;
 	    Local = true;
@@ -2035,7 +2035,7 @@ bool pkgAcqArchive::QueueNext()
       if (stat(DestFile.c_str(),&Buf) == 0)
       {
 	 // Hmm, the partial file is too big, erase it
-	 if ((unsigned long long)Buf.st_size > Version->Size)
+	 if ((unsigned long long)Buf.st_size > Version.Size())
 	    unlink(DestFile.c_str());
 	 else
 	    PartialSize = Buf.st_size;
@@ -2071,7 +2071,7 @@ void pkgAcqArchive::Done(string Message,unsigned long long Size,string CalcHash,
    Item::Done(Message,Size,CalcHash,Cfg);
    
    // Check the size
-   if (Size != Version->Size)
+   if (Size != Version.Size())
    {
       RenameOnError(SizeMismatch);
       return;
@@ -36,7 +36,7 @@
 									/*}}}*/
 using namespace std;
 
-pkgProblemResolver *pkgProblemResolver::This = 0;
+APT_THREAD_LOCAL pkgProblemResolver *pkgProblemResolver::This = 0;
 
 // Simulate::Simulate - Constructor					/*{{{*/
 // ---------------------------------------------------------------------
@@ -359,6 +359,44 @@ pkgProblemResolver::~pkgProblemResolver()
    delete [] Flags;
 }
 									/*}}}*/
+// ProblemResolver::Checkpoint - Open a checkpoint to roll back to	/*{{{*/
+// ---------------------------------------------------------------------
+/* */
+void pkgProblemResolver::Checkpoint()
+{
+   Checkpoints.push_back(FlagsJournal.size());
+   Cache.Checkpoint();
+}
+									/*}}}*/
+// ProblemResolver::Rollback - Undo all changes since the last checkpoint	/*{{{*/
+// ---------------------------------------------------------------------
+/* */
+bool pkgProblemResolver::Rollback()
+{
+   if (Checkpoints.empty() == true)
+      return _error->Error("Internal error, resolver rollback without a checkpoint");
+
+   for (size_t I = FlagsJournal.size(); I > Checkpoints.back(); --I)
+      Flags[FlagsJournal[I - 1].first] = FlagsJournal[I - 1].second;
+   FlagsJournal.resize(Checkpoints.back());
+   Checkpoints.pop_back();
+   return Cache.Rollback();
+}
+									/*}}}*/
+// ProblemResolver::Commit - Keep all changes since the last checkpoint	/*{{{*/
+// ---------------------------------------------------------------------
+/* */
+bool pkgProblemResolver::Commit()
+{
+   if (Checkpoints.empty() == true)
+      return _error->Error("Internal error, resolver commit without a checkpoint");
+
+   Checkpoints.pop_back();
+   if (Checkpoints.empty() == true)
+      FlagsJournal.clear();
+   return Cache.Commit();
+}
+									/*}}}*/
 // ProblemResolver::ScoreSort - Sort the list by score			/*{{{*/
 // ---------------------------------------------------------------------
 /* */
@@ -432,7 +470,7 @@ void pkgProblemResolver::MakeScores()
    // Generate the base scores for a package based on its properties
    for (pkgCache::PkgIterator I = Cache.PkgBegin(); I.end() == false; ++I)
    {
-      if (Cache[I].InstallVer == 0)
+      if (Cache.IsStateComputed(I) == false || Cache[I].InstallVer == 0)
 	 continue;
       
       int &Score = Scores[I->ID];
@@ -467,6 +505,8 @@ void pkgProblemResolver::MakeScores()
 	 pkgCache::PkgIterator const T = D.TargetPkg();
 	 if (D->Version != 0)
 	 {
+	    if (Cache.IsStateComputed(T) == false)
+	       continue;
 	    pkgCache::VerIterator const IV = Cache[T].InstVerIter(Cache);
 	    if (IV.end() == true || D.IsSatisfied(IV) != D.IsNegative())
 	       continue;
@@ -484,13 +524,14 @@ void pkgProblemResolver::MakeScores()
       fortifies high scoring packages */
    for (pkgCache::PkgIterator I = Cache.PkgBegin(); I.end() == false; ++I)
    {
-      if (Cache[I].InstallVer == 0)
+      if (Cache.IsStateComputed(I) == false || Cache[I].InstallVer == 0)
 	 continue;
       
       for (pkgCache::DepIterator D = I.RevDependsList(); D.end() == false; ++D)
       {
 	 // Only do it for the install version
-	 if ((pkgCache::Version *)D.ParentVer() != Cache[D.ParentPkg()].InstallVer ||
+	 if (Cache.IsStateComputed(D.ParentPkg()) == false ||
+	     (pkgCache::Version *)D.ParentVer() != Cache[D.ParentPkg()].InstallVer ||
 	     (D->Type != pkgCache::Dep::Depends && 
 	      D->Type != pkgCache::Dep::PreDepends &&
 	      D->Type != pkgCache::Dep::Recommends))
@@ -510,7 +551,8 @@ void pkgProblemResolver::MakeScores()
       for (pkgCache::PrvIterator P = I.ProvidesList(); P.end() == false; ++P)
       {
 	 // Only do it once per package
-	 if ((pkgCache::Version *)P.OwnerVer() != Cache[P.OwnerPkg()].InstallVer)
+	 if (Cache.IsStateComputed(P.OwnerPkg()) == false ||
+	     (pkgCache::Version *)P.OwnerVer() != Cache[P.OwnerPkg()].InstallVer)
 	    continue;
 	 Scores[P.OwnerPkg()->ID] += abs(Scores[I->ID] - OldScores[I->ID]);
       }
@@ -675,6 +717,14 @@ bool pkgProblemResolver::ResolveInternal(bool const BrokenFix)
       Again = false;
       for (pkgCache::PkgIterator I = Cache.PkgBegin(); I.end() == false; ++I)
       {
+	 // packages the depcache hasn't looked at yet are kept and not broken
+	 if (Cache.IsStateComputed(I) == false)
+	 {
+	    Flags[I->ID] &= ~PreInstalled;
+	    Flags[I->ID] |= Upgradable;
+	    continue;
+	 }
+
 	 if (Cache[I].Install() == true)
 	    Flags[I->ID] |= PreInstalled;
 	 else
@@ -741,6 +791,8 @@ bool pkgProblemResolver::ResolveInternal(bool const BrokenFix)
       for (pkgCache::Package **K = PList; K != PEnd; K++)
       {
 	 pkgCache::PkgIterator I(Cache,*K);
+	 if (Cache.IsStateComputed(I) == false)
+	    continue;
 
 	 /* We attempt to install this and see if any breaks result,
 	    this takes care of some strange cases */
@@ -849,8 +901,9 @@ bool pkgProblemResolver::ResolveInternal(bool const BrokenFix)
 	    /* Look across the version list. If there are no possible
 	       targets then we keep the package and bail. This is necessary
 	       if a package has a dep on another package that can't be found */
-	    SPtrArray<pkgCache::Version *> VList = Start.AllTargets();
-	    if (*VList == 0 && (Flags[I->ID] & Protected) != Protected &&
+	    pkgCache::TargetIterator V(Start);
+	    bool const NoTargets = V.end();
+	    if (NoTargets == true && (Flags[I->ID] & Protected) != Protected &&
 		Start.IsNegative() == false &&
 		Cache[I].NowBroken() == false)
 	    {	       
@@ -867,9 +920,9 @@ bool pkgProblemResolver::ResolveInternal(bool const BrokenFix)
 	    }
 	    
 	    bool Done = false;
-	    for (pkgCache::Version **V = VList; *V != 0; V++)
+	    for (; V.end() == false; ++V)
 	    {
-	       pkgCache::VerIterator Ver(Cache,*V);
+	       pkgCache::VerIterator Ver = V.Ver();
 	       pkgCache::PkgIterator Pkg = Ver.ParentPkg();
 
                /* This is a conflicts, and the version we are looking
@@ -1000,7 +1053,7 @@ bool pkgProblemResolver::ResolveInternal(bool const BrokenFix)
 	    }
 
 	    // Hm, nothing can possibly satisify this dep. Nuke it.
-	    if (VList[0] == 0 &&
+	    if (NoTargets == true &&
 		Start.IsNegative() == false &&
 		(Flags[I->ID] & Protected) != Protected)
 	    {
@@ -1080,7 +1133,7 @@ bool pkgProblemResolver::ResolveInternal(bool const BrokenFix)
       pkgCache::PkgIterator I = Cache.PkgBegin();
       for (;I.end() != true; ++I)
       {
-	 if (Cache[I].InstBroken() == false)
+	 if (Cache.IsStateComputed(I) == false || Cache[I].InstBroken() == false)
 	    continue;
 	 if ((Flags[I->ID] & Protected) != Protected)
 	    return _error->Error(_("Error, pkgProblemResolver::Resolve generated breaks, this may be caused by held packages."));
@@ -1091,6 +1144,8 @@ bool pkgProblemResolver::ResolveInternal(bool const BrokenFix)
    // set the auto-flags (mvo: I'm not sure if we _really_ need this)
    pkgCache::PkgIterator I = Cache.PkgBegin();
    for (;I.end() != true; ++I) {
+      if (Cache.IsStateComputed(I) == false)
+	 continue;
       if (Cache[I].NewInstall() && !(Flags[I->ID] & PreInstalled)) {
 	 if(_config->FindI("Debug::pkgAutoRemove",false)) {
 	    std::clog << "Resolve installed new pkg: " << I.FullName(false) 
@@ -1239,11 +1294,9 @@ bool pkgProblemResolver::ResolveByKeepInternal()
 	       clog << "Package " << I.FullName(false) << " " << Start << endl;
 
 	    // Look at all the possible provides on this package
-	    SPtrArray<pkgCache::Version *> VList = Start.AllTargets();
-	    for (pkgCache::Version **V = VList; *V != 0; V++)
+	    for (pkgCache::TargetIterator V(Start); V.end() == false; ++V)
 	    {
-	       pkgCache::VerIterator Ver(Cache,*V);
-	       pkgCache::PkgIterator Pkg = Ver.ParentPkg();
+	       pkgCache::PkgIterator Pkg = V.ParentPkg();
 	       
 	       // It is not keepable
 	       if (Cache[Pkg].InstallVer == 0 ||
@@ -1322,7 +1375,7 @@ void pkgProblemResolver::InstallProtect()
 // ---------------------------------------------------------------------
 /* This is ment to be used in conjunction with AllTargets to get a list 
    of versions ordered by preference. */
-static pkgCache *PrioCache;
+static APT_THREAD_LOCAL pkgCache *PrioCache;
 static int PrioComp(const void *A,const void *B)
 {
    pkgCache::VerIterator L(*PrioCache,*(pkgCache::Version **)A);
@@ -38,6 +38,8 @@
 
 #include <iostream>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include <apt-pkg/macros.h>
 
@@ -113,7 +115,7 @@ class pkgProblemResolver						/*{{{*/
    bool Debug;
    
    // Sort stuff
-   static pkgProblemResolver *This;
+   static APT_THREAD_LOCAL pkgProblemResolver *This;
    static int ScoreSort(const void *a,const void *b) APT_PURE;
 
    struct PackageKill
@@ -122,6 +124,15 @@ class pkgProblemResolver						/*{{{*/
       DepIterator Dep;
    };
 
+   /** The previous flags changed since the first open checkpoint */
+   std::vector<std::pair<map_ptrloc, unsigned char> > FlagsJournal;
+   std::vector<size_t> Checkpoints;
+   inline void JournalFlags(pkgCache::PkgIterator const &Pkg)
+   {
+      if (Checkpoints.empty() == false)
+	 FlagsJournal.push_back(std::make_pair(Pkg->ID, Flags[Pkg->ID]));
+   }
+
    void MakeScores();
    bool DoUpgrade(pkgCache::PkgIterator Pkg);
 
@@ -133,9 +144,19 @@ class pkgProblemResolver						/*{{{*/
 
    public:
    
-   inline void Protect(pkgCache::PkgIterator Pkg) {Flags[Pkg->ID] |= Protected; Cache.MarkProtected(Pkg);};
-   inline void Remove(pkgCache::PkgIterator Pkg) {Flags[Pkg->ID] |= ToRemove;};
-   inline void Clear(pkgCache::PkgIterator Pkg) {Flags[Pkg->ID] &= ~(Protected | ToRemove);};
+   inline void Protect(pkgCache::PkgIterator Pkg) {JournalFlags(Pkg); Flags[Pkg->ID] |= Protected; Cache.MarkProtected(Pkg);};
+   inline void Remove(pkgCache::PkgIterator Pkg) {JournalFlags(Pkg); Flags[Pkg->ID] |= ToRemove;};
+   inline void Clear(pkgCache::PkgIterator Pkg) {JournalFlags(Pkg); Flags[Pkg->ID] &= ~(Protected | ToRemove);};
+
+   /** \brief open a checkpoint in the resolver and its depcache
+    *
+    *  Rolling back undoes the changes to the depcache as well as the
+    *  Protect, Remove and Clear calls made since the checkpoint, which
+    *  allows to try marking packages speculatively. See
+    *  pkgDepCache::Checkpoint for what is covered. */
+   void Checkpoint();
+   bool Rollback();
+   bool Commit();
    
    // Try to intelligently resolve problems by installing and removing packages   
    bool Resolve(bool BrokenFix = false);
@@ -29,7 +29,9 @@
 
 #include <string.h>
 #include <unistd.h>
+#include <sys/stat.h>
 #include <string>
+#include <sstream>
 #include <vector>
 
 #include <apti18n.h>
@@ -135,9 +137,38 @@ bool pkgCacheFile::BuildPolicy(OpProgress * /*Progress*/)
    return true;
 }
 									/*}}}*/
-// CacheFile::BuildDepCache - Open and build the dependency cache	/*{{{*/
+// PolicyStamp - Identify the pin files and options the policy reads	/*{{{*/
 // ---------------------------------------------------------------------
 /* */
+static std::string PolicyStamp()
+{
+   std::vector<std::string> Files;
+   Files.push_back(_config->FindFile("Dir::Etc::Preferences"));
+   std::string const Parts = _config->FindDir("Dir::Etc::PreferencesParts");
+   if (DirectoryExists(Parts) == true)
+   {
+      std::vector<std::string> const List = GetListOfFilesInDir(Parts, "pref", true, true);
+      Files.insert(Files.end(), List.begin(), List.end());
+   }
+
+   std::ostringstream Stamp;
+   Stamp << _config->Find("APT::Default-Release") << '\n';
+   for (std::vector<std::string>::const_iterator F = Files.begin(); F != Files.end(); ++F)
+   {
+      struct stat St;
+      if (stat(F->c_str(), &St) == 0)
+	 Stamp << *F << ' ' << St.st_size << ' ' << St.st_mtime << '\n';
+   }
+   return Stamp.str();
+}
+									/*}}}*/
+// CacheFile::BuildDepCache - Open and build the dependency cache	/*{{{*/
+// ---------------------------------------------------------------------
+/* The initial state only depends on the cache and the policy, so it is
+   kept in Dir::Cache::depstate and only generated again if one of them
+   changed. A lazy depcache doesn't write it: the status file is part of
+   the stamp, so after most dpkg runs it would have to compute the state
+   of everything, which is what APT::DepCache::Lazy avoids. */
 bool pkgCacheFile::BuildDepCache(OpProgress *Progress)
 {
    if (DCache != NULL)
@@ -147,7 +178,19 @@ bool pkgCacheFile::BuildDepCache(OpProgress *Progress)
    if (_error->PendingError() == true)
       return false;
 
+   std::string const StateFile = _config->FindFile("Dir::Cache::depstate");
+   if (Policy == NULL || StateFile.empty() == true)
+   {
+      DCache->Init(Progress);
+      return true;
+   }
+
+   std::string const Stamp = PolicyStamp();
+   if (DCache->ReadStateCache(StateFile, Stamp) == true)
+      return true;
    DCache->Init(Progress);
+   if (_config->FindB("APT::DepCache::Lazy", false) == false)
+      DCache->WriteStateCache(StateFile, Stamp);
    return true;
 }
 									/*}}}*/
@@ -180,6 +223,10 @@ void pkgCacheFile::RemoveCaches()
 {
    std::string const pkgcache = _config->FindFile("Dir::cache::pkgcache");
    std::string const srcpkgcache = _config->FindFile("Dir::cache::srcpkgcache");
+   std::string const depstate = _config->FindFile("Dir::cache::depstate");
+
+   if (depstate.empty() == false && RealFileExists(depstate) == true)
+      unlink(depstate.c_str());
 
    if (pkgcache.empty() == false && RealFileExists(pkgcache) == true)
       unlink(pkgcache.c_str());
@@ -210,7 +210,11 @@ class pkgCache::VerIterator : public Iterator<Version, VerIterator> {
 
 	// Accessors
 	inline const char *VerStr() const {return S->VerStr == 0?0:Owner->StrP + S->VerStr;}
-	inline const char *Section() const {return S->Section == 0?0:Owner->StrP + S->Section;}
+	inline VersionKey const &VerKey() const {return *((VersionKey const *)(Owner->StrP + S->VerStr) - 1);}
+	inline VersionDetails &Details() const {return Owner->VerDetailsP[S->Details];}
+	inline const char *Section() const {return Details().Section == 0?0:Owner->StrP + Details().Section;}
+	inline unsigned long long Size() const {return Details().Size;}
+	inline unsigned long long InstalledSize() const {return Details().InstalledSize;}
 	inline const char *Arch() const {
 		if ((S->MultiArch & pkgCache::Version::All) == pkgCache::Version::All)
 			return "all";
@@ -282,6 +286,7 @@ class pkgCache::DepIterator : public Iterator<Dependency, DepIterator> {
 
 	// Accessors
 	inline const char *TargetVer() const {return S->Version == 0?0:Owner->StrP + S->Version;}
+	inline VersionKey const &TargetVerKey() const {return *((VersionKey const *)(Owner->StrP + S->Version) - 1);}
 	inline PkgIterator TargetPkg() const {return PkgIterator(*Owner,Owner->PkgP + S->Package);}
 	inline PkgIterator SmartTargetPkg() const {PkgIterator R(*Owner,0);SmartTargetPkg(R);return R;}
 	inline VerIterator ParentVer() const {return VerIterator(*Owner,Owner->VerP + S->ParentVer);}
@@ -334,6 +339,7 @@ class pkgCache::PrvIterator : public Iterator<Provides, PrvIterator> {
 	// Accessors
 	inline const char *Name() const {return Owner->StrP + Owner->PkgP[S->ParentPkg].Name;}
 	inline const char *ProvideVersion() const {return S->ProvideVersion == 0?0:Owner->StrP + S->ProvideVersion;}
+	inline VersionKey const &ProvideVersionKey() const {return *((VersionKey const *)(Owner->StrP + S->ProvideVersion) - 1);}
 	inline PkgIterator ParentPkg() const {return PkgIterator(*Owner,Owner->PkgP + S->ParentPkg);}
 	inline VerIterator OwnerVer() const {return VerIterator(*Owner,Owner->VerP + S->Version);}
 	inline PkgIterator OwnerPkg() const {return PkgIterator(*Owner,Owner->PkgP + Owner->VerP[S->Version].ParentPkg);}
@@ -353,6 +359,61 @@ class pkgCache::PrvIterator : public Iterator<Provides, PrvIterator> {
 	}
 };
 									/*}}}*/
+// Target iterator							/*{{{*/
+/* Walks over all versions which can satisfy a dependency, like the list
+   returned by DepIterator::AllTargets: the versions of the target package
+   first, then the versions providing it. The satisfier index of the cache
+   is used if it has one, otherwise the versions and provides are checked
+   one by one. */
+class pkgCache::TargetIterator : public Iterator<Version, TargetIterator> {
+	DepIterator Dep;
+	// the entries of the dependency in the satisfier index, if there is one
+	map_ptrloc const *Cur;
+	map_ptrloc const *Provided;
+	map_ptrloc const *End;
+	// the provides checked while walking without index
+	PrvIterator Prv;
+
+	void Walk(bool const Advance);
+	void WalkFirst();
+
+	protected:
+	inline Version* OwnerPointer() const {
+		return (Owner != 0) ? Owner->VerP : 0;
+	}
+
+	public:
+	// Iteration
+	void operator ++(int) {
+		if (Cur == 0)
+			Walk(true);
+		else if (++Cur != End)
+			S = Owner->VerP + *Cur;
+		else
+			S = Owner->VerP;
+	}
+	inline void operator ++() {operator ++(0);}
+
+	// Accessors
+	inline VerIterator Ver() const {return VerIterator(*Owner,S);}
+	inline PkgIterator ParentPkg() const {return PkgIterator(*Owner,Owner->PkgP + S->ParentPkg);}
+	/** \brief the version satisfies the dependency with a provides */
+	inline bool IsProvided() const {return Cur == 0 ? Prv.Cache() != 0 : Cur >= Provided;}
+
+	inline TargetIterator(DepIterator const &D) :
+		Iterator<Version, TargetIterator>(*D.Cache()), Dep(D), Cur(0), Provided(0), End(0) {
+		if (Owner->HeaderP->Satisfiers == 0) {
+			WalkFirst();
+			return;
+		}
+		map_ptrloc const * const Index = Owner->HeaderP->SatisfiersP();
+		Cur = Index + Index[2 * D->ID];
+		Provided = Index + Index[2 * D->ID + 1];
+		End = Index + Index[2 * D->ID + 2];
+		S = Owner->VerP + (Cur != End ? *Cur : 0);
+	}
+};
+									/*}}}*/
 // Package file								/*{{{*/
 class pkgCache::PkgFileIterator : public Iterator<PackageFile, PkgFileIterator> {
 	protected:
@@ -436,7 +497,7 @@ inline pkgCache::DepIterator pkgCache::PkgIterator::RevDependsList() const
 inline pkgCache::PrvIterator pkgCache::PkgIterator::ProvidesList() const
        {return PrvIterator(*Owner,Owner->ProvideP + S->ProvidesList,S);}
 inline pkgCache::DescIterator pkgCache::VerIterator::DescriptionList() const
-       {return DescIterator(*Owner,Owner->DescP + S->DescriptionList);}
+       {return DescIterator(*Owner,Owner->DescP + Details().DescriptionList);}
 inline pkgCache::PrvIterator pkgCache::VerIterator::ProvidesList() const
        {return PrvIterator(*Owner,Owner->ProvideP + S->ProvidesList,S);}
 inline pkgCache::DepIterator pkgCache::VerIterator::DependsList() const
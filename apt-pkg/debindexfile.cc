@@ -30,6 +30,8 @@
 #include <apt-pkg/pkgcachegen.h>
 #include <apt-pkg/pkgrecords.h>
 #include <apt-pkg/srcrecords.h>
+#include <apt-pkg/sptr.h>
+#include <apt-pkg/tagfile.h>
 
 #include <stdio.h>
 #include <iostream>
@@ -105,6 +107,14 @@ string debSourcesIndex::Describe(bool Short) const
    return S;
 }
 									/*}}}*/
+// SourcesIndex::IndexFileName - Return the local file of the index	/*{{{*/
+// ---------------------------------------------------------------------
+/* */
+string debSourcesIndex::IndexFileName() const
+{
+   return IndexFile("Sources");
+}
+									/*}}}*/
 // SourcesIndex::Info - One liner describing the index URI		/*{{{*/
 // ---------------------------------------------------------------------
 /* */
@@ -233,6 +243,14 @@ string debPackagesIndex::Describe(bool Short) const
    return S;
 }
 									/*}}}*/
+// PackagesIndex::IndexFileName - Return the local file of the index	/*{{{*/
+// ---------------------------------------------------------------------
+/* */
+string debPackagesIndex::IndexFileName() const
+{
+   return IndexFile("Packages");
+}
+									/*}}}*/
 // PackagesIndex::Info - One liner describing the index URI		/*{{{*/
 // ---------------------------------------------------------------------
 /* */
@@ -318,8 +336,10 @@ unsigned long debPackagesIndex::Size() const
 bool debPackagesIndex::Merge(pkgCacheGenerator &Gen,OpProgress *Prog) const
 {
    string PackageFile = IndexFile("Packages");
-   FileFd Pkg(PackageFile,FileFd::ReadOnly, FileFd::Extension);
-   debListParser Parser(&Pkg, Architecture);
+   // the parser only reads it if the file wasn't preloaded
+   FileFd Pkg(PackageFile,FileFd::ReadOnly | FileFd::ReadAhead, FileFd::Extension);
+   SPtr<pkgTagFilePreload> Preload = Gen.TakePreload(PackageFile);
+   debListParser Parser(&Pkg, Preload, Architecture);
 
    if (_error->PendingError() == true)
       return _error->Error("Problem opening %s",PackageFile.c_str());
@@ -463,6 +483,14 @@ string debTranslationsIndex::Describe(bool Short) const
    return S;
 }
 									/*}}}*/
+// TranslationsIndex::IndexFileName - Return the local file of the index	/*{{{*/
+// ---------------------------------------------------------------------
+/* */
+string debTranslationsIndex::IndexFileName() const
+{
+   return IndexFile(Language);
+}
+									/*}}}*/
 // TranslationsIndex::Info - One liner describing the index URI		/*{{{*/
 // ---------------------------------------------------------------------
 /* */
@@ -483,6 +511,9 @@ string debTranslationsIndex::Info(const char *Type) const
 									/*}}}*/
 bool debTranslationsIndex::HasPackages() const				/*{{{*/
 {
+   // a lean cache has no descriptions to translate
+   if (_config->FindB("APT::Cache-Lean", false) == true)
+      return false;
    return FileExists(IndexFile(Language));
 }
 									/*}}}*/
@@ -524,8 +555,9 @@ bool debTranslationsIndex::Merge(pkgCacheGenerator &Gen,OpProgress *Prog) const
    string TranslationFile = IndexFile(Language);
    if (FileExists(TranslationFile))
    {
-     FileFd Trans(TranslationFile,FileFd::ReadOnly, FileFd::Extension);
-     debTranslationsParser TransParser(&Trans);
+     FileFd Trans(TranslationFile,FileFd::ReadOnly | FileFd::ReadAhead, FileFd::Extension);
+     SPtr<pkgTagFilePreload> Preload = Gen.TakePreload(TranslationFile);
+     debTranslationsParser TransParser(&Trans, Preload);
      if (_error->PendingError() == true)
        return false;
      
@@ -605,7 +637,8 @@ bool debStatusIndex::Merge(pkgCacheGenerator &Gen,OpProgress *Prog) const
    FileFd Pkg(File,FileFd::ReadOnly, FileFd::Extension);
    if (_error->PendingError() == true)
       return false;
-   debListParser Parser(&Pkg);
+   SPtr<pkgTagFilePreload> Preload = Gen.TakePreload(File);
+   debListParser Parser(&Pkg, Preload);
    if (_error->PendingError() == true)
       return false;
 
@@ -42,6 +42,7 @@ class debStatusIndex : public pkgIndexFile
    
    // Interface for acquire
    virtual std::string Describe(bool /*Short*/) const {return File;};
+   virtual std::string IndexFileName() const {return File;};
    
    // Interface for the Cache Generator
    virtual bool Exists() const;
@@ -79,6 +80,7 @@ class debPackagesIndex : public pkgIndexFile
    
    // Interface for acquire
    virtual std::string Describe(bool Short) const;   
+   virtual std::string IndexFileName() const;
    
    // Interface for the Cache Generator
    virtual bool Exists() const;
@@ -114,6 +116,7 @@ class debTranslationsIndex : public pkgIndexFile
 
    // Interface for acquire
    virtual std::string Describe(bool Short) const;   
+   virtual std::string IndexFileName() const;
    virtual bool GetIndexes(pkgAcquire *Owner) const;
    
    // Interface for the Cache Generator
@@ -151,6 +154,7 @@ class debSourcesIndex : public pkgIndexFile
    
    // Interface for acquire
    virtual std::string Describe(bool Short) const;   
+   virtual std::string IndexFileName() const;
 
    // Interface for the record parsers
    virtual pkgSrcRecords::Parser *CreateSrcParser() const;
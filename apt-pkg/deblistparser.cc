@@ -56,16 +56,24 @@ debListParser::debListParser(FileFd *File, string const &Arch) : Tags(File),
       this->Arch = _config->Find("APT::Architecture");
    Architectures = APT::Configuration::getArchitectures();
    MultiArchEnabled = Architectures.size() > 1;
+}
+debListParser::debListParser(FileFd *File, pkgTagFilePreload *Preload,
+			     string const &Arch) : Tags(File, Preload),
+				Arch(Arch) {
+   if (Arch == "native")
+      this->Arch = _config->Find("APT::Architecture");
+   Architectures = APT::Configuration::getArchitectures();
+   MultiArchEnabled = Architectures.size() > 1;
 }
 									/*}}}*/
 // ListParser::UniqFindTagWrite - Find the tag and write a unq string	/*{{{*/
 // ---------------------------------------------------------------------
 /* */
-unsigned long debListParser::UniqFindTagWrite(const char *Tag)
+unsigned long debListParser::UniqFindTagWrite(pkgTagSection::Field::Key const Key)
 {
    const char *Start;
    const char *Stop;
-   if (Section.Find(Tag,Start,Stop) == false)
+   if (Section.Find(Key,Start,Stop) == false)
       return 0;
    return WriteUniqString(Start,Stop - Start);
 }
@@ -74,7 +82,7 @@ unsigned long debListParser::UniqFindTagWrite(const char *Tag)
 // ---------------------------------------------------------------------
 /* This is to return the name of the package this section describes */
 string debListParser::Package() {
-   string const Result = Section.FindS("Package");
+   string const Result = Section.FindS(pkgTagSection::Field::Package);
    if(unlikely(Result.empty() == true))
       _error->Error("Encountered a section with no Package: header");
    return Result;
@@ -84,14 +92,14 @@ string debListParser::Package() {
 // ---------------------------------------------------------------------
 /* This will return the Architecture of the package this section describes */
 string debListParser::Architecture() {
-   return Section.FindS("Architecture");
+   return Section.FindS(pkgTagSection::Field::Architecture);
 }
 									/*}}}*/
 // ListParser::ArchitectureAll						/*{{{*/
 // ---------------------------------------------------------------------
 /* */
 bool debListParser::ArchitectureAll() {
-   return Section.FindS("Architecture") == "all";
+   return Section.FindS(pkgTagSection::Field::Architecture) == "all";
 }
 									/*}}}*/
 // ListParser::Version - Return the version string			/*{{{*/
@@ -101,13 +109,13 @@ bool debListParser::ArchitectureAll() {
    entry is assumed to only describe package properties */
 string debListParser::Version()
 {
-   return Section.FindS("Version");
+   return Section.FindS(pkgTagSection::Field::Version);
 }
 									/*}}}*/
 unsigned char debListParser::ParseMultiArch(bool const showErrors)	/*{{{*/
 {
    unsigned char MA;
-   string const MultiArch = Section.FindS("Multi-Arch");
+   string const MultiArch = Section.FindS(pkgTagSection::Field::MultiArch);
    if (MultiArch.empty() == true)
       MA = pkgCache::Version::None;
    else if (MultiArch == "same") {
@@ -115,7 +123,7 @@ unsigned char debListParser::ParseMultiArch(bool const showErrors)	/*{{{*/
       {
 	 if (showErrors == true)
 	    _error->Warning("Architecture: all package '%s' can't be Multi-Arch: same",
-		  Section.FindS("Package").c_str());
+		  Section.FindS(pkgTagSection::Field::Package).c_str());
 	 MA = pkgCache::Version::None;
       }
       else
@@ -129,7 +137,7 @@ unsigned char debListParser::ParseMultiArch(bool const showErrors)	/*{{{*/
    {
       if (showErrors == true)
 	 _error->Warning("Unknown Multi-Arch type '%s' for package '%s'",
-	       MultiArch.c_str(), Section.FindS("Package").c_str());
+	       MultiArch.c_str(), Section.FindS(pkgTagSection::Field::Package).c_str());
       MA = pkgCache::Version::None;
    }
 
@@ -145,43 +153,44 @@ unsigned char debListParser::ParseMultiArch(bool const showErrors)	/*{{{*/
 bool debListParser::NewVersion(pkgCache::VerIterator &Ver)
 {
    // Parse the section
-   unsigned long const idxSection = UniqFindTagWrite("Section");
-   Ver->Section = idxSection;
+   unsigned long const idxSection = UniqFindTagWrite(pkgTagSection::Field::Section);
+   pkgCache::VersionDetails &Details = Ver.Details();
+   Details.Section = idxSection;
    Ver->MultiArch = ParseMultiArch(true);
    // Archive Size
-   Ver->Size = Section.FindULL("Size");
+   Details.Size = Section.FindULL(pkgTagSection::Field::Size);
    // Unpacked Size (in K)
-   Ver->InstalledSize = Section.FindULL("Installed-Size");
-   Ver->InstalledSize *= 1024;
+   Details.InstalledSize = Section.FindULL(pkgTagSection::Field::InstalledSize);
+   Details.InstalledSize *= 1024;
 
    // Priority
    const char *Start;
    const char *Stop;
-   if (Section.Find("Priority",Start,Stop) == true)
+   if (Section.Find(pkgTagSection::Field::Priority,Start,Stop) == true)
    {      
       if (GrabWord(string(Start,Stop-Start),PrioList,Ver->Priority) == false)
 	 Ver->Priority = pkgCache::State::Extra;
    }
 
-   if (ParseDepends(Ver,"Depends",pkgCache::Dep::Depends) == false)
+   if (ParseDepends(Ver,pkgTagSection::Field::Depends,pkgCache::Dep::Depends) == false)
       return false;
-   if (ParseDepends(Ver,"Pre-Depends",pkgCache::Dep::PreDepends) == false)
+   if (ParseDepends(Ver,pkgTagSection::Field::PreDepends,pkgCache::Dep::PreDepends) == false)
       return false;
-   if (ParseDepends(Ver,"Suggests",pkgCache::Dep::Suggests) == false)
+   if (ParseDepends(Ver,pkgTagSection::Field::Suggests,pkgCache::Dep::Suggests) == false)
       return false;
-   if (ParseDepends(Ver,"Recommends",pkgCache::Dep::Recommends) == false)
+   if (ParseDepends(Ver,pkgTagSection::Field::Recommends,pkgCache::Dep::Recommends) == false)
       return false;
-   if (ParseDepends(Ver,"Conflicts",pkgCache::Dep::Conflicts) == false)
+   if (ParseDepends(Ver,pkgTagSection::Field::Conflicts,pkgCache::Dep::Conflicts) == false)
       return false;
-   if (ParseDepends(Ver,"Breaks",pkgCache::Dep::DpkgBreaks) == false)
+   if (ParseDepends(Ver,pkgTagSection::Field::Breaks,pkgCache::Dep::DpkgBreaks) == false)
       return false;
-   if (ParseDepends(Ver,"Replaces",pkgCache::Dep::Replaces) == false)
+   if (ParseDepends(Ver,pkgTagSection::Field::Replaces,pkgCache::Dep::Replaces) == false)
       return false;
-   if (ParseDepends(Ver,"Enhances",pkgCache::Dep::Enhances) == false)
+   if (ParseDepends(Ver,pkgTagSection::Field::Enhances,pkgCache::Dep::Enhances) == false)
       return false;
 
    // Obsolete.
-   if (ParseDepends(Ver,"Optional",pkgCache::Dep::Suggests) == false)
+   if (ParseDepends(Ver,pkgTagSection::Field::Optional,pkgCache::Dep::Suggests) == false)
       return false;
    
    if (ParseProvides(Ver) == false)
@@ -199,7 +208,7 @@ string debListParser::Description()
 {
    string const lang = DescriptionLanguage();
    if (lang.empty())
-      return Section.FindS("Description");
+      return Section.FindS(pkgTagSection::Field::Description);
    else
       return Section.FindS(string("Description-").append(lang).c_str());
 }
@@ -211,7 +220,7 @@ string debListParser::Description()
    assumed to describe original description. */
 string debListParser::DescriptionLanguage()
 {
-   if (Section.FindS("Description").empty() == false)
+   if (Section.FindS(pkgTagSection::Field::Description).empty() == false)
       return "";
 
    std::vector<string> const lang = APT::Configuration::getLanguages(true);
@@ -231,7 +240,7 @@ string debListParser::DescriptionLanguage()
  */
 MD5SumValue debListParser::Description_md5()
 {
-   string const value = Section.FindS("Description-md5");
+   string const value = Section.FindS(pkgTagSection::Field::DescriptionMD5);
    if (value.empty() == true)
    {
       std::string const desc = Description() + "\n";
@@ -262,7 +271,7 @@ bool debListParser::UsePackage(pkgCache::PkgIterator &Pkg,
 {
    if (Pkg->Section == 0)
    {
-      unsigned long const idxSection = UniqFindTagWrite("Section");
+      unsigned long const idxSection = UniqFindTagWrite(pkgTagSection::Field::Section);
       Pkg->Section = idxSection;
    }
 
@@ -272,9 +281,9 @@ bool debListParser::UsePackage(pkgCache::PkgIterator &Pkg,
    string const static essential = _config->Find("pkgCacheGen::Essential", "all");
    if (essential == "all" ||
        (essential == "native" && Pkg->Arch != 0 && myArch == Pkg.Arch()))
-      if (Section.FindFlag("Essential",Pkg->Flags,pkgCache::Flag::Essential) == false)
+      if (Section.FindFlag(pkgTagSection::Field::Essential,Pkg->Flags,pkgCache::Flag::Essential) == false)
 	 return false;
-   if (Section.FindFlag("Important",Pkg->Flags,pkgCache::Flag::Important) == false)
+   if (Section.FindFlag(pkgTagSection::Field::Important,Pkg->Flags,pkgCache::Flag::Important) == false)
       return false;
 
    if (strcmp(Pkg.Name(),"apt") == 0)
@@ -296,17 +305,19 @@ bool debListParser::UsePackage(pkgCache::PkgIterator &Pkg,
 /* */
 unsigned short debListParser::VersionHash()
 {
-   const char *Sections[] ={"Installed-Size",
-                            "Depends",
-                            "Pre-Depends",
-//                            "Suggests",
-//                            "Recommends",
-                            "Conflicts",
-                            "Breaks",
-                            "Replaces",0};
+   pkgTagSection::Field::Key const Sections[] = {
+      pkgTagSection::Field::InstalledSize,
+      pkgTagSection::Field::Depends,
+      pkgTagSection::Field::PreDepends,
+//      pkgTagSection::Field::Suggests,
+//      pkgTagSection::Field::Recommends,
+      pkgTagSection::Field::Conflicts,
+      pkgTagSection::Field::Breaks,
+      pkgTagSection::Field::Replaces,
+      pkgTagSection::Field::Count};
    unsigned long Result = INIT_FCS;
    char S[1024];
-   for (const char * const *I = Sections; *I != 0; ++I)
+   for (pkgTagSection::Field::Key const *I = Sections; *I != pkgTagSection::Field::Count; ++I)
    {
       const char *Start;
       const char *End;
@@ -351,13 +362,13 @@ bool debListParser::ParseStatus(pkgCache::PkgIterator &Pkg,
 {
    const char *Start;
    const char *Stop;
-   if (Section.Find("Status",Start,Stop) == false)
+   if (Section.Find(pkgTagSection::Field::Status,Start,Stop) == false)
       return true;
 
    // UsePackage() is responsible for setting the flag in the default case
    bool const static essential = _config->Find("pkgCacheGen::Essential", "") == "installed";
    if (essential == true &&
-       Section.FindFlag("Essential",Pkg->Flags,pkgCache::Flag::Essential) == false)
+       Section.FindFlag(pkgTagSection::Field::Essential,Pkg->Flags,pkgCache::Flag::Essential) == false)
       return false;
 
    // Isolate the first word
@@ -721,11 +732,12 @@ const char *debListParser::ParseDepends(const char *Start,const char *Stop,
 /* This is the higher level depends parser. It takes a tag and generates
    a complete depends tree for the given version. */
 bool debListParser::ParseDepends(pkgCache::VerIterator &Ver,
-				 const char *Tag,unsigned int Type)
+				 pkgTagSection::Field::Key const Key,
+				 unsigned int Type)
 {
    const char *Start;
    const char *Stop;
-   if (Section.Find(Tag,Start,Stop) == false)
+   if (Section.Find(Key,Start,Stop) == false)
       return true;
 
    string const pkgArch = Ver.Arch();
@@ -738,7 +750,8 @@ bool debListParser::ParseDepends(pkgCache::VerIterator &Ver,
 
       Start = ParseDepends(Start, Stop, Package, Version, Op, false, false, false);
       if (Start == 0)
-	 return _error->Error("Problem parsing dependency %s",Tag);
+	 return _error->Error("Problem parsing dependency %s",
+			      pkgTagSection::Field::Name(Key));
       size_t const found = Package.rfind(':');
 
       // If negative is unspecific it needs to apply on all architectures
@@ -791,7 +804,7 @@ bool debListParser::ParseProvides(pkgCache::VerIterator &Ver)
 {
    const char *Start;
    const char *Stop;
-   if (Section.Find("Provides",Start,Stop) == true)
+   if (Section.Find(pkgTagSection::Field::Provides,Start,Stop) == true)
    {
       string Package;
       string Version;
@@ -868,7 +881,7 @@ bool debListParser::Step()
       /* See if this is the correct Architecture, if it isn't then we
          drop the whole section. A missing arch tag only happens (in theory)
          inside the Status file, so that is a positive return */
-      string const Architecture = Section.FindS("Architecture");
+      string const Architecture = Section.FindS(pkgTagSection::Field::Architecture);
 
       if (Arch.empty() == true || Arch == "any" || MultiArchEnabled == false)
       {
@@ -951,8 +964,8 @@ bool debListParser::SameVersion(unsigned short const Hash,		/*{{{*/
    // status file has no (Download)Size, but all others are fair game
    // status file is parsed last, so the first version we encounter is
    // probably also the version we have downloaded
-   unsigned long long const Size = Section.FindULL("Size");
-   if (Size != 0 && Size != Ver->Size)
+   unsigned long long const Size = Section.FindULL(pkgTagSection::Field::Size);
+   if (Size != 0 && Size != Ver.Size())
       return false;
    // available everywhere, but easier to check here than to include in VersionHash
    unsigned char MultiArch = ParseMultiArch(false);
@@ -49,9 +49,9 @@ class debListParser : public pkgCacheGenerator::ListParser
    std::vector<std::string> Architectures;
    bool MultiArchEnabled;
 
-   unsigned long UniqFindTagWrite(const char *Tag);
+   unsigned long UniqFindTagWrite(pkgTagSection::Field::Key const Key);
    virtual bool ParseStatus(pkgCache::PkgIterator &Pkg,pkgCache::VerIterator &Ver);
-   bool ParseDepends(pkgCache::VerIterator &Ver,const char *Tag,
+   bool ParseDepends(pkgCache::VerIterator &Ver,pkgTagSection::Field::Key const Key,
 		     unsigned int Type);
    bool ParseProvides(pkgCache::VerIterator &Ver);
    bool NewProvidesAllArch(pkgCache::VerIterator &Ver, std::string const &Package, std::string const &Version);
@@ -100,6 +100,7 @@ class debListParser : public pkgCacheGenerator::ListParser
    static const char *ConvertRelation(const char *I,unsigned int &Op);
 
    debListParser(FileFd *File, std::string const &Arch = "");
+   debListParser(FileFd *File, pkgTagFilePreload *Preload, std::string const &Arch = "");
    virtual ~debListParser() {};
 
    private:
@@ -115,6 +116,8 @@ class debTranslationsParser : public debListParser
 
    debTranslationsParser(FileFd *File, std::string const &Arch = "")
       : debListParser(File, Arch) {};
+   debTranslationsParser(FileFd *File, pkgTagFilePreload *Preload)
+      : debListParser(File, Preload) {};
 };
 
 #endif
@@ -54,7 +54,7 @@ bool debRecordParser::Jump(pkgCache::DescFileIterator const &Desc)
 /* */
 string debRecordParser::FileName()
 {
-   return Section.FindS("Filename");
+   return Section.FindS(pkgTagSection::Field::Filename);
 }
 									/*}}}*/
 // RecordParser::Name - Return the package name				/*{{{*/
@@ -62,7 +62,7 @@ string debRecordParser::FileName()
 /* */
 string debRecordParser::Name()
 {
-   return Section.FindS("Package");
+   return Section.FindS(pkgTagSection::Field::Package);
 }
 									/*}}}*/
 // RecordParser::Homepage - Return the package homepage		       	/*{{{*/
@@ -70,7 +70,7 @@ string debRecordParser::Name()
 /* */
 string debRecordParser::Homepage()
 {
-   return Section.FindS("Homepage");
+   return Section.FindS(pkgTagSection::Field::Homepage);
 }
 									/*}}}*/
 // RecordParser::MD5Hash - Return the archive hash			/*{{{*/
@@ -78,7 +78,7 @@ string debRecordParser::Homepage()
 /* */
 string debRecordParser::MD5Hash()
 {
-   return Section.FindS("MD5Sum");
+   return Section.FindS(pkgTagSection::Field::MD5Sum);
 }
 									/*}}}*/
 // RecordParser::SHA1Hash - Return the archive hash			/*{{{*/
@@ -86,7 +86,7 @@ string debRecordParser::MD5Hash()
 /* */
 string debRecordParser::SHA1Hash()
 {
-   return Section.FindS("SHA1");
+   return Section.FindS(pkgTagSection::Field::SHA1);
 }
 									/*}}}*/
 // RecordParser::SHA256Hash - Return the archive hash			/*{{{*/
@@ -94,7 +94,7 @@ string debRecordParser::SHA1Hash()
 /* */
 string debRecordParser::SHA256Hash()
 {
-   return Section.FindS("SHA256");
+   return Section.FindS(pkgTagSection::Field::SHA256);
 }
 									/*}}}*/
 // RecordParser::SHA512Hash - Return the archive hash			/*{{{*/
@@ -102,7 +102,7 @@ string debRecordParser::SHA256Hash()
 /* */
 string debRecordParser::SHA512Hash()
 {
-   return Section.FindS("SHA512");
+   return Section.FindS(pkgTagSection::Field::SHA512);
 }
 									/*}}}*/
 // RecordParser::Maintainer - Return the maintainer email		/*{{{*/
@@ -110,7 +110,7 @@ string debRecordParser::SHA512Hash()
 /* */
 string debRecordParser::Maintainer()
 {
-   return Section.FindS("Maintainer");
+   return Section.FindS(pkgTagSection::Field::Maintainer);
 }
 									/*}}}*/
 // RecordParser::RecordField - Return the value of an arbitrary field       /*{{*/
@@ -141,8 +141,8 @@ string debRecordParser::LongDesc()
 {
   string orig, dest;
 
-  if (!Section.FindS("Description").empty())
-     orig = Section.FindS("Description").c_str();
+  if (!Section.FindS(pkgTagSection::Field::Description).empty())
+     orig = Section.FindS(pkgTagSection::Field::Description).c_str();
   else
   {
      std::vector<string> const lang = APT::Configuration::getLanguages();
@@ -168,7 +168,7 @@ static const char *SourceVerSeparators = " ()";
 /* */
 string debRecordParser::SourcePkg()
 {
-   string Res = Section.FindS("Source");
+   string Res = Section.FindS(pkgTagSection::Field::Source);
    string::size_type Pos = Res.find_first_of(SourceVerSeparators);
    if (Pos == string::npos)
       return Res;
@@ -180,7 +180,7 @@ string debRecordParser::SourcePkg()
 /* */
 string debRecordParser::SourceVer()
 {
-   string Pkg = Section.FindS("Source");
+   string Pkg = Section.FindS(pkgTagSection::Field::Source);
    string::size_type Pos = Pkg.find_first_of(SourceVerSeparators);
    if (Pos == string::npos)
       return "";
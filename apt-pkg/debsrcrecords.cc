@@ -40,7 +40,7 @@ using std::string;
 const char **debSrcRecordParser::Binaries()
 {
    const char *Start, *End;
-   if (Sect.Find("Binary", Start, End) == false)
+   if (Sect.Find(pkgTagSection::Field::Binary, Start, End) == false)
       return NULL;
    for (; isspace(*Start) != 0; ++Start);
    if (Start >= End)
@@ -79,10 +79,10 @@ bool debSrcRecordParser::BuildDepends(std::vector<pkgSrcRecords::Parser::BuildDe
    unsigned int I;
    const char *Start, *Stop;
    BuildDepRec rec;
-   const char *fields[] = {"Build-Depends", 
-                           "Build-Depends-Indep",
-			   "Build-Conflicts",
-			   "Build-Conflicts-Indep"};
+   pkgTagSection::Field::Key const fields[] = {pkgTagSection::Field::BuildDepends,
+                           pkgTagSection::Field::BuildDependsIndep,
+			   pkgTagSection::Field::BuildConflicts,
+			   pkgTagSection::Field::BuildConflictsIndep};
 
    BuildDeps.clear();
 
@@ -100,7 +100,8 @@ bool debSrcRecordParser::BuildDepends(std::vector<pkgSrcRecords::Parser::BuildDe
 		     rec.Package,rec.Version,rec.Op,true,StripMultiArch,true);
 	 
          if (Start == 0) 
-            return _error->Error("Problem parsing dependency: %s", fields[I]);
+            return _error->Error("Problem parsing dependency: %s",
+				 pkgTagSection::Field::Name(fields[I]));
 	 rec.Type = I;
 
 	 if (rec.Package != "")
@@ -122,12 +123,12 @@ bool debSrcRecordParser::Files(std::vector<pkgSrcRecords::File> &List)
 {
    List.erase(List.begin(),List.end());
    
-   string Files = Sect.FindS("Files");
+   string Files = Sect.FindS(pkgTagSection::Field::Files);
    if (Files.empty() == true)
       return false;
 
    // Stash the / terminated directory prefix
-   string Base = Sect.FindS("Directory");
+   string Base = Sect.FindS(pkgTagSection::Field::Directory);
    if (Base.empty() == false && Base[Base.length()-1] != '/')
       Base += '/';
 
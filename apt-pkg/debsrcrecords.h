@@ -39,10 +39,10 @@ class debSrcRecordParser : public pkgSrcRecords::Parser
    virtual bool Step() {iOffset = Tags.Offset(); return Tags.Step(Sect);};
    virtual bool Jump(unsigned long const &Off) {iOffset = Off; return Tags.Jump(Sect,Off);};
 
-   virtual std::string Package() const {return Sect.FindS("Package");};
-   virtual std::string Version() const {return Sect.FindS("Version");};
-   virtual std::string Maintainer() const {return Sect.FindS("Maintainer");};
-   virtual std::string Section() const {return Sect.FindS("Section");};
+   virtual std::string Package() const {return Sect.FindS(pkgTagSection::Field::Package);};
+   virtual std::string Version() const {return Sect.FindS(pkgTagSection::Field::Version);};
+   virtual std::string Maintainer() const {return Sect.FindS(pkgTagSection::Field::Maintainer);};
+   virtual std::string Section() const {return Sect.FindS(pkgTagSection::Field::Section);};
    virtual const char **Binaries();
    virtual bool BuildDepends(std::vector<BuildDepRec> &BuildDeps, bool const &ArchOnly, bool const &StripMultiArch = true);
    virtual unsigned long Offset() {return iOffset;};
@@ -55,7 +55,7 @@ class debSrcRecordParser : public pkgSrcRecords::Parser
    virtual bool Files(std::vector<pkgSrcRecords::File> &F);
 
    debSrcRecordParser(std::string const &File,pkgIndexFile const *Index) 
-      : Parser(Index), Fd(File,FileFd::ReadOnly, FileFd::Extension), Tags(&Fd,102400),
+      : Parser(Index), Fd(File,FileFd::ReadOnly | FileFd::ReadAhead, FileFd::Extension), Tags(&Fd,102400),
         iOffset(0), Buffer(NULL) {}
    virtual ~debSrcRecordParser();
 };
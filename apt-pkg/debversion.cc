@@ -122,6 +122,41 @@ int debVersioningSystem::CmpFragment(const char *A,const char *AEnd,
    return 1;
 }
 									/*}}}*/
+// CmpUpstreamRevision - Compare the versions without the epoch	/*{{{*/
+// ---------------------------------------------------------------------
+/* The upstream version starts at lhs and ends at dlhs, which is either
+   the last - or the end of the version. */
+static int CmpUpstreamRevision(const char *lhs,const char *dlhs,const char *AEnd,
+			       const char *rhs,const char *drhs,const char *BEnd)
+{
+   // Compare the main version
+   int Res = debVersioningSystem::CmpFragment(lhs,dlhs,rhs,drhs);
+   if (Res != 0)
+      return Res;
+   
+   // Skip the -
+   if (dlhs != lhs)
+      dlhs++;
+   if (drhs != rhs)
+      drhs++;
+
+   // no debian revision need to be treated like -0
+   if (*(dlhs-1) == '-' && *(drhs-1) == '-')
+      return debVersioningSystem::CmpFragment(dlhs,AEnd,drhs,BEnd);
+   else if (*(dlhs-1) == '-')
+   {
+      const char* null = "0";
+      return debVersioningSystem::CmpFragment(dlhs,AEnd,null, null+1);
+   }
+   else if (*(drhs-1) == '-')
+   {
+      const char* null = "0";
+      return debVersioningSystem::CmpFragment(null, null+1, drhs, BEnd);
+   }
+   else
+      return 0;
+}
+									/*}}}*/
 // debVS::CmpVersion - Comparison for versions				/*{{{*/
 // ---------------------------------------------------------------------
 /* This fragments the version into E:V-R triples and compares each 
@@ -176,55 +211,13 @@ int debVersioningSystem::DoCmpVersion(const char *A,const char *AEnd,
       dlhs = AEnd;
    if (drhs == NULL)
       drhs = BEnd;
-   
-   // Compare the main version
-   Res = CmpFragment(lhs,dlhs,rhs,drhs);
-   if (Res != 0)
-      return Res;
-   
-   // Skip the -
-   if (dlhs != lhs)
-      dlhs++;
-   if (drhs != rhs)
-      drhs++;
 
-   // no debian revision need to be treated like -0
-   if (*(dlhs-1) == '-' && *(drhs-1) == '-')
-      return CmpFragment(dlhs,AEnd,drhs,BEnd);
-   else if (*(dlhs-1) == '-')
-   {
-      const char* null = "0";
-      return CmpFragment(dlhs,AEnd,null, null+1);
-   }
-   else if (*(drhs-1) == '-')
-   {
-      const char* null = "0";
-      return CmpFragment(null, null+1, drhs, BEnd);
-   }
-   else
-      return 0;
+   return CmpUpstreamRevision(lhs,dlhs,AEnd,rhs,drhs,BEnd);
 }
 									/*}}}*/
-// debVS::CheckDep - Check a single dependency				/*{{{*/
-// ---------------------------------------------------------------------
-/* This simply preforms the version comparison and switch based on 
-   operator. If DepVer is 0 then we are comparing against a provides
-   with no version. */
-bool debVersioningSystem::CheckDep(const char *PkgVer,
-				   int Op,const char *DepVer)
+// CheckDepResult - Check the result of a comparison against the operator	/*{{{*/
+static bool CheckDepResult(int const Res,int const Op)
 {
-   if (DepVer == 0 || DepVer[0] == 0)
-      return true;
-   if (PkgVer == 0 || PkgVer[0] == 0)
-      return false;
-   Op &= 0x0F;
-
-   // fast track for (equal) strings [by location] which are by definition equal versions
-   if (PkgVer == DepVer)
-      return Op == pkgCache::Dep::Equals || Op == pkgCache::Dep::LessEq || Op == pkgCache::Dep::GreaterEq;
-
-   // Perform the actual comparison.
-   int const Res = CmpVersion(PkgVer, DepVer);
    switch (Op)
    {
       case pkgCache::Dep::LessEq:
@@ -261,6 +254,132 @@ bool debVersioningSystem::CheckDep(const char *PkgVer,
    return false;
 }
 									/*}}}*/
+// debVS::CheckDep - Check a single dependency				/*{{{*/
+// ---------------------------------------------------------------------
+/* This simply preforms the version comparison and switch based on 
+   operator. If DepVer is 0 then we are comparing against a provides
+   with no version. */
+bool debVersioningSystem::CheckDep(const char *PkgVer,
+				   int Op,const char *DepVer)
+{
+   if (DepVer == 0 || DepVer[0] == 0)
+      return true;
+   if (PkgVer == 0 || PkgVer[0] == 0)
+      return false;
+   Op &= 0x0F;
+
+   // fast track for (equal) strings [by location] which are by definition equal versions
+   if (PkgVer == DepVer)
+      return Op == pkgCache::Dep::Equals || Op == pkgCache::Dep::LessEq || Op == pkgCache::Dep::GreaterEq;
+
+   // Perform the actual comparison.
+   return CheckDepResult(CmpVersion(PkgVer, DepVer), Op);
+}
+									/*}}}*/
+// debVS::CheckDepKey - Check a single dependency of the cache		/*{{{*/
+// ---------------------------------------------------------------------
+/* Like CheckDep, just with the keys stored with the versions */
+bool debVersioningSystem::CheckDepKey(pkgCache::VersionKey const &PkgKey,const char *PkgVer,
+				      int Op,pkgCache::VersionKey const &DepKey,const char *DepVer)
+{
+   if (DepVer == 0 || DepVer[0] == 0)
+      return true;
+   if (PkgVer == 0 || PkgVer[0] == 0)
+      return false;
+   Op &= 0x0F;
+
+   if (PkgVer == DepVer)
+      return Op == pkgCache::Dep::Equals || Op == pkgCache::Dep::LessEq || Op == pkgCache::Dep::GreaterEq;
+
+   return CheckDepResult(CmpVersionKey(PkgKey, PkgVer, DepKey, DepVer), Op);
+}
+									/*}}}*/
+// debVS::MakeVersionKey - Parse a version for the cache		/*{{{*/
+// ---------------------------------------------------------------------
+/* The key holds the value of the epoch and where the upstream version
+   and the revision start. The SortKey is the first number of the
+   upstream version (plus one), if that is where it starts: DoCmpVersion
+   decides on that number alone if it differs. Versions this can't be
+   done for safely get no usable key. */
+void debVersioningSystem::MakeVersionKey(const char *A,const char *AEnd,
+					 pkgCache::VersionKey &Key)
+{
+   memset(&Key, 0, sizeof(Key));
+   Key.Epoch = pkgCache::VersionKey::NoEpoch;
+   if (AEnd - A > 0xFFFF)
+      return;
+
+   // Only a plain number is accepted as epoch
+   unsigned int Epoch = 0;
+   const char *lhs = (const char*) memchr(A, ':', AEnd - A);
+   if (lhs == NULL)
+      lhs = A;
+   else
+   {
+      if (lhs == A)
+	 return;
+      const char *I = A;
+      for (; *I == '0'; ++I);
+      if (lhs - I > 9)
+	 return;
+      for (; I != lhs; ++I)
+      {
+	 if (isdigit(*I) == 0)
+	    return;
+	 Epoch = Epoch * 10 + (*I - '0');
+      }
+      ++lhs;
+   }
+
+   // an empty upstream version is left to the string comparison
+   const char *dlhs = (const char*) memrchr(lhs, '-', AEnd - lhs);
+   if (dlhs == NULL)
+      dlhs = AEnd;
+   if (dlhs == lhs)
+      return;
+
+   Key.Upstream = lhs - A;
+   Key.Revision = dlhs - A;
+   if (isdigit(*lhs) != 0)
+   {
+      // numbers with more than 9 digits are just known to be larger
+      for (; lhs != dlhs && *lhs == '0'; ++lhs);
+      const char *I = lhs;
+      unsigned int Number = 0;
+      for (; I != dlhs && isdigit(*I) != 0 && I - lhs < 9; ++I)
+	 Number = Number * 10 + (*I - '0');
+      if (I != dlhs && isdigit(*I) != 0)
+	 Key.SortKey = 1000000001;
+      else
+	 Key.SortKey = Number + 1;
+   }
+   Key.Epoch = Epoch;
+}
+									/*}}}*/
+// debVS::CmpVersionKey - Compare two versions of the cache		/*{{{*/
+// ---------------------------------------------------------------------
+/* Versions ranked by the generator are just compared by their rank.
+   Otherwise the epochs and sort keys settle most comparisons, the others
+   skip the search for the epoch and the revision at least. */
+int debVersioningSystem::CmpVersionKey(pkgCache::VersionKey const &AKey,const char *A,
+				       pkgCache::VersionKey const &BKey,const char *B)
+{
+   if (AKey.Rank != 0 && BKey.Rank != 0)
+      return AKey.Rank < BKey.Rank ? -1 : (AKey.Rank == BKey.Rank ? 0 : 1);
+   if (AKey.Epoch == pkgCache::VersionKey::NoEpoch ||
+       BKey.Epoch == pkgCache::VersionKey::NoEpoch)
+      return CmpVersion(A, B);
+   if (AKey.Epoch != BKey.Epoch)
+      return AKey.Epoch < BKey.Epoch ? -1 : 1;
+   if (AKey.SortKey != BKey.SortKey && AKey.SortKey != 0 && BKey.SortKey != 0)
+      return AKey.SortKey < BKey.SortKey ? -1 : 1;
+
+   const char * const ARev = A + AKey.Revision;
+   const char * const BRev = B + BKey.Revision;
+   return CmpUpstreamRevision(A + AKey.Upstream, ARev, ARev + strlen(ARev),
+			      B + BKey.Upstream, BRev, BRev + strlen(BRev));
+}
+									/*}}}*/
 // debVS::UpstreamVersion - Return the upstream version string		/*{{{*/
 // ---------------------------------------------------------------------
 /* This strips all the debian specific information from the version number */
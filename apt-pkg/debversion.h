@@ -34,6 +34,13 @@ class debVersioningSystem : public pkgVersioningSystem
    }
    virtual std::string UpstreamVersion(const char *A);
 
+   virtual void MakeVersionKey(const char *A,const char *Aend,
+			       pkgCache::VersionKey &Key);
+   virtual int CmpVersionKey(pkgCache::VersionKey const &AKey,const char *A,
+			     pkgCache::VersionKey const &BKey,const char *B) APT_PURE;
+   virtual bool CheckDepKey(pkgCache::VersionKey const &PkgKey,const char *PkgVer,int Op,
+			    pkgCache::VersionKey const &DepKey,const char *DepVer) APT_PURE;
+
    debVersioningSystem();
 };
 
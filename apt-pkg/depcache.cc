@@ -13,7 +13,6 @@
 #include <apt-pkg/depcache.h>
 #include <apt-pkg/versionmatch.h>
 #include <apt-pkg/error.h>
-#include <apt-pkg/sptr.h>
 #include <apt-pkg/fileutl.h>
 #include <apt-pkg/strutl.h>
 #include <apt-pkg/configuration.h>
@@ -24,6 +23,8 @@
 #include <apt-pkg/pkgcache.h>
 #include <apt-pkg/cacheiterators.h>
 #include <apt-pkg/macros.h>
+#include <apt-pkg/mmap.h>
+#include <apt-pkg/md5.h>
 
 #include <stdio.h>
 #include <string.h>
@@ -37,6 +38,7 @@
 #include <set>
 
 #include <sys/stat.h>
+#include <unistd.h>
 
 #include <apti18n.h>
 									/*}}}*/
@@ -96,7 +98,8 @@ pkgDepCache::ActionGroup::~ActionGroup()
 // ---------------------------------------------------------------------
 /* */
 pkgDepCache::pkgDepCache(pkgCache *pCache,Policy *Plcy) :
-  group_level(0), Cache(pCache), PkgState(0), DepState(0)
+  group_level(0), PkgStamp(0), DepStamp(0), CheckpointStamp(0), LastStamp(0),
+  StateMap(0), Cache(pCache), PkgState(0), DepState(0)
 {
    DebugMarker = _config->FindB("Debug::pkgDepCache::Marker", false);
    DebugAutoInstall = _config->FindB("Debug::pkgDepCache::AutoInstall", false);
@@ -111,22 +114,29 @@ pkgDepCache::pkgDepCache(pkgCache *pCache,Policy *Plcy) :
 /* */
 pkgDepCache::~pkgDepCache()
 {
-   delete [] PkgState;
-   delete [] DepState;
+   ReleaseState();
+   delete [] PkgStamp;
+   delete [] DepStamp;
    delete delLocalPolicy;
 }
 									/*}}}*/
 // DepCache::Init - Generate the initial extra structures.		/*{{{*/
 // ---------------------------------------------------------------------
-/* This allocats the extension buffers and initializes them. */
+/* This allocats the extension buffers and initializes them. With
+   APT::DepCache::Lazy packages which are neither installed nor in a bad
+   state are left alone: they are kept as they are, so they can't be
+   broken nor count for anything, and their candidate and dependency
+   state is computed by operator[] once somebody asks for it. */
 bool pkgDepCache::Init(OpProgress *Prog)
 {
+   bool const Lazy = _config->FindB("APT::DepCache::Lazy", false);
+
    // Suppress mark updates during this operation (just in case) and
    // run a mark operation when Init terminates.
    ActionGroup actions(*this);
 
-   delete [] PkgState;
-   delete [] DepState;
+   DropCheckpoints();
+   ReleaseState();
    PkgState = new StateCache[Head().PackageCount];
    DepState = new unsigned char[Head().DependsCount];
    memset(PkgState,0,sizeof(*PkgState)*Head().PackageCount);
@@ -151,6 +161,17 @@ bool pkgDepCache::Init(OpProgress *Prog)
       StateCache &State = PkgState[I->ID];
       State.iFlags = 0;
 
+      if (Lazy == true && I->CurrentVer == 0 &&
+	  I.State() == PkgIterator::NeedsNothing)
+      {
+	 State.iFlags = LazyCandidate | LazyState;
+	 State.CandVersion = State.CurVersion = "";
+	 State.InstallVer = 0;
+	 State.Mode = ModeKeep;
+	 State.DepState = 0xFF;
+	 continue;
+      }
+
       // Figure out the install version
       State.CandidateVer = GetCandidateVer(I);
       State.InstallVer = I.CurrentVer();
@@ -176,6 +197,385 @@ bool pkgDepCache::Init(OpProgress *Prog)
    return true;
 } 
 									/*}}}*/
+// DepCache::ReleaseState - Free the state arrays			/*{{{*/
+void pkgDepCache::ReleaseState()
+{
+   delete [] PkgState;
+   if (StateMap == 0)
+      delete [] DepState;
+   delete StateMap;
+   PkgState = 0;
+   DepState = 0;
+   StateMap = 0;
+}
+									/*}}}*/
+// On-disk format of the state cache					/*{{{*/
+// ---------------------------------------------------------------------
+/* The header is followed by an entry for each package and the DepState
+   byte of each dependency. Pointers into the cache are stored as offsets
+   as it will be mapped somewhere else next time. */
+struct StateCacheHeader
+{
+   unsigned long Signature;
+   unsigned short Version;
+   char Stamp[40];
+   map_ptrloc PackageCount;
+   map_ptrloc DependsCount;
+
+   signed long long iUsrSize;
+   unsigned long long iDownloadSize;
+   unsigned long iInstCount;
+   unsigned long iDelCount;
+   unsigned long iKeepCount;
+   unsigned long iBrokenCount;
+   unsigned long iPolicyBrokenCount;
+   unsigned long iBadCount;
+};
+struct StateCacheEntry
+{
+   map_ptrloc CandidateVer;
+   map_ptrloc CandVersion;
+   map_ptrloc CurVersion;
+   unsigned short Flags;
+   signed char Status;
+   unsigned char DepState;
+   bool Marked;
+   bool Garbage;
+};
+static unsigned long const StateCacheSignature = 0xD3A8C0DE;
+static unsigned short const StateCacheVersion = 1;
+									/*}}}*/
+// StateCacheStamp - Identify everything the initial state depends on	/*{{{*/
+// ---------------------------------------------------------------------
+/* The cache is identified like pkgCacheGenerator validates it, by the
+   size and modification time of the files it was built from, and by its
+   size and profile as a lean cache has the same files but another
+   layout. */
+static string StateCacheStamp(pkgCache &Cache, string const &Stamp)
+{
+   MD5Summation Sum;
+   pkgCache::Header const &H = *Cache.HeaderP;
+   Sum.Add((unsigned char const *)&H.MajorVersion, sizeof(H.MajorVersion));
+   Sum.Add((unsigned char const *)&H.PackageCount, sizeof(H.PackageCount));
+   Sum.Add((unsigned char const *)&H.VersionCount, sizeof(H.VersionCount));
+   Sum.Add((unsigned char const *)&H.DependsCount, sizeof(H.DependsCount));
+   Sum.Add((unsigned char const *)&H.StringList, sizeof(H.StringList));
+   Sum.Add((unsigned char const *)&H.CacheFileSize, sizeof(H.CacheFileSize));
+   Sum.Add((unsigned char const *)&H.Lean, sizeof(H.Lean));
+   if (H.Architecture != 0)
+      Sum.Add(Cache.StrP + H.Architecture);
+   for (pkgCache::PkgFileIterator F = Cache.FileBegin(); F.end() == false; ++F)
+   {
+      Sum.Add(F.FileName(), strlen(F.FileName()) + 1);
+      Sum.Add((unsigned char const *)&F->Size, sizeof(F->Size));
+      Sum.Add((unsigned char const *)&F->mtime, sizeof(F->mtime));
+   }
+
+   struct stat St;
+   string const ExtendedStates = _config->FindFile("Dir::State::extended_states");
+   Sum.Add(ExtendedStates.c_str(), ExtendedStates.length() + 1);
+   if (stat(ExtendedStates.c_str(), &St) == 0)
+   {
+      Sum.Add((unsigned char const *)&St.st_size, sizeof(St.st_size));
+      Sum.Add((unsigned char const *)&St.st_mtime, sizeof(St.st_mtime));
+   }
+
+   // these decide which dependencies count for the policy broken states
+   string Options;
+   Options += _config->FindB("APT::Install-Recommends", false) ? '1' : '0';
+   Options += _config->FindB("APT::Install-Suggests", false) ? '1' : '0';
+   Options += _config->Find("APT::Architecture");
+   Sum.Add(Options.c_str(), Options.length() + 1);
+
+   Sum.Add(Stamp.c_str());
+   return Sum.Result().Value();
+}
+									/*}}}*/
+// DepCache::ReadStateCache - Set up the initial state from a file	/*{{{*/
+// ---------------------------------------------------------------------
+/* A file which doesn't fit is ignored silently, the caller will run
+   Init instead. */
+bool pkgDepCache::ReadStateCache(string const &File, string const &Stamp)
+{
+   if (File.empty() == true || RealFileExists(File) == false)
+      return false;
+
+   pkgCache::Header const &H = *Cache->HeaderP;
+   unsigned long long const Size = sizeof(StateCacheHeader) +
+      sizeof(StateCacheEntry)*H.PackageCount + H.DependsCount;
+
+   _error->PushToStack();
+   FileFd Fd(File, FileFd::ReadOnly);
+   MMap *Map = 0;
+   if (Fd.IsOpen() == true && Fd.Failed() == false && Fd.Size() == Size)
+      Map = new MMap(Fd, 0);
+   bool const Failed = _error->PendingError();
+   _error->RevertToStack();
+   if (Map == 0 || Failed == true || Map->validData() == false)
+   {
+      delete Map;
+      return false;
+   }
+
+   StateCacheHeader const * const Hdr = (StateCacheHeader *)Map->Data();
+   if (Hdr->Signature != StateCacheSignature ||
+       Hdr->Version != StateCacheVersion ||
+       Hdr->PackageCount != H.PackageCount ||
+       Hdr->DependsCount != H.DependsCount ||
+       strncmp(StateCacheStamp(*Cache, Stamp).c_str(), Hdr->Stamp, sizeof(Hdr->Stamp)) != 0)
+   {
+      delete Map;
+      return false;
+   }
+
+   DropCheckpoints();
+   ReleaseState();
+   PkgState = new StateCache[H.PackageCount];
+   memset(PkgState,0,sizeof(*PkgState)*H.PackageCount);
+
+   StateCacheEntry const *E = (StateCacheEntry *)(Hdr + 1);
+   for (PkgIterator I = PkgBegin(); I.end() != true; ++I)
+   {
+      StateCacheEntry const &Entry = E[I->ID];
+      StateCache &State = PkgState[I->ID];
+      State.CandidateVer = Entry.CandidateVer == 0 ? 0 : Cache->VerP + Entry.CandidateVer;
+      State.InstallVer = I.CurrentVer();
+      State.CandVersion = Entry.CandVersion == 0 ? "" : Cache->StrP + Entry.CandVersion;
+      State.CurVersion = Entry.CurVersion == 0 ? "" : Cache->StrP + Entry.CurVersion;
+      State.Flags = Entry.Flags;
+      State.Status = Entry.Status;
+      State.Mode = ModeKeep;
+      State.DepState = Entry.DepState;
+      State.Marked = Entry.Marked;
+      State.Garbage = Entry.Garbage;
+   }
+   DepState = (unsigned char *)(E + H.PackageCount);
+   StateMap = Map;
+
+   iUsrSize = Hdr->iUsrSize;
+   iDownloadSize = Hdr->iDownloadSize;
+   iInstCount = Hdr->iInstCount;
+   iDelCount = Hdr->iDelCount;
+   iKeepCount = Hdr->iKeepCount;
+   iBrokenCount = Hdr->iBrokenCount;
+   iPolicyBrokenCount = Hdr->iPolicyBrokenCount;
+   iBadCount = Hdr->iBadCount;
+   return true;
+}
+									/*}}}*/
+// DepCache::WriteStateCache - Store the initial state in a file	/*{{{*/
+// ---------------------------------------------------------------------
+/* */
+bool pkgDepCache::WriteStateCache(string const &File, string const &Stamp)
+{
+   if (File.empty() == true || access(flNotFile(File).c_str(), W_OK) != 0)
+      return false;
+
+   // computing the rest would cost more than the lazy Init saved
+   for (PkgIterator I = PkgBegin(); I.end() != true; ++I)
+      if ((PkgState[I->ID].iFlags & LazyState) == LazyState)
+	 return false;
+
+   pkgCache::Header const &H = *Cache->HeaderP;
+   StateCacheHeader Hdr;
+   memset(&Hdr,0,sizeof(Hdr));
+   Hdr.Signature = StateCacheSignature;
+   Hdr.Version = StateCacheVersion;
+   strncpy(Hdr.Stamp, StateCacheStamp(*Cache, Stamp).c_str(), sizeof(Hdr.Stamp) - 1);
+   Hdr.PackageCount = H.PackageCount;
+   Hdr.DependsCount = H.DependsCount;
+   Hdr.iUsrSize = iUsrSize;
+   Hdr.iDownloadSize = iDownloadSize;
+   Hdr.iInstCount = iInstCount;
+   Hdr.iDelCount = iDelCount;
+   Hdr.iKeepCount = iKeepCount;
+   Hdr.iBrokenCount = iBrokenCount;
+   Hdr.iPolicyBrokenCount = iPolicyBrokenCount;
+   Hdr.iBadCount = iBadCount;
+
+   std::vector<StateCacheEntry> Entries(H.PackageCount);
+   memset(&Entries[0],0,sizeof(StateCacheEntry)*H.PackageCount);
+   for (PkgIterator I = PkgBegin(); I.end() != true; ++I)
+   {
+      StateCache const &State = PkgState[I->ID];
+      StateCacheEntry &Entry = Entries[I->ID];
+      if (State.CandidateVer != 0)
+	 Entry.CandidateVer = State.CandidateVer - Cache->VerP;
+      if (State.CandVersion[0] != '\0')
+	 Entry.CandVersion = State.CandVersion - Cache->StrP;
+      if (State.CurVersion[0] != '\0')
+	 Entry.CurVersion = State.CurVersion - Cache->StrP;
+      Entry.Flags = State.Flags;
+      Entry.Status = State.Status;
+      Entry.DepState = State.DepState;
+      Entry.Marked = State.Marked;
+      Entry.Garbage = State.Garbage;
+   }
+
+   _error->PushToStack();
+   FileFd Fd(File, FileFd::WriteAtomic, 0644);
+   bool Res = Fd.Write(&Hdr, sizeof(Hdr)) == true &&
+      Fd.Write(&Entries[0], sizeof(StateCacheEntry)*H.PackageCount) == true &&
+      Fd.Write(DepState, H.DependsCount) == true &&
+      Fd.Close() == true;
+   Res &= (_error->PendingError() == false);
+   _error->RevertToStack();
+   return Res;
+}
+									/*}}}*/
+// DepCache::StateSnapshot::~StateSnapshot - Destructor		/*{{{*/
+pkgDepCache::StateSnapshot::~StateSnapshot()
+{
+   delete [] PkgState;
+   delete [] DepState;
+}
+									/*}}}*/
+// DepCache::SaveState - Store the complete state in a snapshot		/*{{{*/
+// ---------------------------------------------------------------------
+/* */
+void pkgDepCache::SaveState(StateSnapshot &Snapshot) const
+{
+   pkgCache::Header const &H = *Cache->HeaderP;
+   if (Snapshot.Head != Cache->HeaderP || Snapshot.PkgState == 0)
+   {
+      delete [] Snapshot.PkgState;
+      delete [] Snapshot.DepState;
+      Snapshot.PkgState = new StateCache[H.PackageCount];
+      Snapshot.DepState = new unsigned char[H.DependsCount];
+      Snapshot.Head = Cache->HeaderP;
+   }
+   memcpy(Snapshot.PkgState, PkgState, sizeof(*PkgState)*H.PackageCount);
+   memcpy(Snapshot.DepState, DepState, sizeof(*DepState)*H.DependsCount);
+
+   Snapshot.iUsrSize = iUsrSize;
+   Snapshot.iDownloadSize = iDownloadSize;
+   Snapshot.iInstCount = iInstCount;
+   Snapshot.iDelCount = iDelCount;
+   Snapshot.iKeepCount = iKeepCount;
+   Snapshot.iBrokenCount = iBrokenCount;
+   Snapshot.iPolicyBrokenCount = iPolicyBrokenCount;
+   Snapshot.iBadCount = iBadCount;
+}
+									/*}}}*/
+// DepCache::RestoreState - Go back to the state stored in a snapshot	/*{{{*/
+// ---------------------------------------------------------------------
+/* The depcache doesn't need to be initialized for this, so a snapshot of
+   one depcache can be used to set up others for the same cache. */
+bool pkgDepCache::RestoreState(StateSnapshot const &Snapshot)
+{
+   if (Snapshot.PkgState == 0 || Snapshot.Head != Cache->HeaderP)
+      return _error->Error("Internal error, depcache snapshot doesn't belong to this cache");
+
+   DropCheckpoints();
+   pkgCache::Header const &H = *Cache->HeaderP;
+   if (PkgState == 0)
+      PkgState = new StateCache[H.PackageCount];
+   if (DepState == 0)
+      DepState = new unsigned char[H.DependsCount];
+   memcpy(PkgState, Snapshot.PkgState, sizeof(*PkgState)*H.PackageCount);
+   memcpy(DepState, Snapshot.DepState, sizeof(*DepState)*H.DependsCount);
+
+   iUsrSize = Snapshot.iUsrSize;
+   iDownloadSize = Snapshot.iDownloadSize;
+   iInstCount = Snapshot.iInstCount;
+   iDelCount = Snapshot.iDelCount;
+   iKeepCount = Snapshot.iKeepCount;
+   iBrokenCount = Snapshot.iBrokenCount;
+   iPolicyBrokenCount = Snapshot.iPolicyBrokenCount;
+   iBadCount = Snapshot.iBadCount;
+   return true;
+}
+									/*}}}*/
+// DepCache::Checkpoint - Open a checkpoint to roll back to		/*{{{*/
+// ---------------------------------------------------------------------
+/* The stamps are allocated with the first checkpoint, after that opening
+   one only records the counters. */
+void pkgDepCache::Checkpoint()
+{
+   if (PkgStamp == 0)
+   {
+      PkgStamp = new unsigned long[Head().PackageCount];
+      DepStamp = new unsigned long[Head().DependsCount];
+      memset(PkgStamp,0,sizeof(*PkgStamp)*Head().PackageCount);
+      memset(DepStamp,0,sizeof(*DepStamp)*Head().DependsCount);
+   }
+
+   CheckpointState C;
+   C.Stamp = ++LastStamp;
+   C.PkgJournal = PkgJournal.size();
+   C.DepJournal = DepJournal.size();
+   C.iUsrSize = iUsrSize;
+   C.iDownloadSize = iDownloadSize;
+   C.iInstCount = iInstCount;
+   C.iDelCount = iDelCount;
+   C.iKeepCount = iKeepCount;
+   C.iBrokenCount = iBrokenCount;
+   C.iPolicyBrokenCount = iPolicyBrokenCount;
+   C.iBadCount = iBadCount;
+   Checkpoints.push_back(C);
+   CheckpointStamp = C.Stamp;
+}
+									/*}}}*/
+// DepCache::Rollback - Undo all changes since the last checkpoint	/*{{{*/
+// ---------------------------------------------------------------------
+/* The journal is replayed backwards, so if an entry was journaled more
+   than once the oldest value wins. */
+bool pkgDepCache::Rollback()
+{
+   if (Checkpoints.empty() == true)
+      return _error->Error("Internal error, depcache rollback without a checkpoint");
+
+   CheckpointState const &C = Checkpoints.back();
+   for (size_t I = PkgJournal.size(); I > C.PkgJournal; --I)
+      PkgState[PkgJournal[I - 1].first] = PkgJournal[I - 1].second;
+   for (size_t I = DepJournal.size(); I > C.DepJournal; --I)
+      DepState[DepJournal[I - 1].first] = DepJournal[I - 1].second;
+   PkgJournal.resize(C.PkgJournal);
+   DepJournal.resize(C.DepJournal);
+
+   iUsrSize = C.iUsrSize;
+   iDownloadSize = C.iDownloadSize;
+   iInstCount = C.iInstCount;
+   iDelCount = C.iDelCount;
+   iKeepCount = C.iKeepCount;
+   iBrokenCount = C.iBrokenCount;
+   iPolicyBrokenCount = C.iPolicyBrokenCount;
+   iBadCount = C.iBadCount;
+
+   Checkpoints.pop_back();
+   CheckpointStamp = Checkpoints.empty() ? 0 : Checkpoints.back().Stamp;
+   return true;
+}
+									/*}}}*/
+// DepCache::Commit - Keep all changes since the last checkpoint	/*{{{*/
+// ---------------------------------------------------------------------
+/* The journal entries stay for the enclosing checkpoint. Entries already
+   journaled for this one will be journaled again if they are changed
+   under the enclosing one, which is harmless as the oldest value wins. */
+bool pkgDepCache::Commit()
+{
+   if (Checkpoints.empty() == true)
+      return _error->Error("Internal error, depcache commit without a checkpoint");
+
+   Checkpoints.pop_back();
+   if (Checkpoints.empty() == true)
+   {
+      DropCheckpoints();
+      return true;
+   }
+   CheckpointStamp = Checkpoints.back().Stamp;
+   return true;
+}
+									/*}}}*/
+// DepCache::DropCheckpoints - Forget about all open checkpoints	/*{{{*/
+void pkgDepCache::DropCheckpoints()
+{
+   Checkpoints.clear();
+   PkgJournal.clear();
+   DepJournal.clear();
+   CheckpointStamp = 0;
+}
+									/*}}}*/
 bool pkgDepCache::readStateFile(OpProgress *Prog)			/*{{{*/
 {
    FileFd state_file;
@@ -204,6 +604,7 @@ bool pkgDepCache::readStateFile(OpProgress *Prog)			/*{{{*/
 	 short const reason = section.FindI("Auto-Installed", 0);
 	 if(reason > 0)
 	 {
+	    JournalPkg(pkg->ID);
 	    PkgState[pkg->ID].Flags |= Flag::Auto;
 	    if (unlikely(debug_autoremove))
 	       std::clog << "Auto-Installed : " << pkg.FullName() << std::endl;
@@ -212,7 +613,10 @@ bool pkgDepCache::readStateFile(OpProgress *Prog)			/*{{{*/
 	       pkgCache::GrpIterator G = pkg.Group();
 	       for (pkg = G.NextPkg(pkg); pkg.end() != true; pkg = G.NextPkg(pkg))
 		  if (pkg->VersionList != 0)
+		  {
+		     JournalPkg(pkg->ID);
 		     PkgState[pkg->ID].Flags |= Flag::Auto;
+		  }
 	    }
 	 }
 	 amt += section.size();
@@ -344,11 +748,37 @@ bool pkgDepCache::writeStateFile(OpProgress * /*prog*/, bool InstalledOnly)	/*{{
 /* This first checks the dependency against the main target package and
    then walks along the package provides list and checks if each provides 
    will be installed then checks the provides against the dep. Res will be 
-   set to the package which was used to satisfy the dep. */
+   set to the package which was used to satisfy the dep. If the cache has
+   a satisfier index only the versions in it are compared with the ones
+   the packages have in the given state. */
 bool pkgDepCache::CheckDep(DepIterator Dep,int Type,PkgIterator &Res)
 {
    Res = Dep.TargetPkg();
 
+   if (Head().Satisfiers != 0)
+   {
+      for (pkgCache::TargetIterator T(Dep); T.end() == false; ++T)
+      {
+	 if (Dep->Type == Dep::Obsoletes && T.IsProvided() == true)
+	    break;
+
+	 PkgIterator const Pkg = T.ParentPkg();
+	 Version const *StateVer = 0;
+	 if (Type == NowVersion)
+	    StateVer = Pkg.CurrentVer();
+	 else if (Type == InstallVersion)
+	    StateVer = PkgState[Pkg->ID].InstallVer;
+	 else if (Type == CandidateVersion)
+	    StateVer = CandidateState(Pkg).CandidateVer;
+	 if (StateVer != T)
+	    continue;
+
+	 Res = Pkg;
+	 return true;
+      }
+      return false;
+   }
+
    /* Check simple depends. A depends -should- never self match but 
       we allow it anyhow because dpkg does. Technically it is a packaging
       bug. Conflicts may never self match */
@@ -364,7 +794,7 @@ bool pkgDepCache::CheckDep(DepIterator Dep,int Type,PkgIterator &Res)
 	 if (Dep.IsSatisfied(PkgState[Pkg->ID].InstVerIter(*this)) == true)
 	    return true;
       
-      if (Type == CandidateVersion && PkgState[Pkg->ID].CandidateVer != 0)
+      if (Type == CandidateVersion && CandidateState(Pkg).CandidateVer != 0)
 	 if (Dep.IsSatisfied(PkgState[Pkg->ID].CandidateVerIter(*this)) == true)
 	    return true;
    }
@@ -395,7 +825,7 @@ bool pkgDepCache::CheckDep(DepIterator Dep,int Type,PkgIterator &Res)
 
       if (Type == CandidateVersion)
       {
-	 StateCache &State = PkgState[P.OwnerPkg()->ID];
+	 StateCache &State = CandidateState(P.OwnerPkg());
 	 if (State.CandidateVer != (Version *)P.OwnerVer())
 	    continue;
       }
@@ -429,11 +859,11 @@ void pkgDepCache::AddSizes(const PkgIterator &Pkg, bool const Inverse)
    if (P.NewInstall() == true)
    {
       if (Inverse == false) {
-	 iUsrSize += P.InstVerIter(*this)->InstalledSize;
-	 iDownloadSize += P.InstVerIter(*this)->Size;
+	 iUsrSize += P.InstVerIter(*this).InstalledSize();
+	 iDownloadSize += P.InstVerIter(*this).Size();
       } else {
-	 iUsrSize -= P.InstVerIter(*this)->InstalledSize;
-	 iDownloadSize -= P.InstVerIter(*this)->Size;
+	 iUsrSize -= P.InstVerIter(*this).InstalledSize();
+	 iDownloadSize -= P.InstVerIter(*this).Size();
       }
       return;
    }
@@ -444,13 +874,13 @@ void pkgDepCache::AddSizes(const PkgIterator &Pkg, bool const Inverse)
 	(P.iFlags & ReInstall) == ReInstall) && P.InstallVer != 0)
    {
       if (Inverse == false) {
-	 iUsrSize -= Pkg.CurrentVer()->InstalledSize;
-	 iUsrSize += P.InstVerIter(*this)->InstalledSize;
-	 iDownloadSize += P.InstVerIter(*this)->Size;
+	 iUsrSize -= Pkg.CurrentVer().InstalledSize();
+	 iUsrSize += P.InstVerIter(*this).InstalledSize();
+	 iDownloadSize += P.InstVerIter(*this).Size();
       } else {
-	 iUsrSize -= P.InstVerIter(*this)->InstalledSize;
-	 iUsrSize += Pkg.CurrentVer()->InstalledSize;
-	 iDownloadSize -= P.InstVerIter(*this)->Size;
+	 iUsrSize -= P.InstVerIter(*this).InstalledSize();
+	 iUsrSize += Pkg.CurrentVer().InstalledSize();
+	 iDownloadSize -= P.InstVerIter(*this).Size();
       }
       return;
    }
@@ -460,9 +890,9 @@ void pkgDepCache::AddSizes(const PkgIterator &Pkg, bool const Inverse)
        P.Delete() == false)
    {
       if (Inverse == false)
-	 iDownloadSize += P.InstVerIter(*this)->Size;
+	 iDownloadSize += P.InstVerIter(*this).Size();
       else
-	 iDownloadSize -= P.InstVerIter(*this)->Size;
+	 iDownloadSize -= P.InstVerIter(*this).Size();
       return;
    }
    
@@ -470,9 +900,9 @@ void pkgDepCache::AddSizes(const PkgIterator &Pkg, bool const Inverse)
    if (Pkg->CurrentVer != 0 && P.InstallVer == 0)
    {
       if (Inverse == false)
-	 iUsrSize -= Pkg.CurrentVer()->InstalledSize;
+	 iUsrSize -= Pkg.CurrentVer().InstalledSize();
       else
-	 iUsrSize += Pkg.CurrentVer()->InstalledSize;
+	 iUsrSize += Pkg.CurrentVer().InstalledSize();
       return;
    }   
 }
@@ -544,6 +974,7 @@ void pkgDepCache::BuildGroupOrs(VerIterator const &V)
    for (DepIterator D = V.DependsList(); D.end() != true; ++D)
    {
       // Build the dependency state.
+      JournalDep(D->ID);
       unsigned char &State = DepState[D->ID];
 
       /* Invert for Conflicts. We have to do this twice to get the
@@ -627,6 +1058,7 @@ unsigned char pkgDepCache::DependencyState(DepIterator &D)
    dependency information. */
 void pkgDepCache::UpdateVerState(PkgIterator Pkg)
 {   
+   JournalPkg(Pkg->ID);
    // Empty deps are always true
    StateCache &State = PkgState[Pkg->ID];
    State.DepState = 0xFF;
@@ -675,32 +1107,8 @@ void pkgDepCache::Update(OpProgress *Prog)
    {
       if (Prog != 0 && Done%20 == 0)
 	 Prog->Progress(Done);
-      for (VerIterator V = I.VersionList(); V.end() != true; ++V)
-      {
-	 unsigned char Group = 0;
-
-	 for (DepIterator D = V.DependsList(); D.end() != true; ++D)
-	 {
-	    // Build the dependency state.
-	    unsigned char &State = DepState[D->ID];
-	    State = DependencyState(D);
-
-	    // Add to the group if we are within an or..
-	    Group |= State;
-	    State |= Group << 3;
-	    if ((D->CompareOp & Dep::Or) != Dep::Or)
-	       Group = 0;
-
-	    // Invert for Conflicts
-	    if (D.IsNegative() == true)
-	       State = ~State;
-	 }
-      }
-
-      // Compute the package dependency state and size additions
-      AddSizes(I);
-      UpdateVerState(I);
-      AddStates(I);
+      if ((PkgState[I->ID].iFlags & LazyState) != LazyState)
+	 ComputeState(I);
    }
 
    if (Prog != 0)
@@ -709,6 +1117,59 @@ void pkgDepCache::Update(OpProgress *Prog)
    readStateFile(Prog);
 }
 									/*}}}*/
+// DepCache::ComputeCandidate - Compute the candidate of a package	/*{{{*/
+// ---------------------------------------------------------------------
+/* This is all a lazy package needs to be the target of a dependency. */
+void pkgDepCache::ComputeCandidate(PkgIterator const &Pkg)
+{
+   JournalPkg(Pkg->ID);
+   StateCache &State = PkgState[Pkg->ID];
+   State.iFlags &= ~LazyCandidate;
+   State.CandidateVer = GetCandidateVer(Pkg);
+   State.Update(Pkg,*this);
+}
+									/*}}}*/
+// DepCache::ComputeState - Compute the dependency state of a package	/*{{{*/
+// ---------------------------------------------------------------------
+/* This is the depends pass of Update for a single package, which also
+   adds it to the counters. The targets of the dependencies only need
+   their candidate, so computing the state of a lazy package never
+   computes the state of others. */
+void pkgDepCache::ComputeState(PkgIterator const &Pkg)
+{
+   CandidateState(Pkg);
+   JournalPkg(Pkg->ID);
+   PkgState[Pkg->ID].iFlags &= ~LazyState;
+
+   for (VerIterator V = Pkg.VersionList(); V.end() != true; ++V)
+   {
+      unsigned char Group = 0;
+
+      for (DepIterator D = V.DependsList(); D.end() != true; ++D)
+      {
+	 // Build the dependency state.
+	 JournalDep(D->ID);
+	 unsigned char &State = DepState[D->ID];
+	 State = DependencyState(D);
+
+	 // Add to the group if we are within an or..
+	 Group |= State;
+	 State |= Group << 3;
+	 if ((D->CompareOp & Dep::Or) != Dep::Or)
+	    Group = 0;
+
+	 // Invert for Conflicts
+	 if (D.IsNegative() == true)
+	    State = ~State;
+      }
+   }
+
+   // Compute the package dependency state and size additions
+   AddSizes(Pkg);
+   UpdateVerState(Pkg);
+   AddStates(Pkg);
+}
+									/*}}}*/
 // DepCache::Update - Update the deps list of a package	   		/*{{{*/
 // ---------------------------------------------------------------------
 /* This is a helper for update that only does the dep portion of the scan. 
@@ -718,6 +1179,11 @@ void pkgDepCache::Update(DepIterator D)
    // Update the reverse deps
    for (;D.end() != true; ++D)
    {      
+      // a lazy package will see the change once its state is computed
+      if ((PkgState[D.ParentPkg()->ID].iFlags & LazyState) == LazyState)
+	 continue;
+
+      JournalDep(D->ID);
       unsigned char &State = DepState[D->ID];
       State = DependencyState(D);
     
@@ -776,6 +1242,7 @@ bool pkgDepCache::MarkKeep(PkgIterator const &Pkg, bool Soft, bool FromUser,
 
    /* We changed the soft state all the time so the UI is a bit nicer
       to use */
+   JournalPkg(Pkg->ID);
    StateCache &P = PkgState[Pkg->ID];
 
    // Check that it is not already kept
@@ -828,7 +1295,8 @@ bool pkgDepCache::MarkDelete(PkgIterator const &Pkg, bool rPurge,
    if (IsModeChangeOk(ModeDelete, Pkg, Depth, FromUser) == false)
       return false;
 
-   StateCache &P = PkgState[Pkg->ID];
+   JournalPkg(Pkg->ID);
+   StateCache &P = (*this)[Pkg];
 
    // Check that it is not already marked for delete
    if ((P.Mode == ModeDelete || P.InstallVer == 0) && 
@@ -1042,7 +1510,8 @@ bool pkgDepCache::MarkInstall(PkgIterator const &Pkg,bool AutoInst,
    if (IsModeChangeOk(ModeInstall, Pkg, Depth, FromUser) == false)
       return false;
 
-   StateCache &P = PkgState[Pkg->ID];
+   JournalPkg(Pkg->ID);
+   StateCache &P = (*this)[Pkg];
 
    // See if there is even any possible instalation candidate
    if (P.CandidateVer == 0)
@@ -1195,13 +1664,13 @@ bool pkgDepCache::MarkInstall(PkgIterator const &Pkg,bool AutoInst,
       if (Start.IsNegative() == false && (DepState[Start->ID] & DepCVer) == DepCVer)
       {
 	 APT::VersionList verlist;
-	 pkgCache::VerIterator Cand = PkgState[Start.TargetPkg()->ID].CandidateVerIter(*this);
+	 pkgCache::VerIterator Cand = CandidateState(Start.TargetPkg()).CandidateVerIter(*this);
 	 if (Cand.end() == false && Start.IsSatisfied(Cand) == true)
 	    verlist.insert(Cand);
 	 for (PrvIterator Prv = Start.TargetPkg().ProvidesList(); Prv.end() != true; ++Prv)
 	 {
 	    pkgCache::VerIterator V = Prv.OwnerVer();
-	    pkgCache::VerIterator Cand = PkgState[Prv.OwnerPkg()->ID].CandidateVerIter(*this);
+	    pkgCache::VerIterator Cand = CandidateState(Prv.OwnerPkg()).CandidateVerIter(*this);
 	    if (Cand.end() == true || V != Cand || Start.IsSatisfied(Prv) == false)
 	       continue;
 	    verlist.insert(Cand);
@@ -1241,26 +1710,24 @@ bool pkgDepCache::MarkInstall(PkgIterator const &Pkg,bool AutoInst,
 	 Otherwise we remove the offender if needed */
       else if (Start.IsNegative() == true && Start->Type != pkgCache::Dep::Obsoletes)
       {
-	 SPtrArray<Version *> List = Start.AllTargets();
 	 pkgCache::PkgIterator TrgPkg = Start.TargetPkg();
-	 for (Version **I = List; *I != 0; I++)
+	 for (pkgCache::TargetIterator I(Start); I.end() == false; ++I)
 	 {
-	    VerIterator Ver(*this,*I);
-	    PkgIterator Pkg = Ver.ParentPkg();
+	    PkgIterator Pkg = I.ParentPkg();
 
-	    /* The List includes all packages providing this dependency,
+	    /* The targets include all packages providing this dependency,
 	       even providers which are not installed, so skip them. */
 	    if (PkgState[Pkg->ID].InstallVer == 0)
 	       continue;
 
             /* Ignore negative dependencies that we are not going to 
                get installed */
-            if (PkgState[Pkg->ID].InstallVer != *I)
+            if (PkgState[Pkg->ID].InstallVer != I)
                continue;
 
 	    if ((Start->Version != 0 || TrgPkg != Pkg) &&
 		PkgState[Pkg->ID].CandidateVer != PkgState[Pkg->ID].InstallVer &&
-		PkgState[Pkg->ID].CandidateVer != *I &&
+		PkgState[Pkg->ID].CandidateVer != I &&
 		MarkInstall(Pkg,true,Depth + 1, false, ForceImportantDeps) == true)
 	       continue;
 	    else if (Start->Type == pkgCache::Dep::Conflicts || 
@@ -1304,7 +1771,7 @@ bool pkgDepCache::IsInstallOkMultiArchSameVersionSynced(PkgIterator const &Pkg,
       return true;
 
    // ignore packages with none-M-A:same candidates
-   VerIterator const CandVer = PkgState[Pkg->ID].CandidateVerIter(*this);
+   VerIterator const CandVer = CandidateState(Pkg).CandidateVerIter(*this);
    if (unlikely(CandVer.end() == true) || CandVer == Pkg.CurrentVer() ||
 	 (CandVer->MultiArch & pkgCache::Version::Same) != pkgCache::Version::Same)
       return true;
@@ -1326,6 +1793,7 @@ bool pkgDepCache::IsInstallOkMultiArchSameVersionSynced(PkgIterator const &Pkg,
       if (CV.Downloadable() == false)
 	 continue;
 
+      JournalPkg(Pkg->ID);
       PkgState[Pkg->ID].iFlags |= AutoKept;
       if (unlikely(DebugMarker == true))
 	 std::clog << OutputInDepth(Depth) << "Ignore MarkInstall of " << Pkg
@@ -1341,7 +1809,7 @@ bool pkgDepCache::IsInstallOkDependenciesSatisfiableByCandidates(PkgIterator con
    if (AutoInst == false)
       return true;
 
-   VerIterator const CandVer = PkgState[Pkg->ID].CandidateVerIter(*this);
+   VerIterator const CandVer = (*this)[Pkg].CandidateVerIter(*this);
    if (unlikely(CandVer.end() == true) || CandVer == Pkg.CurrentVer())
       return true;
 
@@ -1391,6 +1859,9 @@ void pkgDepCache::SetReInstall(PkgIterator const &Pkg,bool To)
    if (unlikely(Pkg.end() == true))
       return;
 
+   if ((PkgState[Pkg->ID].iFlags & LazyState) == LazyState)
+      ComputeState(Pkg);
+
    APT::PackageList pkglist;
    if (Pkg->CurrentVer != 0 &&
        (Pkg.CurrentVer()-> MultiArch & pkgCache::Version::Same) == pkgCache::Version::Same)
@@ -1412,6 +1883,7 @@ void pkgDepCache::SetReInstall(PkgIterator const &Pkg,bool To)
       RemoveSizes(Pkg);
       RemoveStates(Pkg);
 
+      JournalPkg(Pkg->ID);
       StateCache &P = PkgState[Pkg->ID];
       if (To == true)
 	 P.iFlags |= ReInstall;
@@ -1429,7 +1901,8 @@ void pkgDepCache::SetReInstall(PkgIterator const &Pkg,bool To)
 void pkgDepCache::SetCandidateVersion(VerIterator TargetVer)
 {
    pkgCache::PkgIterator Pkg = TargetVer.ParentPkg();
-   StateCache &P = PkgState[Pkg->ID];
+   JournalPkg(Pkg->ID);
+   StateCache &P = (*this)[Pkg];
 
    if (P.CandidateVer == TargetVer)
       return;
@@ -1493,7 +1966,7 @@ bool pkgDepCache::SetCandidateRelease(pkgCache::VerIterator TargetVer,
 	 // virtual packages can't be a solution
 	 if (P.end() == true || (P->ProvidesList == 0 && P->VersionList == 0))
 	    continue;
-	 pkgCache::VerIterator const Cand = PkgState[P->ID].CandidateVerIter(*this);
+	 pkgCache::VerIterator const Cand = (*this)[P].CandidateVerIter(*this);
 	 // no versioned dependency - but is it installable?
 	 if (Start.TargetVer() == 0 || Start.TargetVer()[0] == '\0')
 	 {
@@ -1503,7 +1976,7 @@ bool pkgDepCache::SetCandidateRelease(pkgCache::VerIterator TargetVer,
 	       pkgCache::PrvIterator Prv = P.ProvidesList();
 	       for (; Prv.end() == false; ++Prv)
 	       {
-		  pkgCache::VerIterator const C = PkgState[Prv.OwnerPkg()->ID].CandidateVerIter(*this);
+		  pkgCache::VerIterator const C = (*this)[Prv.OwnerPkg()].CandidateVerIter(*this);
 		  if (C.end() == true || C != Prv.OwnerVer() ||
 		      (VersionState(C.DependsList(), DepInstall, DepCandMin, DepCandPolicy) & DepCandMin) != DepCandMin)
 		     continue;
@@ -1563,7 +2036,7 @@ bool pkgDepCache::SetCandidateRelease(pkgCache::VerIterator TargetVer,
 	    break;
 	 }
 
-	 pkgCache::VerIterator oldCand = PkgState[D.TargetPkg()->ID].CandidateVerIter(*this);
+	 pkgCache::VerIterator oldCand = CandidateState(D.TargetPkg()).CandidateVerIter(*this);
 	 if (V == oldCand)
 	 {
 	    // Do we already touched this Version? If so, their versioned dependencies are okay, no need to check again
@@ -1616,6 +2089,7 @@ bool pkgDepCache::SetCandidateRelease(pkgCache::VerIterator TargetVer,
 /* */
 void pkgDepCache::MarkAuto(const PkgIterator &Pkg, bool Auto)
 {
+  JournalPkg(Pkg->ID);
   StateCache &state = PkgState[Pkg->ID];
 
   ActionGroup group(*this);
@@ -49,6 +49,7 @@
 #include <list>
 #include <string>
 #include <utility>
+#include <vector>
 
 #ifndef APT_8_CLEANER_HEADERS
 #include <apt-pkg/progress.h>
@@ -61,6 +62,7 @@
 
 class OpProgress;
 class pkgVersioningSystem;
+class MMap;
 
 class pkgDepCache : protected pkgCache::Namespace
 {
@@ -134,7 +136,8 @@ class pkgDepCache : protected pkgCache::Namespace
                        DepCandPolicy = (1 << 4), DepCandMin = (1 << 5)};
    
    // These flags are used in StateCache::iFlags
-   enum InternalFlags {AutoKept = (1 << 0), Purge = (1 << 1), ReInstall = (1 << 2), Protected = (1 << 3)};
+   enum InternalFlags {AutoKept = (1 << 0), Purge = (1 << 1), ReInstall = (1 << 2), Protected = (1 << 3),
+                       LazyCandidate = (1 << 4), LazyState = (1 << 5)};
       
    enum VersionTypes {NowVersion, InstallVersion, CandidateVersion};
    enum ModeList {ModeDelete = 0, ModeKeep = 1, ModeInstall = 2, ModeGarbage = 3};
@@ -269,6 +272,16 @@ class pkgDepCache : protected pkgCache::Namespace
    void BuildGroupOrs(VerIterator const &V);
    void UpdateVerState(PkgIterator Pkg);
 
+   // Compute what a lazy depcache has left out for a package so far
+   void ComputeCandidate(PkgIterator const &Pkg);
+   void ComputeState(PkgIterator const &Pkg);
+   inline StateCache &CandidateState(PkgIterator const &Pkg)
+   {
+      if ((PkgState[Pkg->ID].iFlags & LazyCandidate) == LazyCandidate)
+	 ComputeCandidate(Pkg);
+      return PkgState[Pkg->ID];
+   }
+
    // User Policy control
    class Policy
    {
@@ -297,6 +310,42 @@ class pkgDepCache : protected pkgCache::Namespace
    int group_level;
 
    friend class ActionGroup;
+
+   /** The state at the time a checkpoint was opened, together with the
+    *  positions in the journals its changes start at.
+    */
+   struct CheckpointState
+   {
+      unsigned long Stamp;
+      size_t PkgJournal;
+      size_t DepJournal;
+      signed long long iUsrSize;
+      unsigned long long iDownloadSize;
+      unsigned long iInstCount;
+      unsigned long iDelCount;
+      unsigned long iKeepCount;
+      unsigned long iBrokenCount;
+      unsigned long iPolicyBrokenCount;
+      unsigned long iBadCount;
+   };
+   std::vector<CheckpointState> Checkpoints;
+   /** The previous values of the entries changed since the first open
+    *  checkpoint, in the order they were changed. */
+   std::vector<std::pair<map_ptrloc, StateCache> > PkgJournal;
+   std::vector<std::pair<map_ptrloc, unsigned char> > DepJournal;
+   /** The checkpoint each entry was last journaled for, so that it is
+    *  journaled only once per checkpoint. */
+   unsigned long *PkgStamp;
+   unsigned long *DepStamp;
+   /** The stamp of the innermost open checkpoint, 0 if there is none */
+   unsigned long CheckpointStamp;
+   unsigned long LastStamp;
+
+   void DropCheckpoints();
+
+   /** The mapping of a state cache file DepState points into, if any */
+   MMap *StateMap;
+   void ReleaseState();
      
    protected:
 
@@ -336,6 +385,24 @@ class pkgDepCache : protected pkgCache::Namespace
 			      unsigned char SetMin,
 			      unsigned char SetPolicy);
 
+   // Record the previous state of a package or dependency for #Rollback
+   inline void JournalPkg(map_ptrloc const ID)
+   {
+      if (CheckpointStamp != 0 && PkgStamp[ID] != CheckpointStamp)
+      {
+	 PkgStamp[ID] = CheckpointStamp;
+	 PkgJournal.push_back(std::make_pair(ID, PkgState[ID]));
+      }
+   }
+   inline void JournalDep(map_ptrloc const ID)
+   {
+      if (CheckpointStamp != 0 && DepStamp[ID] != CheckpointStamp)
+      {
+	 DepStamp[ID] = CheckpointStamp;
+	 DepJournal.push_back(std::make_pair(ID, DepState[ID]));
+      }
+   }
+
    // Recalculates various portions of the cache, call after changing something
    void Update(DepIterator Dep);           // Mostly internal
    void Update(PkgIterator const &P);
@@ -366,8 +433,32 @@ class pkgDepCache : protected pkgCache::Namespace
    inline Policy &GetPolicy() {return *LocalPolicy;};
    
    // Accessors
-   inline StateCache &operator [](PkgIterator const &I) {return PkgState[I->ID];};
-   inline unsigned char &operator [](DepIterator const &I) {return DepState[I->ID];};
+   inline StateCache &operator [](PkgIterator const &I)
+   {
+      if ((PkgState[I->ID].iFlags & LazyState) == LazyState)
+	 ComputeState(I);
+      return PkgState[I->ID];
+   };
+   inline unsigned char &operator [](DepIterator const &I)
+   {
+      PkgIterator const P = I.ParentPkg();
+      if ((PkgState[P->ID].iFlags & LazyState) == LazyState)
+	 ComputeState(P);
+      return DepState[I->ID];
+   };
+
+   /** \brief \b false if the state of the package wasn't computed yet
+    *
+    *  With APT::DepCache::Lazy #Init only computes the state of installed
+    *  packages, all others get it computed by operator[] when they are
+    *  first looked at. Until then such a package is kept uninstalled and
+    *  isn't broken, so loops over all packages can skip it rather than
+    *  computing the state of the whole cache.
+    */
+   inline bool IsStateComputed(PkgIterator const &Pkg) const
+   {
+      return (PkgState[Pkg->ID].iFlags & LazyState) != LazyState;
+   };
 
    /** \return A function identifying packages in the root set other
     *  than manually installed packages and essential packages, or \b
@@ -420,7 +511,7 @@ class pkgDepCache : protected pkgCache::Namespace
    bool MarkInstall(PkgIterator const &Pkg,bool AutoInst = true,
 		    unsigned long Depth = 0, bool FromUser = true,
 		    bool ForceImportantDeps = false);
-   void MarkProtected(PkgIterator const &Pkg) { PkgState[Pkg->ID].iFlags |= Protected; };
+   void MarkProtected(PkgIterator const &Pkg) { JournalPkg(Pkg->ID); PkgState[Pkg->ID].iFlags |= Protected; };
 
    void SetReInstall(PkgIterator const &Pkg,bool To);
    void SetCandidateVersion(VerIterator TargetVer);
@@ -499,6 +590,85 @@ class pkgDepCache : protected pkgCache::Namespace
    // Generate all state information
    void Update(OpProgress *Prog = 0);
 
+   /** \brief A saved copy of the complete state of a depcache
+    *
+    *  Saving and restoring only copies the state arrays and counters,
+    *  which is a lot cheaper than generating them again with #Init, e.g.
+    *  to resolve many independent requests from the same initial state.
+    *  A snapshot can be restored into any depcache of the same pkgCache.
+    */
+   class StateSnapshot
+   {
+      friend class pkgDepCache;
+
+      pkgCache::Header *Head;
+      StateCache *PkgState;
+      unsigned char *DepState;
+      signed long long iUsrSize;
+      unsigned long long iDownloadSize;
+      unsigned long iInstCount;
+      unsigned long iDelCount;
+      unsigned long iKeepCount;
+      unsigned long iBrokenCount;
+      unsigned long iPolicyBrokenCount;
+      unsigned long iBadCount;
+
+      /** Snapshots are noncopyable. */
+      StateSnapshot(const StateSnapshot &other);
+      void operator=(const StateSnapshot &other);
+   public:
+      StateSnapshot() : Head(0), PkgState(0), DepState(0) {};
+      ~StateSnapshot();
+   };
+
+   /** \brief set up the state after #Init from a file instead
+    *
+    *  The file is written by #WriteStateCache and holds the candidates,
+    *  the dependency states, the counters and the flags read from the
+    *  extended_states file. It is only used if it was written for the
+    *  same cache, extended_states file and options affecting the policy,
+    *  and Stamp, which has to identify everything else the candidates
+    *  depend on (like the pin files). The dependency states are mapped
+    *  copy-on-write.
+    *
+    *  \return \b false if the file doesn't exist or can't be used */
+   bool ReadStateCache(std::string const &File, std::string const &Stamp);
+   /** \brief store the state after #Init in a file for #ReadStateCache
+    *
+    *  Must be called before anything is changed.
+    *
+    *  \return \b false if the file can't be written or a lazy #Init left
+    *  the state of some packages to be computed on access */
+   bool WriteStateCache(std::string const &File, std::string const &Stamp);
+
+   /** \brief store the current state in Snapshot */
+   void SaveState(StateSnapshot &Snapshot) const;
+   /** \brief replace the current state with the one stored in Snapshot
+    *
+    *  \return \b false if the snapshot is empty or from another cache */
+   bool RestoreState(StateSnapshot const &Snapshot);
+
+   /** \brief open a checkpoint to go back to with #Rollback
+    *
+    *  Checkpoints can be nested. Only the entries changed after the
+    *  checkpoint was opened are recorded, so opening and rolling back are
+    *  proportional to the changes made in between, not to the size of
+    *  the cache. Changes made directly through operator[] are not
+    *  recorded, the Marked and Garbage flags which are calculated by
+    *  #MarkAndSweep at the end of each action group neither.
+    *  #Init and #RestoreState drop all open checkpoints.
+    */
+   void Checkpoint();
+   /** \brief undo the changes since the innermost open checkpoint and close it
+    *
+    *  \return \b false if there is no open checkpoint */
+   bool Rollback();
+   /** \brief keep the changes since the innermost open checkpoint and close it
+    *
+    *  The changes become part of the enclosing checkpoint, if any.
+    *  \return \b false if there is no open checkpoint */
+   bool Commit();
+
    pkgDepCache(pkgCache *Cache,Policy *Plcy = 0);
    virtual ~pkgDepCache();
 
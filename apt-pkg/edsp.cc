@@ -108,7 +108,7 @@ void EDSP::WriteScenarioVersion(pkgDepCache &Cache, FILE* output, pkgCache::PkgI
    if (Pkg->SelectedState == pkgCache::State::Hold ||
        (Cache[Pkg].Keep() == true && Cache[Pkg].Protect() == true))
       fprintf(output, "Hold: yes\n");
-   fprintf(output, "APT-ID: %d\n", Ver->ID);
+   fprintf(output, "APT-ID: %llu\n", (unsigned long long) Ver->ID);
    fprintf(output, "Priority: %s\n", PrioMap[Ver->Priority]);
    if ((Pkg->Flags & pkgCache::Flag::Essential) == pkgCache::Flag::Essential)
       fprintf(output, "Essential: yes\n");
@@ -508,19 +508,19 @@ bool EDSP::WriteSolution(pkgDepCache &Cache, FILE* output)
    {
       if (Cache[Pkg].Delete() == true)
       {
-	 fprintf(output, "Remove: %d\n", Pkg.CurrentVer()->ID);
+	 fprintf(output, "Remove: %llu\n", (unsigned long long) Pkg.CurrentVer()->ID);
 	 if (Debug == true)
 	    fprintf(output, "Package: %s\nVersion: %s\n", Pkg.FullName().c_str(), Pkg.CurrentVer().VerStr());
       }
       else if (Cache[Pkg].NewInstall() == true || Cache[Pkg].Upgrade() == true)
       {
-	 fprintf(output, "Install: %d\n", Cache.GetCandidateVer(Pkg)->ID);
+	 fprintf(output, "Install: %llu\n", (unsigned long long) Cache.GetCandidateVer(Pkg)->ID);
 	 if (Debug == true)
 	    fprintf(output, "Package: %s\nVersion: %s\n", Pkg.FullName().c_str(), Cache.GetCandidateVer(Pkg).VerStr());
       }
       else if (Cache[Pkg].Garbage == true)
       {
-	 fprintf(output, "Autoremove: %d\n", Pkg.CurrentVer()->ID);
+	 fprintf(output, "Autoremove: %llu\n", (unsigned long long) Pkg.CurrentVer()->ID);
 	 if (Debug == true)
 	    fprintf(output, "Package: %s\nVersion: %s\n", Pkg.FullName().c_str(), Pkg.CurrentVer().VerStr());
       }
@@ -47,6 +47,7 @@
 #include <signal.h>
 #include <errno.h>
 #include <glob.h>
+#include <pthread.h>
 
 #include <set>
 #include <algorithm>
@@ -840,6 +841,130 @@ class FileFdPrivate {							/*{{{*/
 	public:
 #ifdef HAVE_ZLIB
 	gzFile gz;
+	/* A thread decompressing into a ring of buffers ahead of Read, which
+	   takes the data out of them in order and only waits if it catches up.
+	   The thread waits while all buffers are full. As long as it runs the
+	   gzFile is its alone, so everything else using it has to stop it. */
+	struct GZREADAHEAD {
+	   static const unsigned int count = 8;
+	   static const unsigned long size = 256*1024;
+
+	   gzFile gz;
+	   char *buffers[count];
+	   unsigned long lengths[count];
+	   unsigned int head;
+	   unsigned int filled;
+	   unsigned long offset;
+	   unsigned long long end;
+	   bool done;
+	   bool stop;
+	   int err;
+	   int errnum;
+	   std::string errmsg;
+	   bool started;
+	   pthread_t thread;
+	   pthread_mutex_t lock;
+	   pthread_cond_t changed;
+
+	   GZREADAHEAD(gzFile gz) : gz(gz), head(0), filled(0), offset(0), end(0), done(false),
+				    stop(false), err(Z_OK), errnum(0), started(false) {
+	      for (unsigned int i = 0; i < count; ++i)
+		 buffers[i] = NULL;
+	      pthread_mutex_init(&lock, NULL);
+	      pthread_cond_init(&changed, NULL);
+	   }
+	   ~GZREADAHEAD() {
+	      if (started == true)
+	      {
+		 pthread_mutex_lock(&lock);
+		 stop = true;
+		 pthread_cond_broadcast(&changed);
+		 pthread_mutex_unlock(&lock);
+		 pthread_join(thread, NULL);
+	      }
+	      for (unsigned int i = 0; i < count; ++i)
+		 free(buffers[i]);
+	      pthread_cond_destroy(&changed);
+	      pthread_mutex_destroy(&lock);
+	   }
+	   bool start() {
+	      for (unsigned int i = 0; i < count; ++i)
+		 if ((buffers[i] = (char *) malloc(size)) == NULL)
+		    return false;
+	      started = pthread_create(&thread, NULL, run, this) == 0;
+	      return started;
+	   }
+	   static void *run(void *arg) {
+	      GZREADAHEAD * const r = (GZREADAHEAD *) arg;
+	      pthread_mutex_lock(&r->lock);
+	      while (r->done == false)
+	      {
+		 while (r->filled == count && r->stop == false)
+		    pthread_cond_wait(&r->changed, &r->lock);
+		 if (r->stop == true)
+		    break;
+		 unsigned int const slot = (r->head + r->filled) % count;
+		 pthread_mutex_unlock(&r->lock);
+
+		 unsigned long length = 0;
+		 int res = 0;
+		 while (length != size && (res = gzread(r->gz, r->buffers[slot] + length, size - length)) > 0)
+		    length += res;
+		 int err = Z_OK;
+		 int const errnum = errno;
+		 char const * const errmsg = res < 0 ? gzerror(r->gz, &err) : "";
+
+		 pthread_mutex_lock(&r->lock);
+		 if (length != 0)
+		 {
+		    r->lengths[slot] = length;
+		    ++r->filled;
+		 }
+		 if (res < 0)
+		 {
+		    r->err = err == Z_OK ? Z_ERRNO : err;
+		    r->errnum = errnum;
+		    r->errmsg = errmsg;
+		 }
+		 r->done = res <= 0;
+		 if (r->done == true)
+		    r->end = gztell(r->gz);
+		 pthread_cond_broadcast(&r->changed);
+	      }
+	      pthread_mutex_unlock(&r->lock);
+	      return NULL;
+	   }
+	   /* behaves like gzread: the number of bytes read, 0 at the end of
+	      the file and -1 on errors */
+	   ssize_t read(void *to, unsigned long long todo) {
+	      pthread_mutex_lock(&lock);
+	      while (filled == 0 && done == false)
+		 pthread_cond_wait(&changed, &lock);
+	      bool const empty = filled == 0;
+	      pthread_mutex_unlock(&lock);
+	      if (empty == true)
+	      {
+		 if (err == Z_OK)
+		    return 0;
+		 errno = err == Z_ERRNO ? errnum : 0;
+		 return -1;
+	      }
+	      unsigned long long const n = std::min<unsigned long long>(todo, lengths[head] - offset);
+	      memcpy(to, buffers[head] + offset, n);
+	      offset += n;
+	      if (offset == lengths[head])
+	      {
+		 offset = 0;
+		 pthread_mutex_lock(&lock);
+		 head = (head + 1) % count;
+		 --filled;
+		 pthread_cond_broadcast(&changed);
+		 pthread_mutex_unlock(&lock);
+	      }
+	      return n;
+	   }
+	};
+	GZREADAHEAD* readahead;
 #endif
 #ifdef HAVE_BZ2
 	BZFILE* bz2;
@@ -890,7 +1015,7 @@ class FileFdPrivate {							/*{{{*/
 	unsigned long long seekpos;
 	FileFdPrivate() :
 #ifdef HAVE_ZLIB
-			  gz(NULL),
+			  gz(NULL), readahead(NULL),
 #endif
 #ifdef HAVE_BZ2
 			  bz2(NULL),
@@ -906,6 +1031,7 @@ class FileFdPrivate {							/*{{{*/
 	      /* dummy so that the rest can be 'else if's */;
 #ifdef HAVE_ZLIB
 	   else if (gz != NULL) {
+	      StopReadAhead();
 	      int const e = gzclose(gz);
 	      gz = NULL;
 	      // gzdclose() on empty files always fails with "buffer error" here, ignore that
@@ -937,6 +1063,19 @@ class FileFdPrivate {							/*{{{*/
 
 	   return Res;
 	}
+	bool ReadingAhead() const {
+#ifdef HAVE_ZLIB
+	   return readahead != NULL;
+#else
+	   return false;
+#endif
+	}
+	void StopReadAhead() {
+#ifdef HAVE_ZLIB
+	   delete readahead;
+	   readahead = NULL;
+#endif
+	}
 	bool InternalStream() const {
 	   return false
 #ifdef HAVE_BZ2
@@ -1397,7 +1536,8 @@ FileFd::~FileFd()
 // FileFd::Read - Read a bit of the file				/*{{{*/
 // ---------------------------------------------------------------------
 /* We are careful to handle interruption by a signal while reading
-   gracefully. */
+   gracefully. Gzip files opened with ReadAhead are decompressed by a
+   thread of its own which is started with the first Read. */
 bool FileFd::Read(void *To,unsigned long long Size,unsigned long long *Actual)
 {
    ssize_t Res;
@@ -1405,11 +1545,32 @@ bool FileFd::Read(void *To,unsigned long long Size,unsigned long long *Actual)
    if (Actual != 0)
       *Actual = 0;
    *((char *)To) = '\0';
+#ifdef HAVE_ZLIB
+   if (d != NULL && d->gz != NULL && d->readahead == NULL &&
+       (d->openmode & ReadAhead) == ReadAhead && (d->openmode & WriteOnly) != WriteOnly)
+   {
+      // gzgets in ReadLine doesn't keep track of the position
+      d->seekpos = gztell(d->gz);
+      d->readahead = new FileFdPrivate::GZREADAHEAD(d->gz);
+      if (d->readahead->start() == false)
+      {
+	 d->StopReadAhead();
+	 d->openmode &= ~ReadAhead;
+      }
+   }
+#endif
    do
    {
       if (false)
 	 /* dummy so that the rest can be 'else if's */;
 #ifdef HAVE_ZLIB
+      else if (d != NULL && d->readahead != NULL)
+      {
+	 Res = d->readahead->read(To,Size);
+	 // where gztell would be after a seek beyond the end
+	 if (Res == 0)
+	    d->seekpos = d->readahead->end;
+      }
       else if (d != NULL && d->gz != NULL)
 	 Res = gzread(d->gz,To,Size);
 #endif
@@ -1468,6 +1629,11 @@ bool FileFd::Read(void *To,unsigned long long Size,unsigned long long *Actual)
 	 if (false)
 	    /* dummy so that the rest can be 'else if's */;
 #ifdef HAVE_ZLIB
+	 else if (d != NULL && d->readahead != NULL)
+	 {
+	    if (d->readahead->err != Z_ERRNO)
+	       return FileFdError("gzread: %s (%d: %s)", _("Read error"), d->readahead->err, d->readahead->errmsg.c_str());
+	 }
 	 else if (d != NULL && d->gz != NULL)
 	 {
 	    int err;
@@ -1522,7 +1688,7 @@ char* FileFd::ReadLine(char *To, unsigned long long const Size)
 {
    *To = '\0';
 #ifdef HAVE_ZLIB
-   if (d != NULL && d->gz != NULL)
+   if (d != NULL && d->gz != NULL && d->readahead == NULL)
       return gzgets(d->gz, To, Size);
 #endif
 
@@ -1693,6 +1859,9 @@ bool FileFd::Seek(unsigned long long To)
       d->seekpos = To;
       return true;
    }
+   // a read-ahead is restarted by the next Read from the new position
+   if (d != NULL)
+      d->StopReadAhead();
    off_t res;
 #ifdef HAVE_ZLIB
    if (d != NULL && d->gz)
@@ -1728,7 +1897,13 @@ bool FileFd::Skip(unsigned long long Over)
 
    off_t res;
 #ifdef HAVE_ZLIB
-   if (d != NULL && d->gz != NULL)
+   if (d != NULL && d->ReadingAhead() == true)
+   {
+      // the gzFile itself is somewhere ahead of what was read
+      d->StopReadAhead();
+      res = gzseek(d->gz,d->seekpos + Over,SEEK_SET);
+   }
+   else if (d != NULL && d->gz != NULL)
       res = gzseek(d->gz,Over,SEEK_CUR);
    else
 #endif
@@ -1772,7 +1947,8 @@ unsigned long long FileFd::Tell()
    // seeking around, but not all users of FileFd use always Seek() and co
    // so d->seekpos isn't always true and we can just use it as a hint if
    // we have nothing else, but not always as an authority…
-   if (d != NULL && (d->pipe == true || d->InternalStream() == true))
+   if (d != NULL && (d->pipe == true || d->InternalStream() == true ||
+		     d->ReadingAhead() == true))
       return d->seekpos;
 
    off_t Res;
@@ -1869,31 +2045,24 @@ unsigned long long FileFd::Size()
    // gzopen in "direct" mode as well
    else if (d != NULL && d->gz && !gzdirect(d->gz) && size > 0)
    {
-       off_t const oldPos = lseek(iFd,0,SEEK_CUR);
        /* unfortunately zlib.h doesn't provide a gzsize(), so we have to do
 	* this ourselves; the original (uncompressed) file size is the last 32
 	* bits of the file */
        // FIXME: Size for gz-files is limited by 32bit… no largefile support
-       if (lseek(iFd, -4, SEEK_END) < 0)
+       // pread keeps the offset a read-ahead thread might be reading from
+       if (size < 4)
        {
-	  FileFdErrno("lseek","Unable to seek to end of gzipped file");
+	  FileFdError("Unable to seek to end of gzipped file");
 	  return 0;
        }
+       off_t const Trailer = size - 4;
        uint32_t size = 0;
-       if (read(iFd, &size, 4) != 4)
+       if (pread(iFd, &size, 4, Trailer) != 4)
        {
-	  FileFdErrno("read","Unable to read original size of gzipped file");
+	  FileFdErrno("pread","Unable to read original size of gzipped file");
 	  return 0;
        }
-       size = le32toh(size);
-
-       if (lseek(iFd, oldPos, SEEK_SET) < 0)
-       {
-	  FileFdErrno("lseek","Unable to seek in gzipped file");
-	  return 0;
-       }
-
-       return size;
+       return le32toh(size);
    }
 #endif
 
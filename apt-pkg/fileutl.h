@@ -60,6 +60,8 @@ class FileFd
 	Exclusive = (1 << 3),
 	Atomic = Exclusive | (1 << 4),
 	Empty = (1 << 5),
+	// decompress gzip files in a thread of its own ahead of Read
+	ReadAhead = (1 << 6),
 
 	WriteEmpty = ReadWrite | Create | Empty,
 	WriteExists = ReadWrite,
@@ -70,6 +70,8 @@ class pkgIndexFile
    virtual std::string SourceInfo(pkgSrcRecords::Parser const &Record,
 			     pkgSrcRecords::File const &File) const;
    virtual std::string Describe(bool Short = false) const = 0;   
+   // The local file the index is read from, if there is one
+   virtual std::string IndexFileName() const {return std::string();};
 
    // Interface for acquire
    virtual std::string ArchiveURI(std::string /*File*/) const {return std::string();};
@@ -102,6 +102,14 @@
 	#define APT_HIDDEN
 #endif
 
+/* The static "this" pointers used by qsort comparators need to be per
+   thread so that different threads can each work on their own depcache */
+#if APT_GCC_VERSION >= 0x0303
+	#define APT_THREAD_LOCAL	__thread
+#else
+	#define APT_THREAD_LOCAL
+#endif
+
 // cold functions are unlikely() to be called
 #if APT_GCC_VERSION >= 0x0403
 	#define APT_COLD	__attribute__ ((__cold__))
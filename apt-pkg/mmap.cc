@@ -228,7 +228,19 @@ DynamicMMap::DynamicMMap(FileFd &F,unsigned long Flags,unsigned long const &Work
       this->Flags |= Fallback;
 #endif
 
+   // a private file map can't be extended in place without losing data
+   if ((this->Flags & Public) != Public || F.IsCompressed() == true)
+      this->Flags &= ~Reserve;
+
    unsigned long long EndOfFile = Fd->Size();
+   if ((this->Flags & Reserve) == Reserve)
+   {
+      // the reserved space is committed in whole pages
+      unsigned long long const PSize = sysconf(_SC_PAGESIZE);
+      if (EndOfFile > WorkSpace)
+	 WorkSpace = EndOfFile;
+      WorkSpace = (WorkSpace + PSize - 1) / PSize * PSize;
+   }
    if (EndOfFile > WorkSpace)
       WorkSpace = EndOfFile;
    else if(WorkSpace > 0)
@@ -237,8 +249,9 @@ DynamicMMap::DynamicMMap(FileFd &F,unsigned long Flags,unsigned long const &Work
       char C = 0;
       Fd->Write(&C,sizeof(C));
    }
-   
-   Map(F);
+
+   if (ReserveSpace() == false)
+      Map(F);
    iSize = EndOfFile;
 }
 									/*}}}*/
@@ -266,6 +279,15 @@ DynamicMMap::DynamicMMap(unsigned long Flags,unsigned long const &WorkSpace,
 #endif
 
 #ifdef _POSIX_MAPPED_FILES
+	if ((this->Flags & Reserve) == Reserve) {
+		unsigned long long const PSize = sysconf(_SC_PAGESIZE);
+		this->WorkSpace = (WorkSpace + PSize - 1) / PSize * PSize;
+		if (ReserveSpace() == true) {
+			iSize = 0;
+			return;
+		}
+		this->WorkSpace = WorkSpace;
+	}
 	if ((this->Flags & Fallback) != Fallback) {
 		// Set the permissions.
 		int Prot = PROT_READ;
@@ -308,7 +330,7 @@ DynamicMMap::~DynamicMMap()
       if (validData() == false)
 	 return;
 #ifdef _POSIX_MAPPED_FILES
-      munmap(Base, WorkSpace);
+      munmap(Base, (Flags & Reserve) == Reserve ? Limit : WorkSpace);
 #else
       free(Base);
 #endif
@@ -316,7 +338,7 @@ DynamicMMap::~DynamicMMap()
    }
    
    unsigned long long EndOfFile = iSize;
-   iSize = WorkSpace;
+   iSize = (Flags & Reserve) == Reserve ? Limit : WorkSpace;
    Close(false);
    if(ftruncate(Fd->Fd(),EndOfFile) < 0)
       _error->Errno("ftruncate", _("Failed to truncate file"));
@@ -448,7 +470,13 @@ bool DynamicMMap::Grow() {
 	if (GrowFactor <= 0)
 		return _error->Error(_("Unable to increase size of the MMap as automatic growing is disabled by user."));
 
-	unsigned long long const newSize = WorkSpace + GrowFactor;
+	unsigned long long newSize = WorkSpace + GrowFactor;
+	if ((Flags & Reserve) == Reserve) {
+		unsigned long long const PSize = sysconf(_SC_PAGESIZE);
+		newSize = (newSize + PSize - 1) / PSize * PSize;
+		if (newSize > Limit)
+			newSize = Limit;
+	}
 
 	if(Fd != 0) {
 		Fd->Seek(newSize - 1);
@@ -456,6 +484,14 @@ bool DynamicMMap::Grow() {
 		Fd->Write(&C,sizeof(C));
 	}
 
+	// the reserved space just needs to be committed, the map stays put
+	if ((Flags & Reserve) == Reserve) {
+		if (CommitSpace(WorkSpace, newSize - WorkSpace) == false)
+			return false;
+		WorkSpace = newSize;
+		return true;
+	}
+
 	unsigned long const poolOffset = Pools - ((Pool*) Base);
 
 	if ((Flags & Fallback) != Fallback) {
@@ -490,3 +526,68 @@ bool DynamicMMap::Grow() {
 	return true;
 }
 									/*}}}*/
+// DynamicMMap::ReserveSpace - Reserve the address space for the map	/*{{{*/
+// ---------------------------------------------------------------------
+/* Limit bytes of address space are reserved without any access rights
+   and the WorkSpace is committed at the start of it. If anything fails
+   the Reserve flag is dropped, so that the caller can map as usual. */
+bool DynamicMMap::ReserveSpace()
+{
+   if ((Flags & Reserve) != Reserve)
+      return false;
+#if defined(_POSIX_MAPPED_FILES) && defined(MAP_FIXED)
+   if (Limit != 0 && Limit >= WorkSpace && (Flags & Fallback) != Fallback)
+   {
+#ifdef MAP_ANONYMOUS
+      int Map = MAP_PRIVATE | MAP_ANONYMOUS;
+#else
+      int Map = MAP_PRIVATE | MAP_ANON;
+#endif
+#ifdef MAP_NORESERVE
+      Map |= MAP_NORESERVE;
+#endif
+      Base = mmap(0, Limit, PROT_NONE, Map, -1, 0);
+      if (Base != MAP_FAILED)
+      {
+	 if (WorkSpace == 0 || CommitSpace(0, WorkSpace) == true)
+	    return true;
+	 munmap(Base, Limit);
+      }
+   }
+#endif
+   Base = 0;
+   Flags &= ~Reserve;
+   return false;
+}
+									/*}}}*/
+// DynamicMMap::CommitSpace - Make a part of the reserved space usable	/*{{{*/
+// ---------------------------------------------------------------------
+/* The given range (which has to start at a page boundary) is replaced
+   by a mapping of the file or anonymous memory respectively. */
+bool DynamicMMap::CommitSpace(unsigned long long const Start,
+			      unsigned long long const Size)
+{
+#if defined(_POSIX_MAPPED_FILES) && defined(MAP_FIXED)
+   int Prot = PROT_READ;
+   if ((Flags & ReadOnly) != ReadOnly)
+      Prot |= PROT_WRITE;
+   void * const Where = (char *)Base + Start;
+   void * Got;
+   if (Fd != 0)
+      Got = mmap(Where, Size, Prot, MAP_SHARED | MAP_FIXED, Fd->Fd(), Start);
+   else
+   {
+#ifdef MAP_ANONYMOUS
+      int Map = MAP_ANONYMOUS | MAP_FIXED;
+#else
+      int Map = MAP_ANON | MAP_FIXED;
+#endif
+      Map |= ((Flags & Public) == Public) ? MAP_SHARED : MAP_PRIVATE;
+      Got = mmap(Where, Size, Prot, Map, -1, 0);
+   }
+   return Got == Where;
+#else
+   return false;
+#endif
+}
+									/*}}}*/
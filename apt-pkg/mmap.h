@@ -37,8 +37,16 @@ class FileFd;
 
 /* This should be a 32 bit type, larger tyes use too much ram and smaller
    types are too small. Where ever possible 'unsigned long' should be used
-   instead of this internal type */
+   instead of this internal type. Building with APT_PKG_WIDE_CACHE selects a
+   separate cache format with 64 bit offsets and IDs for caches which would
+   not fit into 4 GB otherwise. */
+#ifdef APT_PKG_WIDE_CACHE
+typedef unsigned long long map_ptrloc;
+typedef unsigned long long map_id_t;
+#else
 typedef unsigned int map_ptrloc;
+typedef unsigned int map_id_t;
+#endif
 
 class MMap
 {
@@ -59,7 +67,8 @@ class MMap
    public:
 
    enum OpenFlags {NoImmMap = (1<<0),Public = (1<<1),ReadOnly = (1<<2),
-                   UnMapped = (1<<3), Moveable = (1<<4), Fallback = (1 << 5)};
+                   UnMapped = (1<<3), Moveable = (1<<4), Fallback = (1 << 5),
+                   Reserve = (1 << 6)};
       
    // Simple accessors
    inline operator void *() {return Base;};
@@ -77,6 +86,10 @@ class MMap
    virtual ~MMap();
 };
 
+/* With the Reserve flag a DynamicMMap reserves Limit bytes of address
+   space up front and only maps the WorkSpace in it, growing it in place.
+   The map never moves then. If the reservation fails the map works as
+   if the flag had not been given. */
 class DynamicMMap : public MMap
 {
    public:
@@ -99,6 +112,8 @@ class DynamicMMap : public MMap
    unsigned int PoolCount;
 
    bool Grow();
+   bool ReserveSpace();
+   bool CommitSpace(unsigned long long const Start,unsigned long long const Size);
    
    public:
 
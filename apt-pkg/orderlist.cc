@@ -81,7 +81,7 @@
 
 using namespace std;
 
-pkgOrderList *pkgOrderList::Me = 0;
+APT_THREAD_LOCAL pkgOrderList *pkgOrderList::Me = 0;
 
 // OrderList::pkgOrderList - Constructor				/*{{{*/
 // ---------------------------------------------------------------------
@@ -69,7 +69,7 @@ class pkgOrderList : protected pkgCache::Namespace
    bool DoRun();
    
    // For pre sorting
-   static pkgOrderList *Me;
+   static APT_THREAD_LOCAL pkgOrderList *Me;
    static int OrderCompareA(const void *a, const void *b) APT_PURE;
    static int OrderCompareB(const void *a, const void *b) APT_PURE;
    int FileCmp(PkgIterator A,PkgIterator B) APT_PURE;
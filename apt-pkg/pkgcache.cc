@@ -47,26 +47,37 @@ using std::string;
 
 // Cache::Header::Header - Constructor					/*{{{*/
 // ---------------------------------------------------------------------
-/* Simply initialize the header */
+/* Simply initialize the header. The padding between the members is
+   written to the cache file as well, so it is cleared first to get the
+   same file from the same input. */
 pkgCache::Header::Header()
 {
+   memset(this,0,sizeof(*this));
    Signature = 0x98FE76DC;
    
    /* Whenever the structures change the major version should be bumped,
-      whenever the generator changes the minor version should be bumped. */
-   MajorVersion = 8;
+      whenever the generator changes the minor version should be bumped.
+      The wide format has its own major version so that it is never mixed
+      up with the normal one, even before the sizes are compared. */
+#ifdef APT_PKG_WIDE_CACHE
+   MajorVersion = 17;
+#else
+   MajorVersion = 16;
+#endif
 #if (APT_PKG_MAJOR >= 4 && APT_PKG_MINOR >= 13)
-   MinorVersion = 2;
+   MinorVersion = 4;
 #else
-   MinorVersion = 1;
+   MinorVersion = 3;
 #endif
    Dirty = false;
+   Lean = false;
    
    HeaderSz = sizeof(pkgCache::Header);
    GroupSz = sizeof(pkgCache::Group);
    PackageSz = sizeof(pkgCache::Package);
    PackageFileSz = sizeof(pkgCache::PackageFile);
    VersionSz = sizeof(pkgCache::Version);
+   VersionDetailsSz = sizeof(pkgCache::VersionDetails);
    DescriptionSz = sizeof(pkgCache::Description);
    DependencySz = sizeof(pkgCache::Dependency);
    ProvidesSz = sizeof(pkgCache::Provides);
@@ -89,8 +100,10 @@ pkgCache::Header::Header()
    StringList = 0;
    VerSysName = 0;
    Architecture = 0;
-   memset(PkgHashTable,0,sizeof(PkgHashTable));
-   memset(GrpHashTable,0,sizeof(GrpHashTable));
+   PkgHashTable = 0;
+   GrpHashTable = 0;
+   HashTableSize = 0;
+   Satisfiers = 0;
    memset(Pools,0,sizeof(Pools));
 
    CacheFileSize = 0;
@@ -106,6 +119,7 @@ bool pkgCache::Header::CheckSizes(Header &Against) const
        PackageSz == Against.PackageSz &&
        PackageFileSz == Against.PackageFileSz &&
        VersionSz == Against.VersionSz &&
+       VersionDetailsSz == Against.VersionDetailsSz &&
        DescriptionSz == Against.DescriptionSz &&
        DependencySz == Against.DependencySz &&
        VerFileSz == Against.VerFileSz &&
@@ -142,6 +156,7 @@ bool pkgCache::ReMap(bool const &Errorchecks)
    DescFileP = (DescFile *)Map.Data();
    PkgFileP = (PackageFile *)Map.Data();
    VerP = (Version *)Map.Data();
+   VerDetailsP = (VersionDetails *)Map.Data();
    DescP = (Description *)Map.Data();
    ProvideP = (Provides *)Map.Data();
    DepP = (Dependency *)Map.Data();
@@ -168,6 +183,10 @@ bool pkgCache::ReMap(bool const &Errorchecks)
    if (Map.Size() < HeaderP->CacheFileSize)
       return _error->Error(_("The package cache file is corrupted, it is too small"));
 
+   if (HeaderP->HashTableSize == 0 ||
+       (HeaderP->HashTableSize & (HeaderP->HashTableSize - 1)) != 0)
+      return _error->Error(_("The package cache file is corrupted"));
+
    // Locate our VS..
    if (HeaderP->VerSysName == 0 ||
        (VS = pkgVersioningSystem::GetVS(StrP + HeaderP->VerSysName)) == 0)
@@ -180,25 +199,33 @@ bool pkgCache::ReMap(bool const &Errorchecks)
    return true;
 }
 									/*}}}*/
+// Cache::NameHash - Hash a name					/*{{{*/
+// ---------------------------------------------------------------------
+/* FNV-1a over the lower cased name. The full value is stored in the
+   groups and packages so that the hash chains can be searched without
+   comparing most of the names. */
+unsigned int pkgCache::NameHash(const char *Str)
+{
+   unsigned int Hash = 2166136261U;
+   for (const char *I = Str; *I != 0; ++I)
+   {
+      Hash ^= (unsigned char) tolower_ascii(*I);
+      Hash *= 16777619U;
+   }
+   return Hash;
+}
+									/*}}}*/
 // Cache::Hash - Hash a string						/*{{{*/
 // ---------------------------------------------------------------------
-/* This is used to generate the hash entries for the HashTable. With my
-   package list from bo this function gets 94% table usage on a 512 item
-   table (480 used items) */
+/* This is used to generate the hash entries for the HashTable. */
 unsigned long pkgCache::sHash(const string &Str) const
 {
-   unsigned long Hash = 0;
-   for (string::const_iterator I = Str.begin(); I != Str.end(); ++I)
-      Hash = 41 * Hash + tolower_ascii(*I);
-   return Hash % _count(HeaderP->PkgHashTable);
+   return NameHash(Str.c_str()) & (HeaderP->HashTableSize - 1);
 }
 
 unsigned long pkgCache::sHash(const char *Str) const
 {
-   unsigned long Hash = tolower_ascii(*Str);
-   for (const char *I = Str + 1; *I != 0; ++I)
-      Hash = 41 * Hash + tolower_ascii(*I);
-   return Hash % _count(HeaderP->PkgHashTable);
+   return NameHash(Str) & (HeaderP->HashTableSize - 1);
 }
 									/*}}}*/
 // Cache::SingleArchFindPkg - Locate a package by name			/*{{{*/
@@ -209,11 +236,18 @@ unsigned long pkgCache::sHash(const char *Str) const
 pkgCache::PkgIterator pkgCache::SingleArchFindPkg(const string &Name)
 {
    // Look at the hash bucket
-   Package *Pkg = PkgP + HeaderP->PkgHashTable[Hash(Name)];
+   unsigned int const FullHash = NameHash(Name.c_str());
+   Package *Pkg = PkgP + HeaderP->PkgHashTableP()[FullHash & (HeaderP->HashTableSize - 1)];
    for (; Pkg != PkgP; Pkg = PkgP + Pkg->NextPackage)
    {
       if (unlikely(Pkg->Name == 0))
 	 continue;
+      if (Pkg->Hash != FullHash)
+      {
+	 if (Pkg->Hash > FullHash)
+	    break;
+	 continue;
+      }
 
       int const cmp = strcasecmp(Name.c_str(), StrP + Pkg->Name);
       if (cmp == 0)
@@ -274,10 +308,16 @@ pkgCache::GrpIterator pkgCache::FindGrp(const string &Name) {
 		return GrpIterator(*this,0);
 
 	// Look at the hash bucket for the group
-	Group *Grp = GrpP + HeaderP->GrpHashTable[sHash(Name)];
+	unsigned int const FullHash = NameHash(Name.c_str());
+	Group *Grp = GrpP + HeaderP->GrpHashTableP()[FullHash & (HeaderP->HashTableSize - 1)];
 	for (; Grp != GrpP; Grp = GrpP + Grp->Next) {
 		if (unlikely(Grp->Name == 0))
 		   continue;
+		if (Grp->Hash != FullHash) {
+			if (Grp->Hash > FullHash)
+				break;
+			continue;
+		}
 
 		int const cmp = strcasecmp(Name.c_str(), StrP + Grp->Name);
 		if (cmp == 0)
@@ -428,10 +468,10 @@ void pkgCache::GrpIterator::operator ++(int)
       S = Owner->GrpP + S->Next;
 
    // Follow the hash table
-   while (S == Owner->GrpP && (HashIndex+1) < (signed)_count(Owner->HeaderP->GrpHashTable))
+   while (S == Owner->GrpP && (HashIndex+1) < (signed)Owner->HeaderP->HashTableSize)
    {
       HashIndex++;
-      S = Owner->GrpP + Owner->HeaderP->GrpHashTable[HashIndex];
+      S = Owner->GrpP + Owner->HeaderP->GrpHashTableP()[HashIndex];
    }
 }
 									/*}}}*/
@@ -445,10 +485,10 @@ void pkgCache::PkgIterator::operator ++(int)
       S = Owner->PkgP + S->NextPackage;
 
    // Follow the hash table
-   while (S == Owner->PkgP && (HashIndex+1) < (signed)_count(Owner->HeaderP->PkgHashTable))
+   while (S == Owner->PkgP && (HashIndex+1) < (signed)Owner->HeaderP->HashTableSize)
    {
       HashIndex++;
-      S = Owner->PkgP + Owner->HeaderP->PkgHashTable[HashIndex];
+      S = Owner->PkgP + Owner->HeaderP->PkgHashTableP()[HashIndex];
    }
 }
 									/*}}}*/
@@ -629,53 +669,56 @@ bool pkgCache::DepIterator::SmartTargetPkg(PkgIterator &Result) const
    must be delete [] 'd */
 pkgCache::Version **pkgCache::DepIterator::AllTargets() const
 {
-   Version **Res = 0;
-   unsigned long Size =0;
-   while (1)
-   {
-      Version **End = Res;
-      PkgIterator DPkg = TargetPkg();
-
-      // Walk along the actual package providing versions
-      for (VerIterator I = DPkg.VersionList(); I.end() == false; ++I)
-      {
-	 if (IsIgnorable(I.ParentPkg()) == true)
-	    continue;
-	 if (IsSatisfied(I) == false)
-	    continue;
+   unsigned long Size = 0;
+   for (TargetIterator T(*this); T.end() == false; ++T)
+      Size++;
 
-	 Size++;
-	 if (Res != 0)
-	    *End++ = I;
-      }
-      
-      // Follow all provides
-      for (PrvIterator I = DPkg.ProvidesList(); I.end() == false; ++I)
-      {
-	 if (IsIgnorable(I) == true)
-	    continue;
-	 if (IsSatisfied(I) == false)
-	    continue;
+   Version **Res = new Version *[Size+1];
+   Version **End = Res;
+   for (TargetIterator T(*this); T.end() == false; ++T)
+      *End++ = T;
+   *End = 0;
+   return Res;
+}
+									/*}}}*/
+// TargetIterator::WalkFirst - Find the first target without the index	/*{{{*/
+// ---------------------------------------------------------------------
+/* */
+void pkgCache::TargetIterator::WalkFirst()
+{
+   S = Owner->VerP;
+   PkgIterator const Pkg = Dep.TargetPkg();
+   if (Dep.IsIgnorable(Pkg) == false)
+      S += Pkg->VersionList;
+   Walk(false);
+}
+									/*}}}*/
+// TargetIterator::Walk - Find the next target without the index	/*{{{*/
+// ---------------------------------------------------------------------
+/* The versions of the target package are checked first, Prv is unset
+   until they are done and it moves on to the provides. */
+void pkgCache::TargetIterator::Walk(bool const Advance)
+{
+   if (Prv.Cache() == 0)
+   {
+      if (Advance == true)
+	 S = Owner->VerP + S->NextVer;
+      for (; S != Owner->VerP; S = Owner->VerP + S->NextVer)
+	 if (Dep.IsSatisfied(VerIterator(*Owner,S)) == true)
+	    return;
+      Prv = Dep.TargetPkg().ProvidesList();
+   }
+   else if (Advance == true)
+      ++Prv;
 
-	 Size++;
-	 if (Res != 0)
-	    *End++ = I.OwnerVer();
-      }
-      
-      // Do it again and write it into the array
-      if (Res == 0)
-      {
-	 Res = new Version *[Size+1];
-	 Size = 0;
-      }
-      else
-      {
-	 *End = 0;
-	 break;
-      }      
+   for (; Prv.end() == false; ++Prv)
+   {
+      if (Dep.IsIgnorable(Prv) == true || Dep.IsSatisfied(Prv) == false)
+	 continue;
+      S = Owner->VerP + Prv->Version;
+      return;
    }
-   
-   return Res;
+   S = Owner->VerP;
 }
 									/*}}}*/
 // DepIterator::GlobOr - Compute an OR group				/*{{{*/
@@ -765,11 +808,15 @@ bool pkgCache::DepIterator::IsMultiArchImplicit() const
 // DepIterator::IsSatisfied - check if a version satisfied the dependency /*{{{*/
 bool pkgCache::DepIterator::IsSatisfied(VerIterator const &Ver) const
 {
-   return Owner->VS->CheckDep(Ver.VerStr(),S->CompareOp,TargetVer());
+   if (S->Version == 0 || Ver->VerStr == 0)
+      return Owner->VS->CheckDep(Ver.VerStr(),S->CompareOp,TargetVer());
+   return Owner->VS->CheckDepKey(Ver.VerKey(),Ver.VerStr(),S->CompareOp,TargetVerKey(),TargetVer());
 }
 bool pkgCache::DepIterator::IsSatisfied(PrvIterator const &Prv) const
 {
-   return Owner->VS->CheckDep(Prv.ProvideVersion(),S->CompareOp,TargetVer());
+   if (S->Version == 0 || Prv->ProvideVersion == 0)
+      return Owner->VS->CheckDep(Prv.ProvideVersion(),S->CompareOp,TargetVer());
+   return Owner->VS->CheckDepKey(Prv.ProvideVersionKey(),Prv.ProvideVersion(),S->CompareOp,TargetVerKey(),TargetVer());
 }
 									/*}}}*/
 // ostream operator to handle string representation of a dependecy	/*{{{*/
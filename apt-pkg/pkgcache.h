@@ -94,12 +94,14 @@ class pkgCache								/*{{{*/
    struct Package;
    struct PackageFile;
    struct Version;
+   struct VersionDetails;
    struct Description;
    struct Provides;
    struct Dependency;
    struct StringItem;
    struct VerFile;
    struct DescFile;
+   struct VersionKey;
    
    // Iterators
    template<typename Str, typename Itr> class Iterator;
@@ -109,6 +111,7 @@ class pkgCache								/*{{{*/
    class DescIterator;
    class DepIterator;
    class PrvIterator;
+   class TargetIterator;
    class PkgFileIterator;
    class VerFileIterator;
    class DescFileIterator;
@@ -171,6 +174,7 @@ class pkgCache								/*{{{*/
    DescFile *DescFileP;
    PackageFile *PkgFileP;
    Version *VerP;
+   VersionDetails *VerDetailsP;
    Description *DescP;
    Provides *ProvideP;
    Dependency *DepP;
@@ -182,9 +186,11 @@ class pkgCache								/*{{{*/
    inline MMap &GetMap() {return Map;}
    inline void *DataEnd() {return ((unsigned char *)Map.Data()) + Map.Size();}
       
-   // String hashing function (512 range)
+   // String hashing function (bucket in the hash tables)
    inline unsigned long Hash(const std::string &S) const {return sHash(S);}
    inline unsigned long Hash(const char *S) const {return sHash(S);}
+   // Full hash of a name, independent of the size of the hash tables
+   static unsigned int NameHash(const char *S) APT_PURE;
 
    // Useful transformation things
    const char *Priority(unsigned char Priority);
@@ -239,6 +245,12 @@ struct pkgCache::Header
        expects to have written things to it and have not fully synced it.
        The file should be erased and rebuilt if it is true. */
    bool Dirty;
+   /** \brief indicates a cache built for dependency resolution only
+
+       A lean cache has no descriptions and no Translation files, see
+       APT::Cache-Lean. It is only valid for a configuration asking for
+       it, everyone else rebuilds the cache with the descriptions. */
+   bool Lean;
 
    /** \brief Size of structure values
 
@@ -252,6 +264,7 @@ struct pkgCache::Header
    unsigned short PackageSz;
    unsigned short PackageFileSz;
    unsigned short VersionSz;
+   unsigned short VersionDetailsSz;
    unsigned short DescriptionSz;
    unsigned short DependencySz;
    unsigned short ProvidesSz;
@@ -309,18 +322,40 @@ struct pkgCache::Header
        By iterating over each entry in the hash table it is possible to iterate over
        the entire list of packages. Hash Collisions are handled with a singly linked
        list of packages based at the hash item. The linked list contains only
-       packages that match the hashing function.
+       packages that match the hashing function and is sorted by the full hash
+       (stored in the group and package) first and the name second.
        In the PkgHashTable is it possible that multiple packages have the same name -
        these packages are stored as a sequence in the list.
 
+       The tables are allocated in the map and are replaced by larger ones by the
+       generator as the number of groups grows. Both fields are the offsets of the
+       tables from the start of the map.
+
        Beware: The Hashmethod assumes that the hash table sizes are equal */
-   map_ptrloc PkgHashTable[2*1048];
-   map_ptrloc GrpHashTable[2*1048];
+   map_ptrloc PkgHashTable;
+   map_ptrloc GrpHashTable;
+   /** \brief Number of buckets in each hash table, always a power of two */
+   map_ptrloc HashTableSize;
+
+   /** \brief index of the versions satisfying each dependency
+
+       For every dependency ID the index holds two offsets, the one at
+       2 * ID + 2 ends its entries: the versions of the target package
+       satisfying the dependency start at the first offset, the versions
+       satisfying it with a provides at the second one. The offsets and
+       entries are counted in map_ptrloc from the start of the index.
+
+       Satisfiers is the offset of the index from the start of the map or
+       0 if the cache has none, see pkgCache::TargetIterator. */
+   map_ptrloc Satisfiers;
 
    /** \brief Size of the complete cache file */
    unsigned long  CacheFileSize;
 
    bool CheckSizes(Header &Against) const APT_PURE;
+   map_ptrloc *PkgHashTableP() const { return (map_ptrloc *)((char *)this + PkgHashTable); }
+   map_ptrloc *GrpHashTableP() const { return (map_ptrloc *)((char *)this + GrpHashTable); }
+   map_ptrloc const *SatisfiersP() const { return (map_ptrloc const *)((char const *)this + Satisfiers); }
    Header();
 };
 									/*}}}*/
@@ -343,8 +378,10 @@ struct pkgCache::Group
    map_ptrloc LastPackage;	// Package
    /** \brief Link to the next Group */
    map_ptrloc Next;		// Group
+   /** \brief full hash of the name, see pkgCache::NameHash */
+   unsigned int Hash;
    /** \brief unique sequel ID */
-   unsigned int ID;
+   map_id_t ID;
 
 };
 									/*}}}*/
@@ -362,10 +399,9 @@ struct pkgCache::Group
 */
 struct pkgCache::Package
 {
-   /** \brief Name of the package */
-   map_ptrloc Name;              // StringItem
-   /** \brief Architecture of the package */
-   map_ptrloc Arch;              // StringItem
+   /* The fields used while resolving come first, the ones for finding
+      the package by its name follow. */
+
    /** \brief Base of a singly linked list of versions
 
        Each structure represents a unique version of the package.
@@ -378,22 +414,19 @@ struct pkgCache::Package
    map_ptrloc VersionList;       // Version
    /** \brief index to the installed version */
    map_ptrloc CurrentVer;        // Version
-   /** \brief indicates the deduced section
-
-       Should be the index to the string "Unknown" or to the section
-       of the last parsed item. */
-   map_ptrloc Section;           // StringItem
-   /** \brief index of the group this package belongs to */
-   map_ptrloc Group;             // Group the Package belongs to
-
-   // Linked list
-   /** \brief Link to the next package in the same bucket */
-   map_ptrloc NextPackage;       // Package
    /** \brief List of all dependencies on this package */
    map_ptrloc RevDepends;        // Dependency
    /** \brief List of all "packages" this package provide */
    map_ptrloc ProvidesList;      // Provides
 
+   /** \brief unique sequel ID
+
+       ID is a unique value from 0 to Header->PackageCount assigned by the generator.
+       This allows clients to create an array of size PackageCount and use it to store
+       state information for the package map. For instance the status file emitter uses
+       this to track which packages have been emitted already. */
+   map_id_t ID;
+
    // Install/Remove/Purge etc
    /** \brief state that the user wishes the package to be in */
    unsigned char SelectedState;     // What
@@ -406,15 +439,26 @@ struct pkgCache::Package
    /** \brief indicates if the package is installed */
    unsigned char CurrentState;      // State
 
-   /** \brief unique sequel ID
-
-       ID is a unique value from 0 to Header->PackageCount assigned by the generator.
-       This allows clients to create an array of size PackageCount and use it to store
-       state information for the package map. For instance the status file emitter uses
-       this to track which packages have been emitted already. */
-   unsigned int ID;
    /** \brief some useful indicators of the package's state */
    unsigned long Flags;
+
+   /** \brief Name of the package */
+   map_ptrloc Name;              // StringItem
+   /** \brief Architecture of the package */
+   map_ptrloc Arch;              // StringItem
+   /** \brief index of the group this package belongs to */
+   map_ptrloc Group;             // Group the Package belongs to
+
+   // Linked list
+   /** \brief Link to the next package in the same bucket */
+   map_ptrloc NextPackage;       // Package
+   /** \brief full hash of the name, the same as the one of the group */
+   unsigned int Hash;
+   /** \brief indicates the deduced section
+
+       Should be the index to the string "Unknown" or to the section
+       of the last parsed item. */
+   map_ptrloc Section;           // StringItem
 };
 									/*}}}*/
 // Package File structure						/*{{{*/
@@ -460,7 +504,7 @@ struct pkgCache::PackageFile
    /** \brief Link to the next PackageFile in the Cache */
    map_ptrloc NextFile;        // PackageFile
    /** \brief unique sequel ID */
-   unsigned int ID;
+   map_id_t ID;
 };
 									/*}}}*/
 // VerFile structure							/*{{{*/
@@ -502,10 +546,37 @@ struct pkgCache::DescFile
     or handled as separate versions based on the Hash value. */
 struct pkgCache::Version
 {
+   /* The fields used while resolving come first, the rest of the data
+      is kept apart in the VersionDetails. */
+
    /** \brief complete version string */
    map_ptrloc VerStr;            // StringItem
-   /** \brief section this version is filled in */
-   map_ptrloc Section;           // StringItem
+   /** \brief links to the owning package
+
+       This allows reverse dependencies to determine the package */
+   map_ptrloc ParentPkg;         // Package
+   /** \brief next (lower or equal) version in the linked list */
+   map_ptrloc NextVer;           // Version
+   /** \brief base of the dependency list */
+   map_ptrloc DependsList;       // Dependency
+   /** \brief list of pkgCache::Provides */
+   map_ptrloc ProvidesList;      // Provides
+   /** \brief references all the PackageFile's that this version came from
+
+       FileList can be used to determine what distribution(s) the Version
+       applies to. If FileList is 0 then this is a blank version.
+       The structure should also have a 0 in all other fields excluding
+       pkgCache::Version::VerStr and Possibly pkgCache::Version::NextVer. */
+   map_ptrloc FileList;          // VerFile
+   /** \brief the rarely used data of this version */
+   map_ptrloc Details;           // VersionDetails
+   /** \brief unique sequel ID */
+   map_id_t ID;
+   /** \brief characteristic value representing this version
+
+       No two packages in existence should have the same VerStr
+       and Hash with different contents. */
+   unsigned short Hash;
 
    /** \brief Multi-Arch capabilities of a package version */
    enum VerMultiArch { None = 0, /*!< is the default and doesn't trigger special behaviour */
@@ -520,42 +591,28 @@ struct pkgCache::Version
        Flags used are defined in pkgCache::Version::VerMultiArch
    */
    unsigned char MultiArch;
+   /** \brief parsed priority value */
+   unsigned char Priority;
+};
+									/*}}}*/
+// VersionDetails structure						/*{{{*/
+/** \brief the parts of a version which are rarely needed
 
-   /** \brief references all the PackageFile's that this version came from
-
-       FileList can be used to determine what distribution(s) the Version
-       applies to. If FileList is 0 then this is a blank version.
-       The structure should also have a 0 in all other fields excluding
-       pkgCache::Version::VerStr and Possibly pkgCache::Version::NextVer. */
-   map_ptrloc FileList;          // VerFile
-   /** \brief next (lower or equal) version in the linked list */
-   map_ptrloc NextVer;           // Version
+    They are kept out of pkgCache::Version so that walking over all the
+    versions touches as little memory as possible. VerIterator gives
+    access to them like to the fields of the version. */
+struct pkgCache::VersionDetails
+{
+   /** \brief section this version is filled in */
+   map_ptrloc Section;           // StringItem
    /** \brief next description in the linked list */
    map_ptrloc DescriptionList;   // Description
-   /** \brief base of the dependency list */
-   map_ptrloc DependsList;       // Dependency
-   /** \brief links to the owning package
-
-       This allows reverse dependencies to determine the package */
-   map_ptrloc ParentPkg;         // Package
-   /** \brief list of pkgCache::Provides */
-   map_ptrloc ProvidesList;      // Provides
-
    /** \brief archive size for this version
 
        For Debian this is the size of the .deb file. */
    unsigned long long Size;      // These are the .deb size
    /** \brief uncompressed size for this version */
    unsigned long long InstalledSize;
-   /** \brief characteristic value representing this version
-
-       No two packages in existence should have the same VerStr
-       and Hash with different contents. */
-   unsigned short Hash;
-   /** \brief unique sequel ID */
-   unsigned int ID;
-   /** \brief parsed priority value */
-   unsigned char Priority;
 };
 									/*}}}*/
 // Description structure						/*{{{*/
@@ -581,7 +638,7 @@ struct pkgCache::Description
    map_ptrloc ParentPkg;         // Package
 
    /** \brief unique sequel ID */
-   unsigned int ID;
+   map_id_t ID;
 };
 									/*}}}*/
 // Dependency structure							/*{{{*/
@@ -608,7 +665,7 @@ struct pkgCache::Dependency
    map_ptrloc ParentVer;       // Version
 
    /** \brief unique sequel ID */
-   map_ptrloc ID;
+   map_id_t ID;
    /** \brief Dependency type - Depends, Recommends, Conflicts, etc */
    unsigned char Type;
    /** \brief comparison operator specified on the depends line
@@ -661,6 +718,33 @@ struct pkgCache::StringItem
    map_ptrloc NextItem;      // StringItem
 };
 									/*}}}*/
+// VersionKey structure							/*{{{*/
+/** \brief parsed form of a version string
+
+    The version strings of versions, dependencies and provides are
+    preceded by this key in the cache, so that the versioning system can
+    compare them without parsing them again. It is filled in by
+    pkgVersioningSystem::MakeVersionKey; if Epoch is NoEpoch the key can't
+    be used and the strings have to be compared instead. Once the cache is
+    built the generator ranks all of them, so that two cached versions
+    compare like their ranks. */
+struct pkgCache::VersionKey
+{
+   enum { NoEpoch = 0xFFFFFFFF };
+   /** \brief numeric value of the epoch */
+   unsigned int Epoch;
+   /** \brief orders versions with the same epoch if both are non-zero
+       and differ, otherwise the versions have to be compared */
+   unsigned int SortKey;
+   /** \brief offset of the upstream version in the string */
+   unsigned short Upstream;
+   /** \brief offset of the revision (its '-') or length of the string */
+   unsigned short Revision;
+   /** \brief position of the version in the ordered list of all version
+       strings of the cache, equal versions share it; 0 if it has none */
+   unsigned int Rank;
+};
+									/*}}}*/
 
 
 inline char const * pkgCache::NativeArch()
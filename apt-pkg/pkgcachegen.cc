@@ -30,13 +30,25 @@
 #include <apt-pkg/mmap.h>
 #include <apt-pkg/pkgcache.h>
 #include <apt-pkg/cacheiterators.h>
+#include <apt-pkg/tagfile.h>
+#include <apt-pkg/aptconfiguration.h>
+#include <apt-pkg/debmetaindex.h>
+#include <apt-pkg/indexrecords.h>
+#include <apt-pkg/sha2.h>
 
 #include <stddef.h>
+#include <stdlib.h>
 #include <string.h>
+#include <algorithm>
 #include <iostream>
+#include <limits>
+#include <map>
+#include <sstream>
 #include <string>
+#include <utility>
 #include <vector>
 #include <sys/stat.h>
+#include <pthread.h>
 #include <unistd.h>
 
 #include <apti18n.h>
@@ -46,6 +58,7 @@ template <typename Iter> std::vector<Iter*> pkgCacheGenerator::Dynamic<Iter>::to
 
 static bool IsDuplicateDescription(pkgCache::DescIterator Desc,
 			    MD5SumValue const &CurMd5, std::string const &CurLang);
+static bool CheckValidity(pkgCache &Cache, FileIterator Start, FileIterator End);
 
 using std::string;
 
@@ -53,11 +66,10 @@ using std::string;
 // ---------------------------------------------------------------------
 /* We set the dirty flag and make sure that is written to the disk */
 pkgCacheGenerator::pkgCacheGenerator(DynamicMMap *pMap,OpProgress *Prog) :
-		    Map(*pMap), Cache(pMap,false), Progress(Prog),
-		    FoundFileDeps(0)
+		    Preloader(NULL), Map(*pMap), Cache(pMap,false),
+		    Progress(Prog), FoundFileDeps(0)
 {
    CurrentFile = 0;
-   memset(UniqHash,0,sizeof(UniqHash));
    
    if (_error->PendingError() == true)
       return;
@@ -73,6 +85,7 @@ pkgCacheGenerator::pkgCacheGenerator(DynamicMMap *pMap,OpProgress *Prog) :
 
       // Starting header
       *Cache.HeaderP = pkgCache::Header();
+      Cache.HeaderP->Lean = _config->FindB("APT::Cache-Lean", false);
       map_ptrloc const idxVerSysName = WriteStringInMap(_system->VS->Label);
       Cache.HeaderP->VerSysName = idxVerSysName;
       // this pointer is set in ReMap, but we need it now for WriteUniqString
@@ -81,6 +94,11 @@ pkgCacheGenerator::pkgCacheGenerator(DynamicMMap *pMap,OpProgress *Prog) :
       Cache.HeaderP->Architecture = idxArchitecture;
       if (unlikely(idxVerSysName == 0 || idxArchitecture == 0))
 	 return;
+      map_ptrloc TableSize = 64;
+      while (TableSize < (unsigned long) _config->FindI("APT::Cache-HashTableSize", 4096))
+	 TableSize *= 2;
+      if (GrowHashTables(TableSize) == false)
+	 return;
       Cache.ReMap();
    }
    else
@@ -93,6 +111,9 @@ pkgCacheGenerator::pkgCacheGenerator(DynamicMMap *pMap,OpProgress *Prog) :
 	 _error->Error(_("Cache has an incompatible versioning system"));
 	 return;
       }      
+
+      // the index is out of date as soon as anything changes
+      Cache.HeaderP->Satisfiers = 0;
    }
    
    Cache.HeaderP->Dirty = true;
@@ -107,6 +128,9 @@ pkgCacheGenerator::~pkgCacheGenerator()
 {
    if (_error->PendingError() == true)
       return;
+   RankVersions();
+   if (IndexSatisfiers() == false)
+      return;
    if (Map.Sync() == false)
       return;
    
@@ -126,10 +150,6 @@ void pkgCacheGenerator::ReMap(void const * const oldMap, void const * const newM
 
    CurrentFile += (pkgCache::PackageFile const * const) newMap - (pkgCache::PackageFile const * const) oldMap;
 
-   for (size_t i = 0; i < _count(UniqHash); ++i)
-      if (UniqHash[i] != 0)
-	 UniqHash[i] += (pkgCache::StringItem const * const) newMap - (pkgCache::StringItem const * const) oldMap;
-
    for (std::vector<pkgCache::GrpIterator*>::const_iterator i = Dynamic<pkgCache::GrpIterator>::toReMap.begin();
 	i != Dynamic<pkgCache::GrpIterator>::toReMap.end(); ++i)
       (*i)->ReMap(oldMap, newMap);
@@ -171,6 +191,199 @@ map_ptrloc pkgCacheGenerator::WriteStringInMap(const char *String) {
    return index;
 }
 									/*}}}*/
+// CacheGenerator::WriteVersionInMap - Write a version string with its key	/*{{{*/
+// ---------------------------------------------------------------------
+/* The string is preceded by the pkgCache::VersionKey the versioning
+   system parsed from it, the returned index points at the string. */
+map_ptrloc pkgCacheGenerator::WriteVersionInMap(std::string const &Version)
+{
+   void const * const oldMap = Map.Data();
+   map_ptrloc const Item = Map.RawAllocate(sizeof(pkgCache::VersionKey) + Version.length() + 1,
+					   sizeof(map_ptrloc));
+   if (unlikely(Item == 0))
+      return 0;
+   ReMap(oldMap, Map.Data());
+
+   pkgCache::VersionKey * const Key = (pkgCache::VersionKey *)(Cache.StrP + Item);
+   Cache.VS->MakeVersionKey(Version.c_str(), Version.c_str() + Version.length(), *Key);
+   memcpy(Key + 1, Version.c_str(), Version.length() + 1);
+   return Item + sizeof(pkgCache::VersionKey);
+}
+									/*}}}*/
+// VersionOrder - Order of version strings in the cache			/*{{{*/
+struct VersionOrder
+{
+   pkgCache &Cache;
+   VersionOrder(pkgCache &Cache) : Cache(Cache) {}
+   pkgCache::VersionKey const &Key(map_ptrloc const Str) const
+   {
+      return *((pkgCache::VersionKey const *)(Cache.StrP + Str) - 1);
+   }
+   int Cmp(map_ptrloc const A, map_ptrloc const B) const
+   {
+      return Cache.VS->CmpVersionKey(Key(A), Cache.StrP + A, Key(B), Cache.StrP + B);
+   }
+   bool operator() (map_ptrloc const A, map_ptrloc const B) const
+   {
+      return Cmp(A, B) < 0;
+   }
+};
+									/*}}}*/
+// CacheGenerator::RankVersions - Rank all version strings of the cache	/*{{{*/
+// ---------------------------------------------------------------------
+/* The strings of the versions, dependencies and provides are sorted and
+   numbered, equal versions get the same rank. Strings without a usable
+   key aren't ranked. Ranks left from an earlier run (an updated cache or
+   one based on the source cache) are still in order among themselves,
+   so they are used for the sorting and replaced afterwards. */
+void pkgCacheGenerator::RankVersions()
+{
+   std::vector<map_ptrloc> Strings;
+   Strings.reserve(Cache.HeaderP->VersionCount + Cache.HeaderP->DependsCount / 4);
+   for (pkgCache::PkgIterator P = Cache.PkgBegin(); P.end() == false; ++P)
+      for (pkgCache::VerIterator V = P.VersionList(); V.end() == false; ++V)
+      {
+	 Strings.push_back(V->VerStr);
+	 for (pkgCache::DepIterator D = V.DependsList(); D.end() == false; ++D)
+	    if (D->Version != 0)
+	       Strings.push_back(D->Version);
+	 for (pkgCache::PrvIterator Prv = V.ProvidesList(); Prv.end() == false; ++Prv)
+	    if (Prv->ProvideVersion != 0)
+	       Strings.push_back(Prv->ProvideVersion);
+      }
+   std::sort(Strings.begin(), Strings.end());
+   Strings.erase(std::unique(Strings.begin(), Strings.end()), Strings.end());
+
+   VersionOrder const Order(Cache);
+   std::vector<map_ptrloc>::iterator Keyed = Strings.begin();
+   for (std::vector<map_ptrloc>::const_iterator S = Strings.begin(); S != Strings.end(); ++S)
+      if (Order.Key(*S).Epoch != pkgCache::VersionKey::NoEpoch)
+	 *Keyed++ = *S;
+   Strings.erase(Keyed, Strings.end());
+   std::stable_sort(Strings.begin(), Strings.end(), Order);
+
+   std::vector<unsigned int> Ranks(Strings.size());
+   for (size_t I = 0; I < Strings.size(); ++I)
+      Ranks[I] = (I == 0) ? 1 : Ranks[I - 1] + (Order.Cmp(Strings[I - 1], Strings[I]) != 0 ? 1 : 0);
+   for (size_t I = 0; I < Strings.size(); ++I)
+      ((pkgCache::VersionKey *)(Cache.StrP + Strings[I]) - 1)->Rank = Ranks[I];
+}
+									/*}}}*/
+// CacheGenerator::IndexSatisfiers - Store the targets of each dependency/*{{{*/
+// ---------------------------------------------------------------------
+/* Which versions can satisfy a dependency only depends on the cache, so
+   they are collected here once for every dependency in the order of
+   TargetIterator instead of each time the dependency is looked at. The
+   index of an updated cache is replaced, the space of the old one is
+   left unused. */
+bool pkgCacheGenerator::IndexSatisfiers()
+{
+   if (_config->FindB("APT::Cache-Satisfiers", true) == false)
+      return true;
+
+   map_ptrloc const Deps = Cache.HeaderP->DependsCount;
+   std::vector<map_ptrloc> ByID(Deps, 0);
+   for (pkgCache::PkgIterator P = Cache.PkgBegin(); P.end() == false; ++P)
+      for (pkgCache::VerIterator V = P.VersionList(); V.end() == false; ++V)
+	 for (pkgCache::DepIterator D = V.DependsList(); D.end() == false; ++D)
+	    ByID[D->ID] = D.Index();
+
+   std::vector<map_ptrloc> Index(2 * Deps + 1);
+   Index.reserve(Index.size() + Deps + Cache.HeaderP->ProvidesCount);
+   for (map_ptrloc ID = 0; ID < Deps; ++ID)
+   {
+      Index[2 * ID] = Index.size();
+      if (ByID[ID] == 0)
+      {
+	 // left over from a retracted version
+	 Index[2 * ID + 1] = Index.size();
+	 continue;
+      }
+
+      pkgCache::DepIterator const D(Cache, Cache.DepP + ByID[ID]);
+      pkgCache::PkgIterator const Target = D.TargetPkg();
+      if (D.IsIgnorable(Target) == false)
+	 for (pkgCache::VerIterator V = Target.VersionList(); V.end() == false; ++V)
+	    if (D.IsSatisfied(V) == true)
+	       Index.push_back(V.Index());
+      Index[2 * ID + 1] = Index.size();
+      for (pkgCache::PrvIterator Prv = Target.ProvidesList(); Prv.end() == false; ++Prv)
+	 if (D.IsIgnorable(Prv) == false && D.IsSatisfied(Prv) == true)
+	    Index.push_back(Prv->Version);
+   }
+   Index[2 * Deps] = Index.size();
+
+   void const * const oldMap = Map.Data();
+   map_ptrloc const Satisfiers = Map.RawAllocate(Index.size() * sizeof(map_ptrloc), sizeof(map_ptrloc));
+   if (unlikely(Satisfiers == 0))
+      return false;
+   ReMap(oldMap, Map.Data());
+   memcpy((char *)Map.Data() + Satisfiers, &Index[0], Index.size() * sizeof(map_ptrloc));
+   Cache.HeaderP->Satisfiers = Satisfiers;
+   return true;
+}
+									/*}}}*/
+// HashChainOrder - Order of the entries in a hash chain			/*{{{*/
+static int HashChainOrder(unsigned int const Hash, const char *Name,
+			  unsigned int const OtherHash, const char *OtherName)
+{
+   if (Hash != OtherHash)
+      return Hash < OtherHash ? -1 : 1;
+   return strcasecmp(Name, OtherName);
+}
+									/*}}}*/
+// CacheGenerator::GrowHashTables - Move the names into larger tables	/*{{{*/
+// ---------------------------------------------------------------------
+/* The tables are allocated in one block with Size buckets each. The
+   groups (and the packages of each group as one sequence) are inserted
+   into the new tables, the space of the old ones is left unused. */
+bool pkgCacheGenerator::GrowHashTables(map_ptrloc const Size)
+{
+   void const * const oldMap = Map.Data();
+   map_ptrloc const Tables = Map.RawAllocate(2 * Size * sizeof(map_ptrloc), sizeof(map_ptrloc));
+   if (unlikely(Tables == 0))
+      return false;
+   ReMap(oldMap, Map.Data());
+
+   map_ptrloc * const GrpTable = (map_ptrloc *)((char *)Map.Data() + Tables);
+   map_ptrloc * const PkgTable = GrpTable + Size;
+   memset(GrpTable, 0, 2 * Size * sizeof(map_ptrloc));
+
+   map_ptrloc const * const OldGrpTable = Cache.HeaderP->GrpHashTableP();
+   for (map_ptrloc I = 0; I < Cache.HeaderP->HashTableSize; ++I)
+   {
+      for (map_ptrloc G = OldGrpTable[I]; G != 0;)
+      {
+	 pkgCache::Group * const Grp = Cache.GrpP + G;
+	 map_ptrloc const Next = Grp->Next;
+	 const char * const Name = Cache.StrP + Grp->Name;
+
+	 map_ptrloc *insertAt = &GrpTable[Grp->Hash & (Size - 1)];
+	 while (*insertAt != 0 && HashChainOrder(Grp->Hash, Name,
+		  (Cache.GrpP + *insertAt)->Hash, Cache.StrP + (Cache.GrpP + *insertAt)->Name) > 0)
+	    insertAt = &(Cache.GrpP + *insertAt)->Next;
+	 Grp->Next = *insertAt;
+	 *insertAt = G;
+
+	 if (Grp->FirstPackage != 0)
+	 {
+	    insertAt = &PkgTable[Grp->Hash & (Size - 1)];
+	    while (*insertAt != 0 && HashChainOrder(Grp->Hash, Name,
+		     (Cache.PkgP + *insertAt)->Hash, Cache.StrP + (Cache.PkgP + *insertAt)->Name) > 0)
+	       insertAt = &(Cache.PkgP + *insertAt)->NextPackage;
+	    (Cache.PkgP + Grp->LastPackage)->NextPackage = *insertAt;
+	    *insertAt = Grp->FirstPackage;
+	 }
+	 G = Next;
+      }
+   }
+
+   Cache.HeaderP->GrpHashTable = Tables;
+   Cache.HeaderP->PkgHashTable = Tables + Size * sizeof(map_ptrloc);
+   Cache.HeaderP->HashTableSize = Size;
+   return true;
+}
+									/*}}}*/
 map_ptrloc pkgCacheGenerator::AllocateInMap(const unsigned long &size) {/*{{{*/
    void const * const oldMap = Map.Data();
    map_ptrloc const index = Map.Allocate(size);
@@ -253,18 +466,23 @@ bool pkgCacheGenerator::MergeList(ListParser &List,
       }
    }
 
-   if (Cache.HeaderP->PackageCount >= (1ULL<<sizeof(Cache.PkgP->ID)*8)-1)
+   map_id_t const MaxID = std::numeric_limits<map_id_t>::max();
+   if (Cache.HeaderP->PackageCount >= MaxID)
       return _error->Error(_("Wow, you exceeded the number of package "
 			     "names this APT is capable of."));
-   if (Cache.HeaderP->VersionCount >= (1ULL<<(sizeof(Cache.VerP->ID)*8))-1)
+   if (Cache.HeaderP->VersionCount >= MaxID)
       return _error->Error(_("Wow, you exceeded the number of versions "
 			     "this APT is capable of."));
-   if (Cache.HeaderP->DescriptionCount >= (1ULL<<(sizeof(Cache.DescP->ID)*8))-1)
+   if (Cache.HeaderP->DescriptionCount >= MaxID)
       return _error->Error(_("Wow, you exceeded the number of descriptions "
 			     "this APT is capable of."));
-   if (Cache.HeaderP->DependsCount >= (1ULL<<(sizeof(Cache.DepP->ID)*8))-1ULL)
+   if (Cache.HeaderP->DependsCount >= MaxID)
       return _error->Error(_("Wow, you exceeded the number of dependencies "
 			     "this APT is capable of."));
+   // strings are addressed by their offset in the map
+   if (Map.Size() >= std::numeric_limits<map_ptrloc>::max())
+      return _error->Error(_("Wow, you exceeded the size of the cache "
+			     "this APT is capable of."));
 
    FoundFileDeps |= List.HasFileDeps();
    return true;
@@ -300,6 +518,9 @@ bool pkgCacheGenerator::MergeListPackage(ListParser &List, pkgCache::PkgIterator
       return _error->Error(_("Error occurred while processing %s (%s%d)"),
 			   Pkg.Name(), "UsePackage", 1);
 
+   if (Cache.HeaderP->Lean == true)
+      return true;
+
    // Find the right version to write the description
    MD5SumValue CurMd5 = List.Description_md5();
    if (CurMd5.Value().empty() == true || List.Description().empty() == true)
@@ -333,7 +554,7 @@ bool pkgCacheGenerator::MergeListPackage(ListParser &List, pkgCache::PkgIterator
       // that to be able to efficiently share these lists
       VerDesc = Ver.DescriptionList(); // old value might be invalid after ReMap
       for (;VerDesc.end() == false && VerDesc->NextDesc != 0; ++VerDesc);
-      map_ptrloc * const LastNextDesc = (VerDesc.end() == true) ? &Ver->DescriptionList : &VerDesc->NextDesc;
+      map_ptrloc * const LastNextDesc = (VerDesc.end() == true) ? &Ver.Details().DescriptionList : &VerDesc->NextDesc;
       *LastNextDesc = descindex;
 
       if (NewFileDesc(Desc,List) == false)
@@ -359,12 +580,15 @@ bool pkgCacheGenerator::MergeListVersion(ListParser &List, pkgCache::PkgIterator
    unsigned short const Hash = List.VersionHash();
    if (Ver.end() == false)
    {
+      pkgCache::VersionKey Key;
+      Cache.VS->MakeVersionKey(Version.c_str(), Version.c_str() + Version.length(), Key);
+
       /* We know the list is sorted so we use that fact in the search.
          Insertion of new versions is done with correct sorting */
       int Res = 1;
       for (; Ver.end() == false; LastVer = &Ver->NextVer, Ver++)
       {
-	 Res = Cache.VS->CmpVersion(Version,Ver.VerStr());
+	 Res = Cache.VS->CmpVersionKey(Key,Version.c_str(),Ver.VerKey(),Ver.VerStr());
 	 // Version is higher as current version - insert here
 	 if (Res > 0)
 	    break;
@@ -487,6 +711,8 @@ bool pkgCacheGenerator::MergeListVersion(ListParser &List, pkgCache::PkgIterator
    }
 
    /* Record the Description (it is not translated) */
+   if (Cache.HeaderP->Lean == true)
+      return true;
    MD5SumValue CurMd5 = List.Description_md5();
    if (CurMd5.Value().empty() == true || List.Description().empty() == true)
       return true;
@@ -503,7 +729,7 @@ bool pkgCacheGenerator::MergeListVersion(ListParser &List, pkgCache::PkgIterator
       {
 	 if (IsDuplicateDescription(V.DescriptionList(), CurMd5, "") == false)
 	    continue;
-	 Ver->DescriptionList = V->DescriptionList;
+	 Ver.Details().DescriptionList = V.Details().DescriptionList;
 	 return true;
       }
    }
@@ -518,7 +744,7 @@ bool pkgCacheGenerator::MergeListVersion(ListParser &List, pkgCache::PkgIterator
 			   Pkg.Name(), "NewDescription", 2);
 
    Desc->ParentPkg = Pkg.Index();
-   Ver->DescriptionList = descindex;
+   Ver.Details().DescriptionList = descindex;
 
    if (NewFileDesc(Desc,List) == false)
       return _error->Error(_("Error occurred while processing %s (%s%d)"),
@@ -600,14 +826,24 @@ bool pkgCacheGenerator::NewGroup(pkgCache::GrpIterator &Grp, const string &Name)
    Grp->Name = idxName;
 
    // Insert it into the hash table
-   unsigned long const Hash = Cache.Hash(Name);
-   map_ptrloc *insertAt = &Cache.HeaderP->GrpHashTable[Hash];
-   while (*insertAt != 0 && strcasecmp(Name.c_str(), Cache.StrP + (Cache.GrpP + *insertAt)->Name) > 0)
+   Grp->Hash = pkgCache::NameHash(Name.c_str());
+   map_ptrloc *insertAt = &Cache.HeaderP->GrpHashTableP()[Grp->Hash & (Cache.HeaderP->HashTableSize - 1)];
+   while (*insertAt != 0 && HashChainOrder(Grp->Hash, Name.c_str(),
+	    (Cache.GrpP + *insertAt)->Hash, Cache.StrP + (Cache.GrpP + *insertAt)->Name) > 0)
       insertAt = &(Cache.GrpP + *insertAt)->Next;
    Grp->Next = *insertAt;
    *insertAt = Group;
 
    Grp->ID = Cache.HeaderP->GroupCount++;
+
+   // keep the load factor of the hash tables below 3/4
+   if (Cache.HeaderP->GroupCount * 4 > Cache.HeaderP->HashTableSize * 3)
+   {
+      map_ptrloc const idxGrp = Grp.Index();
+      if (GrowHashTables(Cache.HeaderP->HashTableSize * 2) == false)
+	 return false;
+      Grp = pkgCache::GrpIterator(Cache, Cache.GrpP + idxGrp);
+   }
    return true;
 }
 									/*}}}*/
@@ -636,9 +872,9 @@ bool pkgCacheGenerator::NewPackage(pkgCache::PkgIterator &Pkg,const string &Name
    {
       Grp->FirstPackage = Package;
       // Insert it into the hash table
-      unsigned long const Hash = Cache.Hash(Name);
-      map_ptrloc *insertAt = &Cache.HeaderP->PkgHashTable[Hash];
-      while (*insertAt != 0 && strcasecmp(Name.c_str(), Cache.StrP + (Cache.PkgP + *insertAt)->Name) > 0)
+      map_ptrloc *insertAt = &Cache.HeaderP->PkgHashTableP()[Grp->Hash & (Cache.HeaderP->HashTableSize - 1)];
+      while (*insertAt != 0 && HashChainOrder(Grp->Hash, Name.c_str(),
+	       (Cache.PkgP + *insertAt)->Hash, Cache.StrP + (Cache.PkgP + *insertAt)->Name) > 0)
 	 insertAt = &(Cache.PkgP + *insertAt)->NextPackage;
       Pkg->NextPackage = *insertAt;
       *insertAt = Package;
@@ -654,6 +890,7 @@ bool pkgCacheGenerator::NewPackage(pkgCache::PkgIterator &Pkg,const string &Name
 
    // Set the name, arch and the ID
    Pkg->Name = Grp->Name;
+   Pkg->Hash = Grp->Hash;
    Pkg->Group = Grp.Index();
    // all is mapped to the native architecture
    map_ptrloc const idxArch = (Arch == "all") ? Cache.HeaderP->Architecture : WriteUniqString(Arch.c_str());
@@ -753,9 +990,11 @@ bool pkgCacheGenerator::NewFileVer(pkgCache::VerIterator &Ver,
    pkgCache::VerFileIterator VF(Cache,Cache.VerFileP + VerFile);
    VF->File = CurrentFile - Cache.PkgFileP;
    
-   // Link it to the end of the list
+   /* Link it in the order of the files, which is the end of the list
+      unless a retracted file is merged again */
    map_ptrloc *Last = &Ver->FileList;
-   for (pkgCache::VerFileIterator V = Ver.FileList(); V.end() == false; ++V)
+   for (pkgCache::VerFileIterator V = Ver.FileList();
+	V.end() == false && V.File()->ID < CurrentFile->ID; ++V)
       Last = &V->NextFile;
    VF->NextFile = *Last;
    *Last = VF.Index();
@@ -778,7 +1017,10 @@ unsigned long pkgCacheGenerator::NewVersion(pkgCache::VerIterator &Ver,
 					    unsigned long const Hash,
 					    unsigned long Next)
 {
-   // Get a structure
+   // Get a structure, the rarely needed fields go into their own record
+   map_ptrloc const Details = AllocateInMap(sizeof(pkgCache::VersionDetails));
+   if (Details == 0)
+      return 0;
    map_ptrloc const Version = AllocateInMap(sizeof(pkgCache::Version));
    if (Version == 0)
       return 0;
@@ -786,6 +1028,7 @@ unsigned long pkgCacheGenerator::NewVersion(pkgCache::VerIterator &Ver,
    // Fill it in
    Ver = pkgCache::VerIterator(Cache,Cache.VerP + Version);
    //Dynamic<pkgCache::VerIterator> DynV(Ver); // caller MergeListVersion already takes care of it
+   Ver->Details = Details;
    Ver->NextVer = Next;
    Ver->ParentPkg = ParentPkg;
    Ver->Hash = Hash;
@@ -814,7 +1057,7 @@ unsigned long pkgCacheGenerator::NewVersion(pkgCache::VerIterator &Ver,
       }
    }
    // haven't found the version string, so create
-   map_ptrloc const idxVerStr = WriteStringInMap(VerStr);
+   map_ptrloc const idxVerStr = WriteVersionInMap(VerStr);
    if (unlikely(idxVerStr == 0))
       return 0;
    Ver->VerStr = idxVerStr;
@@ -838,9 +1081,10 @@ bool pkgCacheGenerator::NewFileDesc(pkgCache::DescIterator &Desc,
    pkgCache::DescFileIterator DF(Cache,Cache.DescFileP + DescFile);
    DF->File = CurrentFile - Cache.PkgFileP;
 
-   // Link it to the end of the list
+   // Link it in the order of the files, see NewFileVer
    map_ptrloc *Last = &Desc->FileList;
-   for (pkgCache::DescFileIterator D = Desc.FileList(); D.end() == false; ++D)
+   for (pkgCache::DescFileIterator D = Desc.FileList();
+	D.end() == false && D.File()->ID < CurrentFile->ID; ++D)
       Last = &D->NextFile;
 
    DF->NextFile = *Last;
@@ -911,7 +1155,7 @@ bool pkgCacheGenerator::NewDepends(pkgCache::PkgIterator &Pkg,
       if (index == 0)
       {
 	 void const * const oldMap = Map.Data();
-	 index = WriteStringInMap(Version);
+	 index = WriteVersionInMap(Version);
 	 if (unlikely(index == 0))
 	    return false;
 	 if (OldDepLast != 0 && oldMap != Map.Data())
@@ -1031,7 +1275,7 @@ bool pkgCacheGenerator::ListParser::NewProvides(pkgCache::VerIterator &Ver,
    Prv->NextPkgProv = Ver->ProvidesList;
    Ver->ProvidesList = Prv.Index();
    if (Version.empty() == false) {
-      map_ptrloc const idxProvideVersion = WriteString(Version);
+      map_ptrloc const idxProvideVersion = Owner->WriteVersionInMap(Version);
       Prv->ProvideVersion = idxProvideVersion;
       if (unlikely(idxProvideVersion == 0))
 	 return false;
@@ -1060,75 +1304,277 @@ bool pkgCacheGenerator::ListParser::SameVersion(unsigned short const Hash,/*{{{*
 // CacheGenerator::SelectFile - Select the current file being parsed	/*{{{*/
 // ---------------------------------------------------------------------
 /* This is used to select which file is to be associated with all newly
-   added versions. The caller is responsible for setting the IMS fields. */
+   added versions. The caller is responsible for setting the IMS fields.
+   A file which was retracted before is put back into its old place. */
 bool pkgCacheGenerator::SelectFile(const string &File,const string &Site,
 				   const pkgIndexFile &Index,
 				   unsigned long Flags)
 {
-   // Get some space for the structure
-   map_ptrloc const idxFile = AllocateInMap(sizeof(*CurrentFile));
-   if (unlikely(idxFile == 0))
-      return false;
-   CurrentFile = Cache.PkgFileP + idxFile;
+   std::vector<map_ptrloc>::iterator Retracted = RetractedFiles.begin();
+   for (; Retracted != RetractedFiles.end(); ++Retracted)
+      if (File == Cache.StrP + Cache.PkgFileP[*Retracted].FileName)
+	 break;
+
+   if (Retracted != RetractedFiles.end())
+   {
+      // Forget everything but the name and the place in the list
+      CurrentFile = Cache.PkgFileP + *Retracted;
+      RetractedFiles.erase(Retracted);
+      pkgCache::PackageFile const Old = *CurrentFile;
+      memset(CurrentFile, 0, sizeof(*CurrentFile));
+      CurrentFile->FileName = Old.FileName;
+      CurrentFile->NextFile = Old.NextFile;
+      CurrentFile->ID = Old.ID;
+   }
+   else
+   {
+      // Get some space for the structure
+      map_ptrloc const idxFile = AllocateInMap(sizeof(*CurrentFile));
+      if (unlikely(idxFile == 0))
+	 return false;
+      CurrentFile = Cache.PkgFileP + idxFile;
+
+      map_ptrloc const idxFileName = WriteStringInMap(File);
+      if (unlikely(idxFileName == 0))
+	 return false;
+      CurrentFile->FileName = idxFileName;
+      CurrentFile->NextFile = Cache.HeaderP->FileList;
+      CurrentFile->ID = Cache.HeaderP->PackageFileCount;
+      Cache.HeaderP->FileList = CurrentFile - Cache.PkgFileP;
+      Cache.HeaderP->PackageFileCount++;
+   }
 
    // Fill it in
-   map_ptrloc const idxFileName = WriteStringInMap(File);
    map_ptrloc const idxSite = WriteUniqString(Site);
-   if (unlikely(idxFileName == 0 || idxSite == 0))
+   if (unlikely(idxSite == 0))
       return false;
-   CurrentFile->FileName = idxFileName;
    CurrentFile->Site = idxSite;
-   CurrentFile->NextFile = Cache.HeaderP->FileList;
    CurrentFile->Flags = Flags;
-   CurrentFile->ID = Cache.HeaderP->PackageFileCount;
    map_ptrloc const idxIndexType = WriteUniqString(Index.GetType()->Label);
    if (unlikely(idxIndexType == 0))
       return false;
    CurrentFile->IndexType = idxIndexType;
    PkgFileName = File;
-   Cache.HeaderP->FileList = CurrentFile - Cache.PkgFileP;
-   Cache.HeaderP->PackageFileCount++;
 
    if (Progress != 0)
       Progress->SubProgress(Index.Size());
    return true;
 }
 									/*}}}*/
+// CacheGenerator::RetractFiles - Remove the data of some files		/*{{{*/
+// ---------------------------------------------------------------------
+/* The VerFile and DescFile records are the provenance of each version
+   and description. Records of the retracted files are dropped first and
+   versions without any record left are unlinked from their package. The
+   dependencies and provides of these versions are marked with a zero
+   ParentVer or Version and removed from the reverse lists in a second
+   run over the packages, so each list is only walked once.
+
+   Descriptions are shared between versions, so a description which
+   lost its last record stays if it heads the list of a remaining
+   version - its text is in the stanza of that version, so the record is
+   recreated from the VerFile. Translations without a record are
+   unlinked. The dpkg state of a package is reset if a retracted status
+   file had it, merging the file again sets it once more. */
+bool pkgCacheGenerator::RetractFiles(std::vector<pkgCache::PkgFileIterator> const &Files)
+{
+   if (Files.empty() == true)
+      return true;
+
+   std::vector<bool> Retract(Cache.HeaderP->PackageFileCount, false);
+   for (std::vector<pkgCache::PkgFileIterator>::const_iterator F = Files.begin();
+	F != Files.end(); ++F)
+   {
+      Retract[(*F)->ID] = true;
+      RetractedFiles.push_back(F->Index());
+   }
+
+   for (pkgCache::PkgIterator Pkg = Cache.PkgBegin(); Pkg.end() == false; ++Pkg)
+   {
+      bool ResetState = false;
+      map_ptrloc *Ver = &Pkg->VersionList;
+      while (*Ver != 0)
+      {
+	 pkgCache::Version &V = Cache.VerP[*Ver];
+	 for (map_ptrloc *VF = &V.FileList; *VF != 0;)
+	 {
+	    pkgCache::PackageFile const &File = Cache.PkgFileP[Cache.VerFileP[*VF].File];
+	    if (Retract[File.ID] == false)
+	    {
+	       VF = &Cache.VerFileP[*VF].NextFile;
+	       continue;
+	    }
+	    if ((File.Flags & pkgCache::Flag::NotSource) != 0)
+	       ResetState = true;
+	    *VF = Cache.VerFileP[*VF].NextFile;
+	 }
+
+	 if (V.FileList != 0)
+	 {
+	    Ver = &V.NextVer;
+	    continue;
+	 }
+
+	 for (map_ptrloc D = V.DependsList; D != 0; D = Cache.DepP[D].NextDepends)
+	    Cache.DepP[D].ParentVer = 0;
+	 for (map_ptrloc P = V.ProvidesList; P != 0; P = Cache.ProvideP[P].NextPkgProv)
+	    Cache.ProvideP[P].Version = 0;
+	 if (Pkg->CurrentVer == *Ver)
+	    Pkg->CurrentVer = 0;
+	 *Ver = V.NextVer;
+      }
+
+      if (ResetState == true)
+      {
+	 Pkg->CurrentVer = 0;
+	 Pkg->SelectedState = pkgCache::State::Unknown;
+	 Pkg->InstState = pkgCache::State::Ok;
+	 Pkg->CurrentState = pkgCache::State::NotInstalled;
+      }
+   }
+
+   // pairs of a Description and the VerFile to recreate its record from
+   std::vector<std::pair<map_ptrloc, map_ptrloc> > Orphans;
+   for (pkgCache::PkgIterator Pkg = Cache.PkgBegin(); Pkg.end() == false; ++Pkg)
+   {
+      for (map_ptrloc *D = &Pkg->RevDepends; *D != 0;)
+	 if (Cache.DepP[*D].ParentVer == 0)
+	    *D = Cache.DepP[*D].NextRevDepends;
+	 else
+	    D = &Cache.DepP[*D].NextRevDepends;
+      for (map_ptrloc *P = &Pkg->ProvidesList; *P != 0;)
+	 if (Cache.ProvideP[*P].Version == 0)
+	    *P = Cache.ProvideP[*P].NextProvides;
+	 else
+	    P = &Cache.ProvideP[*P].NextProvides;
+
+      for (map_ptrloc Ver = Pkg->VersionList; Ver != 0; Ver = Cache.VerP[Ver].NextVer)
+      {
+	 pkgCache::VersionDetails &V = Cache.VerDetailsP[Cache.VerP[Ver].Details];
+	 for (map_ptrloc *Desc = &V.DescriptionList; *Desc != 0;)
+	 {
+	    pkgCache::Description &D = Cache.DescP[*Desc];
+	    for (map_ptrloc *DF = &D.FileList; *DF != 0;)
+	       if (Retract[Cache.PkgFileP[Cache.DescFileP[*DF].File].ID] == true)
+		  *DF = Cache.DescFileP[*DF].NextFile;
+	       else
+		  DF = &Cache.DescFileP[*DF].NextFile;
+
+	    if (D.FileList == 0 && Desc != &V.DescriptionList)
+	       *Desc = D.NextDesc;
+	    else
+	       Desc = &D.NextDesc;
+	 }
+	 if (V.DescriptionList != 0 && Cache.DescP[V.DescriptionList].FileList == 0)
+	    Orphans.push_back(std::make_pair(V.DescriptionList, Cache.VerP[Ver].FileList));
+      }
+   }
+
+   for (std::vector<std::pair<map_ptrloc, map_ptrloc> >::const_iterator O = Orphans.begin();
+	O != Orphans.end(); ++O)
+   {
+      // shared by several versions, the first one recreated it already
+      if (Cache.DescP[O->first].FileList != 0)
+	 continue;
+      map_ptrloc const DescFile = AllocateInMap(sizeof(pkgCache::DescFile));
+      if (unlikely(DescFile == 0))
+	 return false;
+      pkgCache::VerFile const &VF = Cache.VerFileP[O->second];
+      pkgCache::DescFile &DF = Cache.DescFileP[DescFile];
+      DF.File = VF.File;
+      DF.NextFile = 0;
+      DF.Offset = VF.Offset;
+      DF.Size = VF.Size;
+      Cache.DescP[O->first].FileList = DescFile;
+      Cache.HeaderP->DescFileCount++;
+   }
+
+   return true;
+}
+									/*}}}*/
+// UniqStringHash - Hash of a string for the interning table		/*{{{*/
+static unsigned int UniqStringHash(const char *S, unsigned int const Size)
+{
+   unsigned int Hash = 2166136261U;
+   for (const char * const End = S + Size; S != End; ++S)
+      Hash = (Hash ^ (unsigned char) *S) * 16777619U;
+   return Hash;
+}
+									/*}}}*/
+// CacheGenerator::InitUniqTable - Intern the strings already in the map	/*{{{*/
+void pkgCacheGenerator::InitUniqTable()
+{
+   UniqBucket const Empty = {0, 0};
+   UniqTable.assign(64, Empty);
+   UniqList.clear();
+   for (map_ptrloc I = Cache.HeaderP->StringList; I != 0; I = Cache.StringItemP[I].NextItem)
+   {
+      const char * const S = Cache.StrP + Cache.StringItemP[I].String;
+      UniqList.push_back(I);
+      AddUniqString(UniqStringHash(S, strlen(S)), I);
+   }
+}
+									/*}}}*/
+// CacheGenerator::AddUniqString - Put an item into the interning table	/*{{{*/
+// ---------------------------------------------------------------------
+/* The table is kept at most half full, so probe sequences stay short */
+void pkgCacheGenerator::AddUniqString(unsigned int const Hash, map_ptrloc const Item)
+{
+   if (UniqList.size() * 2 > UniqTable.size())
+   {
+      std::vector<UniqBucket> Old;
+      Old.swap(UniqTable);
+      UniqBucket const Empty = {0, 0};
+      UniqTable.assign(Old.size() * 2, Empty);
+      for (std::vector<UniqBucket>::const_iterator B = Old.begin(); B != Old.end(); ++B)
+	 if (B->Item != 0)
+	    AddUniqString(B->Hash, B->Item);
+   }
+
+   size_t const Mask = UniqTable.size() - 1;
+   size_t B = Hash & Mask;
+   while (UniqTable[B].Item != 0)
+      B = (B + 1) & Mask;
+   UniqTable[B].Hash = Hash;
+   UniqTable[B].Item = Item;
+}
+									/*}}}*/
 // CacheGenerator::WriteUniqueString - Insert a unique string		/*{{{*/
 // ---------------------------------------------------------------------
 /* This is used to create handles to strings. Given the same text it
-   always returns the same number */
+   always returns the same number. The strings are found with the
+   interning table, the StringList in the map is still kept sorted
+   from the largest string down for readers of the cache. */
 unsigned long pkgCacheGenerator::WriteUniqString(const char *S,
 						 unsigned int Size)
 {
-   /* We use a very small transient hash table here, this speeds up generation
-      by a fair amount on slower machines */
-   pkgCache::StringItem *&Bucket = UniqHash[(S[0]*5 + S[1]) % _count(UniqHash)];
-   if (Bucket != 0 && 
-       stringcmp(S,S+Size,Cache.StrP + Bucket->String) == 0)
-      return Bucket->String;
-   
-   // Search for an insertion point
-   pkgCache::StringItem *I = Cache.StringItemP + Cache.HeaderP->StringList;
-   int Res = 1;
-   map_ptrloc *Last = &Cache.HeaderP->StringList;
-   for (; I != Cache.StringItemP; Last = &I->NextItem, 
-        I = Cache.StringItemP + I->NextItem)
-   {
-      Res = stringcmp(S,S+Size,Cache.StrP + I->String);
-      if (Res >= 0)
-	 break;
+   if (UniqTable.empty() == true)
+      InitUniqTable();
+
+   unsigned int const Hash = UniqStringHash(S, Size);
+   size_t const Mask = UniqTable.size() - 1;
+   for (size_t B = Hash & Mask; UniqTable[B].Item != 0; B = (B + 1) & Mask)
+   {
+      if (UniqTable[B].Hash != Hash)
+	 continue;
+      pkgCache::StringItem const * const I = Cache.StringItemP + UniqTable[B].Item;
+      if (stringcmp(S,S+Size,Cache.StrP + I->String) == 0)
+	 return I->String;
    }
-   
-   // Match
-   if (Res == 0)
+
+   // Search for an insertion point
+   size_t Low = 0;
+   size_t High = UniqList.size();
+   while (Low < High)
    {
-      Bucket = I;
-      return I->String;
+      size_t const Middle = Low + (High - Low) / 2;
+      if (stringcmp(S,S+Size,Cache.StrP + Cache.StringItemP[UniqList[Middle]].String) < 0)
+	 Low = Middle + 1;
+      else
+	 High = Middle;
    }
-   
+
    // Get a structure
-   void const * const oldMap = Map.Data();
    map_ptrloc const Item = AllocateInMap(sizeof(pkgCache::StringItem));
    if (Item == 0)
       return 0;
@@ -1136,19 +1582,19 @@ unsigned long pkgCacheGenerator::WriteUniqString(const char *S,
    map_ptrloc const idxString = WriteStringInMap(S,Size);
    if (unlikely(idxString == 0))
       return 0;
-   if (oldMap != Map.Data()) {
-      Last += (map_ptrloc const * const) Map.Data() - (map_ptrloc const * const) oldMap;
-      I += (pkgCache::StringItem const * const) Map.Data() - (pkgCache::StringItem const * const) oldMap;
-   }
-   *Last = Item;
 
    // Fill in the structure
-   pkgCache::StringItem *ItemP = Cache.StringItemP + Item;
-   ItemP->NextItem = I - Cache.StringItemP;
+   pkgCache::StringItem * const ItemP = Cache.StringItemP + Item;
+   ItemP->NextItem = Low < UniqList.size() ? UniqList[Low] : 0;
    ItemP->String = idxString;
+   if (Low == 0)
+      Cache.HeaderP->StringList = Item;
+   else
+      Cache.StringItemP[UniqList[Low - 1]].NextItem = Item;
 
-   Bucket = ItemP;
-   return ItemP->String;
+   UniqList.insert(UniqList.begin() + Low, Item);
+   AddUniqString(Hash, Item);
+   return idxString;
 }
 									/*}}}*/
 // CheckValidity - Check that a cache is up-to-date			/*{{{*/
@@ -1189,7 +1635,29 @@ static bool CheckValidity(const string &CacheFile,
       _error->Discard();
       return false;
    }
-   
+
+   if (CheckValidity(Cache, Start, End) == false)
+      return false;
+
+   if (OutMap != 0)
+      *OutMap = Map.UnGuard();
+   return true;
+}
+/* This does the actual work for the function above on an already mapped
+   cache: every index file must be in the cache with matching IMS data and
+   the cache must not have any extra files. */
+static bool CheckValidity(pkgCache &Cache, FileIterator Start, FileIterator End)
+{
+   bool const Debug = _config->FindB("Debug::pkgCacheGen", false);
+
+   // a lean cache lacks what others need, a full one is just too big
+   if (Cache.HeaderP->Lean != _config->FindB("APT::Cache-Lean", false))
+   {
+      if (Debug == true)
+	 std::clog << "Cache is " << (Cache.HeaderP->Lean ? "" : "not ") << "lean" << std::endl;
+      return false;
+   }
+
    /* Now we check every index file, see if it is in the cache,
       verify the IMS data and check that it is on the disk too.. */
    SPtrArray<bool> Visited = new bool[Cache.HeaderP->PackageFileCount];
@@ -1248,9 +1716,97 @@ static bool CheckValidity(const string &CacheFile,
       _error->Discard();
       return false;
    }
-   
-   if (OutMap != 0)
-      *OutMap = Map.UnGuard();
+
+   return true;
+}
+									/*}}}*/
+// PlanCacheUpdate - Check if a cache can be updated instead of rebuilt	/*{{{*/
+// ---------------------------------------------------------------------
+/* The cache has to know all files it was built from and none of them
+   may have vanished. Changed files are retracted and merged again, new
+   files are merged on top of the rest; both are returned in Changed in
+   the order of the list. The space of retracted versions is not reused,
+   so once more than a third of the versions are dead (or most of the
+   data changed anyway) the cache is built from scratch instead. */
+static bool PlanCacheUpdate(const string &CacheFile,
+			    pkgSourceList &List,
+			    FileIterator Start,
+			    FileIterator End,
+			    std::vector<pkgIndexFile *> &Changed)
+{
+   bool const Debug = _config->FindB("Debug::pkgCacheGen", false);
+   if (CacheFile.empty() == true || FileExists(CacheFile) == false ||
+       List.GetLastModifiedTime() > GetModificationTime(CacheFile))
+      return false;
+
+   FileFd CacheF(CacheFile,FileFd::ReadOnly);
+   SPtr<MMap> Map = new MMap(CacheF,0);
+   pkgCache Cache(Map);
+   if (_error->PendingError() == true || Map->Size() == 0)
+   {
+      _error->Discard();
+      return false;
+   }
+   if (Cache.HeaderP->Lean != _config->FindB("APT::Cache-Lean", false))
+      return false;
+
+   SPtrArray<bool> Visited = new bool[Cache.HeaderP->PackageFileCount];
+   memset(Visited,0,sizeof(*Visited)*Cache.HeaderP->PackageFileCount);
+   unsigned long ChangedSize = 0;
+   unsigned long TotalSize = 0;
+   for (; Start != End; ++Start)
+   {
+      if ((*Start)->HasPackages() == false || (*Start)->Exists() == false)
+	 continue;
+      TotalSize += (*Start)->Size();
+
+      pkgCache::PkgFileIterator File = (*Start)->FindInCache(Cache);
+      if (File.end() == false)
+      {
+	 Visited[File->ID] = true;
+	 continue;
+      }
+
+      std::string const Name = (*Start)->IndexFileName();
+      if (Name.empty() == true)
+	 return false;
+      for (File = Cache.FileBegin(); File.end() == false; ++File)
+	 if (Name == File.FileName())
+	 {
+	    Visited[File->ID] = true;
+	    break;
+	 }
+      Changed.push_back(*Start);
+      ChangedSize += (*Start)->Size();
+      if (Debug == true)
+	 std::clog << "Update " << (*Start)->Describe() << (File.end() == true ? " (new)" : "") << std::endl;
+   }
+
+   for (unsigned I = 0; I != Cache.HeaderP->PackageFileCount; I++)
+      if (Visited[I] == false)
+      {
+	 if (Debug == true)
+	    std::clog << "File with ID " << I << " is gone, can't update" << std::endl;
+	 return false;
+      }
+
+   unsigned long Versions = 0;
+   for (pkgCache::PkgIterator Pkg = Cache.PkgBegin(); Pkg.end() == false; ++Pkg)
+      for (pkgCache::VerIterator Ver = Pkg.VersionList(); Ver.end() == false; ++Ver)
+	 ++Versions;
+   if (Cache.HeaderP->VersionCount - Versions > Versions / 2 ||
+       ChangedSize > TotalSize / 2)
+   {
+      if (Debug == true)
+	 std::clog << "Too much changed to update the cache" << std::endl;
+      return false;
+   }
+
+   if (_error->PendingError() == true)
+   {
+      _error->Discard();
+      return false;
+   }
    return true;
 }
 									/*}}}*/
@@ -1270,15 +1826,170 @@ static unsigned long ComputeSize(FileIterator Start,FileIterator End)
    return TotalSize;
 }
 									/*}}}*/
+// IndexPreloader - Read index files ahead of the merge			/*{{{*/
+// ---------------------------------------------------------------------
+/* Worker threads read and split the files in the order in which they are
+   merged, at most Window files ahead of the merge. The merge itself
+   stays in one thread and sees the same sections as if its parser had
+   read the file, so the resulting cache is the same. A file which can
+   not be loaded is left to the parser, which reports the error. Large
+   files are split by up to Jobs threads each, as a single big Packages
+   file is often most of the work. */
+class pkgIndexPreloader
+{
+   struct Slot
+   {
+      std::string File;
+      pkgTagFilePreload *Content;
+      bool Done;
+   };
+
+   pkgCacheGenerator &Gen;
+   std::vector<Slot> Slots;
+   std::vector<pthread_t> Threads;
+   pthread_mutex_t Lock;
+   pthread_cond_t Changed;
+   size_t Next;
+   size_t Merged;
+   size_t Window;
+   unsigned int Jobs;
+
+   static void *Run(void *Arg);
+
+   public:
+   pkgTagFilePreload *Take(std::string const &File);
+
+   pkgIndexPreloader(pkgCacheGenerator &Gen, std::vector<std::string> const &Files,
+		     unsigned int const Jobs);
+   ~pkgIndexPreloader();
+};
+pkgIndexPreloader::pkgIndexPreloader(pkgCacheGenerator &Gen,
+				     std::vector<std::string> const &Files,
+				     unsigned int const Jobs) :
+   Gen(Gen), Next(0), Merged(0), Window(2 * Jobs), Jobs(Jobs)
+{
+   for (std::vector<std::string>::const_iterator F = Files.begin(); F != Files.end(); ++F)
+   {
+      Slot S;
+      S.File = *F;
+      S.Content = NULL;
+      S.Done = false;
+      Slots.push_back(S);
+   }
+   pthread_mutex_init(&Lock, NULL);
+   pthread_cond_init(&Changed, NULL);
+
+   // filled on first use, which must not happen in the workers
+   APT::Configuration::getCompressors();
+
+   for (unsigned int J = 0; J < Jobs && J < Slots.size(); ++J)
+   {
+      pthread_t Thread;
+      if (pthread_create(&Thread, NULL, Run, this) != 0)
+	 break;
+      Threads.push_back(Thread);
+   }
+   Gen.Preloader = this;
+}
+pkgIndexPreloader::~pkgIndexPreloader()
+{
+   Gen.Preloader = NULL;
+   pthread_mutex_lock(&Lock);
+   Merged = Slots.size();
+   pthread_cond_broadcast(&Changed);
+   pthread_mutex_unlock(&Lock);
+   for (std::vector<pthread_t>::const_iterator T = Threads.begin(); T != Threads.end(); ++T)
+      pthread_join(*T, NULL);
+   for (std::vector<Slot>::const_iterator S = Slots.begin(); S != Slots.end(); ++S)
+      delete S->Content;
+   pthread_cond_destroy(&Changed);
+   pthread_mutex_destroy(&Lock);
+}
+void *pkgIndexPreloader::Run(void *Arg)
+{
+   pkgIndexPreloader * const P = (pkgIndexPreloader *) Arg;
+   pthread_mutex_lock(&P->Lock);
+   while (true)
+   {
+      while (P->Next < P->Slots.size() && P->Next >= P->Merged + P->Window)
+	 pthread_cond_wait(&P->Changed, &P->Lock);
+      if (P->Next >= P->Slots.size())
+	 break;
+      size_t const I = P->Next++;
+      // skipped by the merge in the meantime
+      if (I < P->Merged)
+	 continue;
+      std::string const File = P->Slots[I].File;
+      pthread_mutex_unlock(&P->Lock);
+
+      pkgTagFilePreload *Content = new pkgTagFilePreload;
+      if (Content->Load(File, P->Jobs) == false)
+      {
+	 delete Content;
+	 Content = NULL;
+      }
+      _error->Discard();
+
+      pthread_mutex_lock(&P->Lock);
+      P->Slots[I].Content = Content;
+      P->Slots[I].Done = true;
+      pthread_cond_broadcast(&P->Changed);
+   }
+   pthread_mutex_unlock(&P->Lock);
+   return NULL;
+}
+pkgTagFilePreload *pkgIndexPreloader::Take(std::string const &File)
+{
+   if (Threads.empty() == true)
+      return NULL;
+   pthread_mutex_lock(&Lock);
+   size_t I = Merged;
+   for (; I < Slots.size() && Slots[I].File != File; ++I);
+   pkgTagFilePreload *Content = NULL;
+   if (I < Slots.size())
+   {
+      // files merged without a preload (or not at all) are skipped
+      Merged = I;
+      pthread_cond_broadcast(&Changed);
+      while (Slots[I].Done == false)
+	 pthread_cond_wait(&Changed, &Lock);
+      Content = Slots[I].Content;
+      Slots[I].Content = NULL;
+      Merged = I + 1;
+      pthread_cond_broadcast(&Changed);
+   }
+   pthread_mutex_unlock(&Lock);
+   return Content;
+}
+									/*}}}*/
+// CacheGenerator::TakePreload - Get a file read by the preloader	/*{{{*/
+pkgTagFilePreload *pkgCacheGenerator::TakePreload(std::string const &File)
+{
+   if (Preloader == NULL)
+      return NULL;
+   return Preloader->Take(File);
+}
+									/*}}}*/
 // BuildCache - Merge the list of index files into the cache		/*{{{*/
 // ---------------------------------------------------------------------
-/* */
+/* With APT::Cache-Jobs (default: the number of processors) above one the
+   index files are read by a pkgIndexPreloader while they are merged. */
 static bool BuildCache(pkgCacheGenerator &Gen,
 		       OpProgress *Progress,
 		       unsigned long &CurrentSize,unsigned long TotalSize,
 		       FileIterator Start, FileIterator End)
 {
    FileIterator I;
+   std::vector<std::string> Files;
+   for (I = Start; I != End; ++I)
+      if ((*I)->HasPackages() == true && (*I)->Exists() == true &&
+	  (*I)->IndexFileName().empty() == false)
+	 Files.push_back((*I)->IndexFileName());
+   int const Jobs = _config->FindI("APT::Cache-Jobs", sysconf(_SC_NPROCESSORS_ONLN));
+   SPtr<pkgIndexPreloader> Preloader;
+   if (Jobs > 1 && Files.empty() == false)
+      Preloader = new pkgIndexPreloader(Gen, Files, Jobs);
+
    for (I = Start; I != End; ++I)
    {
       if ((*I)->HasPackages() == false)
@@ -1323,20 +2034,170 @@ static bool BuildCache(pkgCacheGenerator &Gen,
    return true;
 }
 									/*}}}*/
+// FindSize - Read a byte count which might not fit into an int		/*{{{*/
+static unsigned long FindSize(const char *Name, unsigned long const Default)
+{
+   std::string const Value = _config->Find(Name);
+   if (Value.empty() == true)
+      return Default;
+   return strtoul(Value.c_str(), NULL, 0);
+}
+									/*}}}*/
 // CacheGenerator::CreateDynamicMMap - load an mmap with configuration options	/*{{{*/
 DynamicMMap* pkgCacheGenerator::CreateDynamicMMap(FileFd *CacheF, unsigned long Flags) {
-   unsigned long const MapStart = _config->FindI("APT::Cache-Start", 24*1024*1024);
-   unsigned long const MapGrow = _config->FindI("APT::Cache-Grow", 1*1024*1024);
-   unsigned long const MapLimit = _config->FindI("APT::Cache-Limit", 0);
+   unsigned long const MapStart = FindSize("APT::Cache-Start", 24*1024*1024);
+   unsigned long const MapGrow = FindSize("APT::Cache-Grow", 1*1024*1024);
+   unsigned long MapLimit = FindSize("APT::Cache-Limit", 0);
    Flags |= MMap::Moveable;
    if (_config->FindB("APT::Cache-Fallback", false) == true)
       Flags |= MMap::Fallback;
+   // with enough address space reserve it for the largest cache we can
+   // build, so that the map doesn't move around while it grows
+   if (_config->FindB("APT::Cache-Reserve", sizeof(unsigned long) >= 8) == true)
+   {
+      if (MapLimit == 0)
+      {
+#ifdef APT_PKG_WIDE_CACHE
+	 unsigned long long const MaxSize = 64ULL*1024*1024*1024;
+#else
+	 unsigned long long const MaxSize = 4ULL*1024*1024*1024;
+#endif
+	 MapLimit = std::min<unsigned long long>(MaxSize, std::numeric_limits<unsigned long>::max());
+      }
+      Flags |= MMap::Reserve;
+   }
    if (CacheF != NULL)
       return new DynamicMMap(*CacheF, Flags, MapStart, MapGrow, MapLimit);
    else
       return new DynamicMMap(Flags, MapStart, MapGrow, MapLimit);
 }
 									/*}}}*/
+// SharedCacheKey - Identify a source cache by what it is built from	/*{{{*/
+// ---------------------------------------------------------------------
+/* The key covers the cache format, the architectures and the name and
+   content of every index file of the sources. The content is identified
+   by the hash the Release file lists for it as long as the local file
+   has the size listed there, every other file is hashed here. An empty
+   key is returned if a file can't be read. */
+static void HashAdd(SHA256Summation &Sum, std::string const &S)
+{
+   // including the terminator keeps "ab","c" and "a","bc" apart
+   Sum.Add((const unsigned char *) S.c_str(), S.length() + 1);
+}
+static std::string SharedCacheKey(pkgSourceList &List, FileIterator Start, FileIterator End)
+{
+   SHA256Summation Sum;
+   pkgCache::Header const Format;
+   std::ostringstream Config;
+   Config << Format.MajorVersion << '.' << Format.MinorVersion << ' '
+	  << sizeof(map_ptrloc) << ' ' << _config->FindB("APT::Cache-Lean", false) << ' '
+	  << _system->VS->Label << ' '
+	  << _config->Find("APT::Architecture");
+   std::vector<std::string> const Archs = APT::Configuration::getArchitectures();
+   for (std::vector<std::string>::const_iterator A = Archs.begin(); A != Archs.end(); ++A)
+      Config << ' ' << *A;
+   HashAdd(Sum, Config.str());
+
+   // the hashes and sizes of the files the Release files know about
+   std::map<std::string, std::pair<std::string, unsigned long long> > Listed;
+   for (pkgSourceList::const_iterator I = List.begin(); I != List.end(); ++I)
+   {
+      if (strcmp((*I)->GetType(), "deb") != 0)
+	 continue;
+      debReleaseIndex const * const Deb = (debReleaseIndex *) (*I);
+      std::string Release = Deb->MetaIndexFile("InRelease");
+      if (FileExists(Release) == false)
+	 Release = Deb->MetaIndexFile("Release");
+      if (FileExists(Release) == false)
+	 continue;
+
+      indexRecords Records;
+      _error->PushToStack();
+      bool const Loaded = Records.Load(Release);
+      _error->RevertToStack();
+      if (Loaded == false)
+	 continue;
+      std::vector<std::string> const Keys = Records.MetaKeys();
+      for (std::vector<std::string>::const_iterator K = Keys.begin(); K != Keys.end(); ++K)
+      {
+	 indexRecords::checkSum const * const Record = Records.Lookup(*K);
+	 Listed[Deb->MetaIndexFile(K->c_str())] = std::make_pair(Record->Hash.toStr(), Record->Size);
+      }
+   }
+
+   for (; Start != End; ++Start)
+   {
+      if ((*Start)->HasPackages() == false || (*Start)->Exists() == false)
+	 continue;
+      std::string const File = (*Start)->IndexFileName();
+      HashAdd(Sum, File);
+
+      struct stat St;
+      if (stat(File.c_str(), &St) != 0)
+	 return std::string();
+      std::map<std::string, std::pair<std::string, unsigned long long> >::const_iterator const L = Listed.find(File);
+      if (L != Listed.end() && L->second.second == (unsigned long long) St.st_size)
+      {
+	 HashAdd(Sum, L->second.first);
+	 continue;
+      }
+
+      SHA256Summation Content;
+      FileFd Fd(File, FileFd::ReadOnly);
+      if (Fd.Failed() == true || Content.AddFD(Fd) == false)
+	 return std::string();
+      HashAdd(Sum, "SHA256:" + Content.Result().Value());
+   }
+   return Sum.Result().Value();
+}
+									/*}}}*/
+// CheckSharedCache - Check that a cache in the shared store can be used	/*{{{*/
+// ---------------------------------------------------------------------
+/* The key already says what the cache was built from, so this only makes
+   sure that the file was completely written in a format we understand. */
+static bool CheckSharedCache(std::string const &CacheFile)
+{
+   if (FileExists(CacheFile) == false)
+      return false;
+
+   _error->PushToStack();
+   FileFd CacheF(CacheFile, FileFd::ReadOnly);
+   SPtr<MMap> Map = new MMap(CacheF, 0);
+   pkgCache Cache(Map);
+   bool const Okay = _error->PendingError() == false && Map->Size() != 0 &&
+		     Cache.HeaderP->Dirty == false;
+   _error->RevertToStack();
+   return Okay;
+}
+									/*}}}*/
+// WriteSourceCache - Store the source cache currently in the map	/*{{{*/
+// ---------------------------------------------------------------------
+/* The header is written last and marked clean only in the file, so that
+   an interrupted write never leaves a usable looking cache behind. */
+static bool WriteSourceCache(pkgCacheGenerator &Gen, DynamicMMap &Map, std::string const &File)
+{
+   FileFd SCacheF(File,FileFd::WriteAtomic);
+   if (_error->PendingError() == true)
+      return false;
+
+   fchmod(SCacheF.Fd(),0644);
+
+   // Write out the main data
+   if (SCacheF.Write(Map.Data(),Map.Size()) == false)
+      return _error->Error(_("IO Error saving source cache"));
+   SCacheF.Sync();
+
+   // Write out the proper header
+   Gen.GetCache().HeaderP->Dirty = false;
+   bool const Okay = SCacheF.Seek(0) == true &&
+      SCacheF.Write(Map.Data(),sizeof(*Gen.GetCache().HeaderP)) == true;
+   Gen.GetCache().HeaderP->Dirty = true;
+   if (Okay == false)
+      return _error->Error(_("IO Error saving source cache"));
+   SCacheF.Sync();
+   return true;
+}
+									/*}}}*/
 // CacheGenerator::MakeStatusCache - Construct the status cache		/*{{{*/
 // ---------------------------------------------------------------------
 /* This makes sure that the status cache (the cache that has all 
@@ -1415,7 +2276,41 @@ bool pkgCacheGenerator::MakeStatusCache(pkgSourceList &List,OpProgress *Progress
 	 std::clog << "pkgcache.bin is NOT valid" << std::endl;
    
    /* At this point we know we need to reconstruct the package cache,
-      begin. */
+      begin. Unless the source cache can be used the old cache is updated
+      if it only misses some changed or new files; keep it open then as
+      it is replaced below. */
+   bool const SrcCacheValid = CheckValidity(SrcCacheFile, List, Files.begin(),
+					    Files.begin()+EndOfSource);
+   std::vector<pkgIndexFile *> Changed;
+   SPtr<FileFd> OldCacheF;
+   if (SrcCacheValid == false &&
+       _config->FindB("APT::Cache-Incremental", true) == true &&
+       PlanCacheUpdate(CacheFile, List, Files.begin(), Files.end(), Changed) == true)
+   {
+      if (Debug == true)
+	 std::clog << "pkgcache.bin can be updated" << std::endl;
+      OldCacheF = new FileFd(CacheFile,FileFd::ReadOnly);
+   }
+
+   /* Failing that the shared store might have a source cache built from
+      the same index files by someone else, e.g. another chroot with a
+      copy of our lists. */
+   string SharedCacheFile;
+   bool SharedCacheValid = false;
+   if (SrcCacheValid == false && OldCacheF == 0 &&
+       _config->Find("Dir::Cache::Shared").empty() == false)
+   {
+      string const Key = SharedCacheKey(List, Files.begin(), Files.begin()+EndOfSource);
+      if (Key.empty() == false)
+      {
+	 SharedCacheFile = _config->FindDir("Dir::Cache::Shared") + "srcpkgcache-" + Key + ".bin";
+	 SharedCacheValid = CheckSharedCache(SharedCacheFile);
+      }
+      if (Debug == true)
+	 std::clog << "Shared source cache " << SharedCacheFile << " is "
+		   << (SharedCacheValid ? "valid" : "NOT valid") << std::endl;
+   }
+
    SPtr<FileFd> CacheF;
    SPtr<DynamicMMap> Map;
    if (Writeable == true && CacheFile.empty() == false)
@@ -1454,11 +2349,39 @@ bool pkgCacheGenerator::MakeStatusCache(pkgSourceList &List,OpProgress *Progress
 	 std::clog << "Open memory Map (not filebased)" << std::endl;
    }
    
-   // Lets try the source cache.
+   // Update the old cache or try the source cache.
    unsigned long CurrentSize = 0;
    unsigned long TotalSize = 0;
-   if (CheckValidity(SrcCacheFile, List, Files.begin(),
-		     Files.begin()+EndOfSource) == true)
+   if (OldCacheF != 0)
+   {
+      // Preload the map with the old cache
+      unsigned long const alloc = Map->RawAllocate(OldCacheF->Size());
+      if ((alloc == 0 && _error->PendingError())
+		|| OldCacheF->Read((unsigned char *)Map->Data() + alloc,
+				   OldCacheF->Size()) == false)
+	 return false;
+
+      TotalSize = ComputeSize(Changed.begin(),Changed.end());
+
+      // Remove what the changed files brought in and merge them again
+      pkgCacheGenerator Gen(Map.Get(),Progress);
+      if (_error->PendingError() == true)
+	 return false;
+      std::vector<pkgCache::PkgFileIterator> Retract;
+      for (FileIterator I = Changed.begin(); I != Changed.end(); ++I)
+      {
+	 std::string const Name = (*I)->IndexFileName();
+	 for (pkgCache::PkgFileIterator F = Gen.GetCache().FileBegin(); F.end() == false; ++F)
+	    if (Name == F.FileName())
+	       Retract.push_back(F);
+      }
+      if (Gen.RetractFiles(Retract) == false)
+	 return false;
+      if (BuildCache(Gen,Progress,CurrentSize,TotalSize,
+		     Changed.begin(),Changed.end()) == false)
+	 return false;
+   }
+   else if (SrcCacheValid == true)
    {
       if (Debug == true)
 	 std::clog << "srcpkgcache.bin is valid - populate MMap with it." << std::endl;
@@ -1480,6 +2403,44 @@ bool pkgCacheGenerator::MakeStatusCache(pkgSourceList &List,OpProgress *Progress
 		     Files.begin()+EndOfSource,Files.end()) == false)
 	 return false;
    }
+   else if (SharedCacheValid == true)
+   {
+      if (Debug == true)
+	 std::clog << "Populate MMap with the shared source cache." << std::endl;
+      FileFd SCacheF(SharedCacheFile,FileFd::ReadOnly);
+      unsigned long const alloc = Map->RawAllocate(SCacheF.Size());
+      if ((alloc == 0 && _error->PendingError())
+		|| SCacheF.Read((unsigned char *)Map->Data() + alloc,
+				SCacheF.Size()) == false)
+	 return false;
+
+      TotalSize = ComputeSize(Files.begin()+EndOfSource,Files.end());
+
+      pkgCacheGenerator Gen(Map.Get(),Progress);
+      if (_error->PendingError() == true)
+	 return false;
+
+      /* The content of our files is the same, but they are likely not as
+	 old as the ones the cache was built from: take over our times so
+	 that the cache is found valid from now on. */
+      for (FileIterator I = Files.begin(); I != Files.begin()+EndOfSource; ++I)
+      {
+	 if ((*I)->HasPackages() == false || (*I)->Exists() == false)
+	    continue;
+	 std::string const Name = (*I)->IndexFileName();
+	 struct stat St;
+	 if (stat(Name.c_str(), &St) != 0)
+	    return _error->Errno("stat", _("Unable to stat %s"), Name.c_str());
+	 for (pkgCache::PkgFileIterator F = Gen.GetCache().FileBegin(); F.end() == false; ++F)
+	    if (Name == F.FileName())
+	       F->mtime = St.st_mtime;
+      }
+
+      // Build the status cache
+      if (BuildCache(Gen,Progress,CurrentSize,TotalSize,
+		     Files.begin()+EndOfSource,Files.end()) == false)
+	 return false;
+   }
    else
    {
       if (Debug == true)
@@ -1495,28 +2456,23 @@ bool pkgCacheGenerator::MakeStatusCache(pkgSourceList &List,OpProgress *Progress
 	 return false;
       
       // Write it back
-      if (Writeable == true && SrcCacheFile.empty() == false)
+      if (Writeable == true && SrcCacheFile.empty() == false &&
+	  WriteSourceCache(Gen, *Map, SrcCacheFile) == false)
+	 return false;
+
+      // and offer it to everyone else building from the same files
+      if (SharedCacheFile.empty() == false &&
+	  access(flNotFile(SharedCacheFile).c_str(), W_OK) == 0)
       {
-	 FileFd SCacheF(SrcCacheFile,FileFd::WriteAtomic);
-	 if (_error->PendingError() == true)
-	    return false;
-	 
-	 fchmod(SCacheF.Fd(),0644);
-	 
-	 // Write out the main data
-	 if (SCacheF.Write(Map->Data(),Map->Size()) == false)
-	    return _error->Error(_("IO Error saving source cache"));
-	 SCacheF.Sync();
-	 
-	 // Write out the proper header
-	 Gen.GetCache().HeaderP->Dirty = false;
-	 if (SCacheF.Seek(0) == false ||
-	     SCacheF.Write(Map->Data(),sizeof(*Gen.GetCache().HeaderP)) == false)
-	    return _error->Error(_("IO Error saving source cache"));
-	 Gen.GetCache().HeaderP->Dirty = true;
-	 SCacheF.Sync();
+	 if (Debug == true)
+	    std::clog << "Store the source cache as " << SharedCacheFile << std::endl;
+	 // the store is only a shortcut, failing to fill it isn't an error
+	 _error->PushToStack();
+	 if (WriteSourceCache(Gen, *Map, SharedCacheFile) == false && Debug == true)
+	    _error->DumpErrors();
+	 _error->RevertToStack();
       }
-      
+
       // Build the status cache
       if (BuildCache(Gen,Progress,CurrentSize,TotalSize,
 		     Files.begin()+EndOfSource,Files.end()) == false)
@@ -1578,6 +2534,32 @@ bool pkgCacheGenerator::MakeOnlyStatusCache(OpProgress *Progress,DynamicMMap **O
    return true;
 }
 									/*}}}*/
+// CacheGenerator::IsStatusCacheValid - Check a loaded cache		/*{{{*/
+// ---------------------------------------------------------------------
+/* Long running users keep a cache mapped and need to know if the index
+   files (including the status files) changed below them since it was
+   generated. This is the same check MakeStatusCache does before it
+   decides to reuse pkgcache.bin, just against the cache in memory. */
+bool pkgCacheGenerator::IsStatusCacheValid(pkgSourceList &List, pkgCache &Cache)
+{
+   std::vector<pkgIndexFile *> Files;
+   for (std::vector<metaIndex *>::const_iterator i = List.begin();
+        i != List.end();
+        ++i)
+   {
+      std::vector <pkgIndexFile *> *Indexes = (*i)->GetIndexFiles();
+      for (std::vector<pkgIndexFile *>::const_iterator j = Indexes->begin();
+	   j != Indexes->end();
+	   ++j)
+         Files.push_back (*j);
+   }
+
+   if (_system->AddStatusFiles(Files) == false)
+      return false;
+
+   return CheckValidity(Cache, Files.begin(), Files.end());
+}
+									/*}}}*/
 // IsDuplicateDescription						/*{{{*/
 static bool IsDuplicateDescription(pkgCache::DescIterator Desc,
 			    MD5SumValue const &CurMd5, std::string const &CurLang)
@@ -32,16 +32,39 @@ class FileFd;
 class pkgSourceList;
 class OpProgress;
 class pkgIndexFile;
+class pkgTagFilePreload;
+class pkgIndexPreloader;
 
 class pkgCacheGenerator							/*{{{*/
 {
    private:
 
-   pkgCache::StringItem *UniqHash[26];
+   /* Interning table of the unique strings: open addressing over the
+      StringItems with their hashes, plus the items in list order to find
+      the place of a new one. Only offsets are kept, so both stay valid if
+      the map moves. */
+   struct UniqBucket
+   {
+      unsigned int Hash;
+      map_ptrloc Item;
+   };
+   std::vector<UniqBucket> UniqTable;
+   std::vector<map_ptrloc> UniqList;
+   APT_HIDDEN void InitUniqTable();
+   APT_HIDDEN void AddUniqString(unsigned int const Hash, map_ptrloc const Item);
    APT_HIDDEN map_ptrloc WriteStringInMap(std::string const &String) { return WriteStringInMap(String.c_str()); };
    APT_HIDDEN map_ptrloc WriteStringInMap(const char *String);
    APT_HIDDEN map_ptrloc WriteStringInMap(const char *String, const unsigned long &Len);
+   APT_HIDDEN map_ptrloc WriteVersionInMap(std::string const &Version);
+   APT_HIDDEN void RankVersions();
+   APT_HIDDEN bool IndexSatisfiers();
    APT_HIDDEN map_ptrloc AllocateInMap(const unsigned long &size);
+   APT_HIDDEN bool GrowHashTables(map_ptrloc const Size);
+
+   friend class pkgIndexPreloader;
+   pkgIndexPreloader *Preloader;
+   // PackageFile structures of retracted files, reused by SelectFile
+   std::vector<map_ptrloc> RetractedFiles;
 
    public:
    
@@ -98,6 +121,18 @@ class pkgCacheGenerator							/*{{{*/
    bool SelectFile(const std::string &File,const std::string &Site,pkgIndexFile const &Index,
 		   unsigned long Flags = 0);
    bool MergeList(ListParser &List,pkgCache::VerIterator *Ver = 0);
+   /** \brief Remove everything the given files contributed to the cache
+
+       Versions only found in these files are unlinked together with their
+       dependencies and provides, other versions just lose the record of
+       the files. Packages and strings stay in the cache. If a file is
+       merged again afterwards it gets its old PackageFile structure back,
+       so the IDs of the files don't change. */
+   bool RetractFiles(std::vector<pkgCache::PkgFileIterator> const &Files);
+   /** \brief File read ahead of time by another thread, or NULL
+
+       The caller owns the returned object. */
+   pkgTagFilePreload *TakePreload(std::string const &File);
    inline pkgCache &GetCache() {return Cache;};
    inline pkgCache::PkgFileIterator GetCurFile() 
          {return pkgCache::PkgFileIterator(Cache,CurrentFile);};
@@ -110,6 +145,7 @@ class pkgCacheGenerator							/*{{{*/
 			MMap **OutMap = 0,bool AllowMem = false);
    static bool MakeOnlyStatusCache(OpProgress *Progress,DynamicMMap **OutMap);
    static DynamicMMap* CreateDynamicMMap(FileFd *CacheF, unsigned long Flags = 0);
+   static bool IsStatusCacheValid(pkgSourceList &List, pkgCache &Cache);
 
    void ReMap(void const * const oldMap, void const * const newMap);
 
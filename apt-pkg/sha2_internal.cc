@@ -607,13 +607,10 @@ void SHA256_Final(sha2_byte digest[], SHA256_CTX* context) {
 			/* Begin padding with a 1 bit: */
 			*context->buffer = 0x80;
 		}
-		/* Set the bit count: */
-		union {
-			sha2_byte* c;
-			sha2_word64* l;
-		} bitcount;
-		bitcount.c = &context->buffer[SHA256_SHORT_BLOCK_LENGTH];
-		*(bitcount.l) = context->bitcount;
+		/* Set the bit count (copied, the transform reads the
+		   buffer as words and may not see a store of another type): */
+		MEMCPY_BCOPY(&context->buffer[SHA256_SHORT_BLOCK_LENGTH],
+			     &context->bitcount, sizeof(sha2_word64));
 
 		/* Final transform: */
 		SHA256_Transform(context, (sha2_word32*)context->buffer);
@@ -932,13 +929,10 @@ static void SHA512_Last(SHA512_CTX* context) {
 		*context->buffer = 0x80;
 	}
 	/* Store the length of input data (in bits): */
-	union {
-		sha2_byte* c;
-		sha2_word64* l;
-	} bitcount;
-	bitcount.c = &context->buffer[SHA512_SHORT_BLOCK_LENGTH];
-	bitcount.l[0] = context->bitcount[1];
-	bitcount.l[1] = context->bitcount[0];
+	MEMCPY_BCOPY(&context->buffer[SHA512_SHORT_BLOCK_LENGTH],
+		     &context->bitcount[1], sizeof(sha2_word64));
+	MEMCPY_BCOPY(&context->buffer[SHA512_SHORT_BLOCK_LENGTH + sizeof(sha2_word64)],
+		     &context->bitcount[0], sizeof(sha2_word64));
 
 	/* Final transform: */
 	SHA512_Transform(context, (sha2_word64*)context->buffer);
@@ -5,8 +5,9 @@
 
    Fast scanner for RFC-822 type header information
    
-   This uses a rotating buffer to load the package information into.
-   The scanner runs over it and isolates and indexes a single section.
+   This uses a rotating buffer to load the package information into,
+   uncompressed files are mapped instead. The scanner runs over it and
+   isolates and indexes a single section.
    
    ##################################################################### */
 									/*}}}*/
@@ -17,25 +18,72 @@
 #include <apt-pkg/error.h>
 #include <apt-pkg/strutl.h>
 #include <apt-pkg/fileutl.h>
+#include <apt-pkg/mmap.h>
 
+#include <algorithm>
 #include <string>
 #include <stdio.h>
 #include <ctype.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <stdint.h>
+#include <assert.h>
+#include <pthread.h>
+#if defined(__GNUC__) && defined(__SSE2__) && (defined(__x86_64__) || defined(__i386__))
+#define APT_TAGSCAN_SSE2
+#include <emmintrin.h>
+// AVX2 intrinsics in a target function and __builtin_cpu_supports
+#if !defined(__clang__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define APT_TAGSCAN_AVX2
+#include <immintrin.h>
+#endif
+#endif
 
 #include <apti18n.h>
 									/*}}}*/
 
 using std::string;
 
+/* A tag file mapped into memory, so that the sections can be scanned
+   right where they are. Scan needs a blank line after each section
+   though: if the file doesn't end with one, everything after its last
+   blank line is copied and the newlines are added like pkgTagFile::Fill
+   does it. Size counts these newlines, too. */
+class pkgTagFileMap
+{
+   MMap *Map;
+   char *Tail;
+   unsigned long long MapSize;
+
+   public:
+   unsigned long long Size;
+
+   bool Open(FileFd &Fd);
+   /** \brief the text at Offset, End is set to the end of the part it is in */
+   inline const char *At(unsigned long long const Offset, const char *&End) const
+   {
+      if (Offset < MapSize)
+      {
+	 End = (const char *)Map->Data() + MapSize;
+	 return (const char *)Map->Data() + Offset;
+      }
+      End = Tail + (Size - MapSize);
+      return Tail + (Offset - MapSize);
+   }
+
+   pkgTagFileMap() : Map(NULL), Tail(NULL), MapSize(0), Size(0) {}
+   ~pkgTagFileMap() { delete Map; free(Tail); }
+};
+
 class pkgTagFilePrivate
 {
 public:
    pkgTagFilePrivate(FileFd *pFd, unsigned long long Size) : Fd(*pFd), Buffer(NULL),
 							     Start(NULL), End(NULL),
 							     Done(false), iOffset(0),
-							     Size(Size)
+							     Size(Size), Preload(NULL),
+							     Record(0), Map(NULL)
    {
    }
    FileFd &Fd;
@@ -45,19 +93,105 @@ public:
    bool Done;
    unsigned long long iOffset;
    unsigned long long Size;
+   pkgTagFilePreload *Preload;
+   unsigned long Record;
+   pkgTagFileMap *Map;
 };
 
+// TagFileMap::Open - Map the file of Fd if possible			/*{{{*/
+// ---------------------------------------------------------------------
+/* Only regular uncompressed files which weren't read from yet can be
+   mapped, false is returned for everything else to read it instead. */
+bool pkgTagFileMap::Open(FileFd &Fd)
+{
+   struct stat St;
+   if (Fd.IsOpen() == false || Fd.IsCompressed() == true ||
+       fstat(Fd.Fd(), &St) != 0 || S_ISREG(St.st_mode) == 0 ||
+       St.st_size == 0 || Fd.Tell() != 0)
+      return false;
+
+   _error->PushToStack();
+   Map = new MMap(Fd, MMap::ReadOnly);
+   bool const Failed = _error->PendingError() == true || Map->validData() == false;
+   _error->RevertToStack();
+   if (Failed == true)
+      return false;
+
+   const char * const Data = (const char *)Map->Data();
+   unsigned long long const FileSize = Map->Size();
+   unsigned int LineCount = 0;
+   for (const char *E = Data + FileSize - 1; E >= Data && (*E == '\n' || *E == '\r'); --E)
+      if (*E == '\n')
+	 ++LineCount;
+   MapSize = Size = FileSize;
+   if (LineCount >= 2)
+      return true;
+
+   // find the blank line before the last section
+   MapSize = 0;
+   for (const char *P = Data + FileSize - 1; P > Data; --P)
+   {
+      if (*P != '\n')
+	 continue;
+      const char *Q = P - 1;
+      for (; Q > Data && *Q == '\r'; --Q);
+      if (*Q != '\n')
+	 continue;
+      for (++P; P < Data + FileSize && (*P == '\n' || *P == '\r'); ++P);
+      MapSize = P - Data;
+      break;
+   }
+
+   Tail = (char *)malloc(FileSize - MapSize + 2);
+   if (Tail == NULL)
+      return false;
+   memcpy(Tail, Data + MapSize, FileSize - MapSize);
+   for (; LineCount < 2; ++LineCount)
+      Tail[Size++ - MapSize] = '\n';
+   return true;
+}
+									/*}}}*/
+
 // TagFile::pkgTagFile - Constructor					/*{{{*/
 // ---------------------------------------------------------------------
 /* */
 pkgTagFile::pkgTagFile(FileFd *pFd,unsigned long long Size)
 {
+   d = new pkgTagFilePrivate(pFd, Size);
+   Init(Size);
+}
+pkgTagFile::pkgTagFile(FileFd *pFd,pkgTagFilePreload *Preload)
+{
+   d = new pkgTagFilePrivate(pFd, 32*1024);
+   if (Preload == NULL)
+      Init(32*1024);
+   else
+   {
+      d->Preload = Preload;
+      d->Done = true;
+   }
+}
+									/*}}}*/
+// TagFile::Init - Set up the buffer for reading from the file		/*{{{*/
+void pkgTagFile::Init(unsigned long long Size)
+{
+   // there is nothing to buffer if the file can be mapped
+   d->Map = new pkgTagFileMap;
+   if (d->Map->Open(d->Fd) == true)
+   {
+      d->Done = true;
+      d->iOffset = 0;
+      return;
+   }
+   delete d->Map;
+   d->Map = NULL;
+
    /* The size is increased by 4 because if we start with the Size of the
       filename we need to try to read 1 char more to see an EOF faster, 1
       char the end-pointer can be on and maybe 2 newlines need to be added
       to the end of the file -> 4 extra chars */
    Size += 4;
-   d = new pkgTagFilePrivate(pFd, Size);
+   d->Size = Size;
 
    if (d->Fd.IsOpen() == false)
       d->Start = d->End = d->Buffer = 0;
@@ -81,6 +215,7 @@ pkgTagFile::pkgTagFile(FileFd *pFd,unsigned long long Size)
 pkgTagFile::~pkgTagFile()
 {
    free(d->Buffer);
+   delete d->Map;
    delete d;
 }
 									/*}}}*/
@@ -128,6 +263,33 @@ bool pkgTagFile::Resize(unsigned long long const newSize)
  */
 bool pkgTagFile::Step(pkgTagSection &Tag)
 {
+   if (d->Preload != NULL)
+   {
+      if (d->Record == d->Preload->Records.size() ||
+	  Restore(Tag, d->Record) == false)
+	 return false;
+      ++d->Record;
+      Tag.Trim();
+      return true;
+   }
+
+   if (d->Map != NULL)
+   {
+      const char *End;
+      const char * const Start = d->Map->At(d->iOffset, End);
+      if (d->iOffset >= d->Map->Size || Tag.Scan(Start, End - Start) == false)
+      {
+	 // like Fill we ignore a few bytes left over at the end
+	 if (d->Map->Size - d->iOffset <= 3)
+	    return false;
+	 return _error->Error(_("Unable to parse package file %s (1)"),
+			      d->Fd.Name().c_str());
+      }
+      d->iOffset += Tag.size();
+      Tag.Trim();
+      return true;
+   }
+
    while (Tag.Scan(d->Start,d->End - d->Start) == false)
    {
       if (Fill() == false)
@@ -201,8 +363,35 @@ bool pkgTagFile::Fill()
 // ---------------------------------------------------------------------
 /* This jumps to a pre-recorded file location and reads the record
    that is there */
+static bool RecordBefore(pkgTagFilePreload::Record const &R, unsigned long long const Offset)
+{
+   return R.Start < Offset;
+}
 bool pkgTagFile::Jump(pkgTagSection &Tag,unsigned long long Offset)
 {
+   if (d->Preload != NULL)
+   {
+      std::vector<pkgTagFilePreload::Record> const &Records = d->Preload->Records;
+      std::vector<pkgTagFilePreload::Record>::const_iterator const R =
+	 std::lower_bound(Records.begin(), Records.end(), Offset, RecordBefore);
+      if (R == Records.end() || R->Start != Offset)
+	 return false;
+      d->Record = R - Records.begin();
+      return Restore(Tag, d->Record);
+   }
+
+   if (d->Map != NULL)
+   {
+      if (Offset >= d->Map->Size)
+	 return false;
+      const char *End;
+      const char * const Start = d->Map->At(Offset, End);
+      d->iOffset = Offset;
+      if (Tag.Scan(Start, End - Start) == false)
+	 return _error->Error(_("Unable to parse package file %s (2)"),d->Fd.Name().c_str());
+      return true;
+   }
+
    // We are within a buffer space of the next hit..
    if (Offset >= d->iOffset && d->iOffset + (d->End - d->Start) > Offset)
    {
@@ -239,6 +428,259 @@ bool pkgTagFile::Jump(pkgTagSection &Tag,unsigned long long Offset)
    return true;
 }
 									/*}}}*/
+// TagFile::Restore - Set up a section recorded by the preload		/*{{{*/
+bool pkgTagFile::Restore(pkgTagSection &Tag, unsigned long const Record)
+{
+   pkgTagFilePreload const &P = *d->Preload;
+   pkgTagFilePreload::Record const &R = P.Records[Record];
+   const char *End;
+   Tag.Restore(P.Text(R.Start, End), R.Length, &P.Fields[R.Fields], &P.Tokens[R.Fields], R.Count);
+   d->iOffset = R.Start + R.Length;
+   return true;
+}
+									/*}}}*/
+// TagFilePreload::pkgTagFilePreload - Constructor			/*{{{*/
+pkgTagFilePreload::pkgTagFilePreload() : Buffer(NULL), Size(0), Map(NULL)
+{
+}
+									/*}}}*/
+// TagFilePreload::~pkgTagFilePreload - Destructor			/*{{{*/
+pkgTagFilePreload::~pkgTagFilePreload()
+{
+   free(Buffer);
+   delete Map;
+}
+									/*}}}*/
+// TagFilePreload::Read - Read a complete file into the buffer		/*{{{*/
+// ---------------------------------------------------------------------
+/* The end of the file is handled like pkgTagFile::Fill does it: two
+   newlines are appended if they are missing. */
+bool pkgTagFilePreload::Read(FileFd &Fd)
+{
+   unsigned long long Allocated = Fd.FileSize() + 4;
+   if (Fd.IsCompressed() == true)
+      Allocated *= 4;
+   Buffer = (char *)malloc(Allocated);
+   Size = 0;
+   while (Buffer != NULL)
+   {
+      unsigned long long Actual = 0;
+      if (Fd.Read(Buffer + Size, Allocated - Size - 2, &Actual) == false)
+	 return false;
+      Size += Actual;
+      if (Actual == 0)
+	 break;
+      if (Allocated - Size - 2 == 0)
+      {
+	 Allocated *= 2;
+	 char * const newBuffer = (char *)realloc(Buffer, Allocated);
+	 if (newBuffer == NULL)
+	    free(Buffer);
+	 Buffer = newBuffer;
+      }
+   }
+   if (Buffer == NULL)
+      return _error->Errno("realloc", "Unable to read %s", Fd.Name().c_str());
+
+   if (Size != 0)
+   {
+      unsigned int LineCount = 0;
+      for (const char *E = Buffer + Size - 1; E >= Buffer && (*E == '\n' || *E == '\r'); --E)
+	 if (*E == '\n')
+	    ++LineCount;
+      for (; LineCount < 2; ++LineCount)
+	 Buffer[Size++] = '\n';
+   }
+   return true;
+}
+									/*}}}*/
+// TagFilePreload::Text - The data at Pos				/*{{{*/
+// ---------------------------------------------------------------------
+/* End is set to the end of the part of the data Pos is in. */
+const char *pkgTagFilePreload::Text(unsigned long long const Pos,const char *&End) const
+{
+   if (Map != NULL)
+      return Map->At(Pos, End);
+   End = Buffer + Size;
+   return Buffer + Pos;
+}
+									/*}}}*/
+// TagFilePreload::Split - Split a chunk of the data into sections	/*{{{*/
+// ---------------------------------------------------------------------
+/* Like pkgTagFile::Step does it up to three bytes at the end of the file
+   which can't be scanned are ignored. The sections are scanned with the
+   same end of the data as if the file was split in one go, the chunk
+   only says where to stop. */
+struct pkgTagFilePreload::Chunk
+{
+   pkgTagFilePreload const *Preload;
+   unsigned long long Begin;
+   unsigned long long Finish;
+   std::vector<Record> Records;
+   std::vector<unsigned int> Fields;
+   std::vector<unsigned short> Tokens;
+   bool Failed;
+};
+void pkgTagFilePreload::Split(Chunk &C) const
+{
+   pkgTagSection Section;
+   unsigned long long Pos = C.Begin;
+   while (Pos < C.Finish)
+   {
+      const char *End;
+      const char * const Start = Text(Pos, End);
+      if (Section.Scan(Start, End - Start) == false)
+      {
+	 C.Failed = Size - Pos > 3;
+	 return;
+      }
+
+      Record R;
+      R.Start = Pos;
+      R.Length = Section.size();
+      R.Fields = C.Fields.size();
+      R.Count = Section.Count();
+      const char *Tag, *Stop = Start;
+      for (unsigned int I = 0; I != R.Count; ++I)
+      {
+	 Section.Get(Tag, Stop, I);
+	 C.Fields.push_back(Tag - Start);
+      }
+      C.Fields.push_back(Stop - Start);
+      C.Tokens.resize(C.Fields.size());
+      Section.Tokens(&C.Tokens[R.Fields], End);
+      C.Records.push_back(R);
+      Pos += R.Length;
+   }
+}
+void *pkgTagFilePreload::RunChunk(void *Arg)
+{
+   Chunk * const C = (Chunk *) Arg;
+   C->Preload->Split(*C);
+   return NULL;
+}
+									/*}}}*/
+// NextSection - Find the start of the first section after Text	/*{{{*/
+// ---------------------------------------------------------------------
+/* A section ends with the first blank line in it and Scan takes all the
+   blank lines after it, so the first character after a run of newlines
+   with a blank line in it is where Scan starts with a section, wherever
+   in the file it began. NULL is returned if there is no blank line. */
+static const char *NextSection(const char *Text, const char * const End)
+{
+   for (; (Text = (const char *)memchr(Text, '\n', End - Text)) != NULL; ++Text)
+   {
+      const char *P = Text + 1;
+      for (; P != End && *P == '\r'; ++P);
+      if (P == End || *P != '\n')
+	 continue;
+      for (; P != End && (*P == '\n' || *P == '\r'); ++P);
+      return P;
+   }
+   return NULL;
+}
+									/*}}}*/
+// TagFilePreload::Load - Map or read and split a complete file		/*{{{*/
+// ---------------------------------------------------------------------
+/* Files of at least two MinChunk are cut into up to Jobs chunks, each of
+   which is split in a thread of its own. If the sections of a chunk
+   don't end where the next chunk begins the file is split again in one
+   go, so that the result is the same in any case. */
+bool pkgTagFilePreload::Load(std::string const &File,unsigned int const Jobs)
+{
+   FileFd Fd(File, FileFd::ReadOnly, FileFd::Extension);
+   if (Fd.IsOpen() == false || Fd.Failed() == true)
+      return false;
+
+   Map = new pkgTagFileMap;
+   if (Map->Open(Fd) == true)
+      Size = Map->Size;
+   else
+   {
+      delete Map;
+      Map = NULL;
+      if (Read(Fd) == false)
+	 return false;
+   }
+
+   unsigned long long const MinChunk = 256*1024;
+   unsigned long long ChunkCount = Size / MinChunk;
+   if (ChunkCount > Jobs)
+      ChunkCount = Jobs;
+   std::vector<Chunk> Chunks;
+   Chunk C;
+   C.Preload = this;
+   C.Begin = 0;
+   C.Failed = false;
+   for (unsigned long long I = 1; I < ChunkCount; ++I)
+   {
+      unsigned long long const Target = Size / ChunkCount * I;
+      if (Target <= C.Begin)
+	 continue;
+      const char *End;
+      const char * const Start = Text(Target, End);
+      const char * const Next = NextSection(Start, End);
+      if (Next == NULL)
+	 continue;
+      C.Finish = Target + (Next - Start);
+      if (C.Finish >= Size)
+	 break;
+      Chunks.push_back(C);
+      C.Begin = C.Finish;
+   }
+   C.Finish = Size;
+   Chunks.push_back(C);
+
+   std::vector<pthread_t> Threads(Chunks.size());
+   std::vector<bool> Started(Chunks.size(), false);
+   for (size_t I = 1; I < Chunks.size(); ++I)
+      Started[I] = pthread_create(&Threads[I], NULL, RunChunk, &Chunks[I]) == 0;
+   for (size_t I = 0; I < Chunks.size(); ++I)
+   {
+      if (Started[I] == true)
+	 pthread_join(Threads[I], NULL);
+      else
+	 Split(Chunks[I]);
+   }
+
+   bool Failed = false;
+   bool Aligned = true;
+   for (std::vector<Chunk>::const_iterator I = Chunks.begin(); I != Chunks.end(); ++I)
+   {
+      Failed |= I->Failed;
+      if (I + 1 == Chunks.end() || I->Failed == true)
+	 continue;
+      if (I->Records.empty() == true ? I->Begin != I->Finish :
+	  I->Records.back().Start + I->Records.back().Length != I->Finish)
+	 Aligned = false;
+   }
+   if (Chunks.size() > 1 && (Failed == true || Aligned == false))
+   {
+      C.Begin = 0;
+      Chunks.assign(1, C);
+      Split(Chunks[0]);
+      Failed = Chunks[0].Failed;
+   }
+   if (Failed == true)
+      return _error->Error(_("Unable to parse package file %s (1)"), File.c_str());
+
+   Records.swap(Chunks[0].Records);
+   Fields.swap(Chunks[0].Fields);
+   Tokens.swap(Chunks[0].Tokens);
+   for (std::vector<Chunk>::const_iterator I = Chunks.begin() + 1; I != Chunks.end(); ++I)
+   {
+      unsigned long const Offset = Fields.size();
+      for (std::vector<Record>::const_iterator R = I->Records.begin(); R != I->Records.end(); ++R)
+      {
+	 Records.push_back(*R);
+	 Records.back().Fields += Offset;
+      }
+      Fields.insert(Fields.end(), I->Fields.begin(), I->Fields.end());
+      Tokens.insert(Tokens.end(), I->Tokens.begin(), I->Tokens.end());
+   }
+   return true;
+}
+									/*}}}*/
 // pkgTagSection::pkgTagSection - Constructor				/*{{{*/
 // ---------------------------------------------------------------------
 /* */
@@ -247,6 +689,287 @@ pkgTagSection::pkgTagSection()
 {
    memset(&Indexes, 0, sizeof(Indexes));
    memset(&AlphaIndexes, 0, sizeof(AlphaIndexes));
+   memset(&FieldIndexes, 0, sizeof(FieldIndexes));
+}
+									/*}}}*/
+// TagScanner - Find the line ends and colons Scan looks for		/*{{{*/
+// ---------------------------------------------------------------------
+/* Scan runs over every line of every section, looking for the end of the
+   tag name on it and for the end of the line. Instead of a search per
+   line this compares 64 bytes at a time and keeps the bitmasks of the
+   newlines and of the colons (and NULs, which end AlphaHash as well) in
+   them, so the short lines of a section are mostly answered from the
+   masks of a block loaded for an earlier line. The masks are built with
+   SSE2, or AVX2 if the CPU has it and the compiler is gcc 4.9 or newer;
+   the plain loop is used elsewhere and for the last bytes before End,
+   which are not read past. */
+namespace {
+struct TagMasks
+{
+   uint64_t Newlines;
+   uint64_t Colons;
+};
+typedef TagMasks BlockMasksFn(const char *Block);
+
+static TagMasks PlainMasks(const char *Block, unsigned int Length)
+{
+   TagMasks M = {0, 0};
+   for (unsigned int I = 0; I != Length; ++I)
+   {
+      if (Block[I] == '\n')
+	 M.Newlines |= (uint64_t)1 << I;
+      else if (Block[I] == ':' || Block[I] == 0)
+	 M.Colons |= (uint64_t)1 << I;
+   }
+   return M;
+}
+#ifndef APT_TAGSCAN_SSE2
+static TagMasks BlockMasksPlain(const char *Block)
+{
+   return PlainMasks(Block, 64);
+}
+#else
+static TagMasks BlockMasksSSE2(const char *Block)
+{
+   __m128i const NL = _mm_set1_epi8('\n');
+   __m128i const Colon = _mm_set1_epi8(':');
+   __m128i const Zero = _mm_setzero_si128();
+   TagMasks M = {0, 0};
+   for (unsigned int I = 0; I != 64; I += 16)
+   {
+      __m128i const B = _mm_loadu_si128((__m128i const *)(Block + I));
+      M.Newlines |= (uint64_t)(unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(B, NL)) << I;
+      M.Colons |= (uint64_t)(unsigned int)_mm_movemask_epi8(_mm_or_si128(
+	       _mm_cmpeq_epi8(B, Colon), _mm_cmpeq_epi8(B, Zero))) << I;
+   }
+   return M;
+}
+#endif
+#ifdef APT_TAGSCAN_AVX2
+__attribute__((target("avx2")))
+static TagMasks BlockMasksAVX2(const char *Block)
+{
+   __m256i const NL = _mm256_set1_epi8('\n');
+   __m256i const Colon = _mm256_set1_epi8(':');
+   __m256i const Zero = _mm256_setzero_si256();
+   __m256i const Lo = _mm256_loadu_si256((__m256i const *)Block);
+   __m256i const Hi = _mm256_loadu_si256((__m256i const *)(Block + 32));
+   TagMasks M;
+   M.Newlines = (uint64_t)(unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(Lo, NL)) |
+      ((uint64_t)(unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(Hi, NL)) << 32);
+   M.Colons = (uint64_t)(unsigned int)_mm256_movemask_epi8(_mm256_or_si256(
+	    _mm256_cmpeq_epi8(Lo, Colon), _mm256_cmpeq_epi8(Lo, Zero))) |
+      ((uint64_t)(unsigned int)_mm256_movemask_epi8(_mm256_or_si256(
+	    _mm256_cmpeq_epi8(Hi, Colon), _mm256_cmpeq_epi8(Hi, Zero))) << 32);
+   // the compiler doesn't always do it for us, and the SSE code called
+   // afterwards would pay for the dirty upper halves of the registers
+   _mm256_zeroupper();
+   return M;
+}
+#endif
+// AlphaHash of the tag from Start to Tag, of which only the last 8 count
+static inline unsigned long PlainAlphaHash(const char *Start, const char *Tag)
+{
+   unsigned long Res = 0;
+   for (const char *C = Tag - Start > 8 ? Tag - 8 : Start; C != Tag; ++C)
+      Res = ((unsigned long)(*C) & 0xDF) ^ (Res << 1);
+   return Res & 0xFF;
+}
+/* The same from the 8 bytes before Tag at once: each character is shifted
+   left by its distance from the end, so they are folded in pairs, then
+   pairs of pairs and so on. Those bytes must be readable even if the tag
+   is shorter. */
+static inline unsigned long WordAlphaHash(const char *Start, const char *Tag)
+{
+#ifdef APT_TAGSCAN_SSE2
+   uint64_t W;
+   memcpy(&W, Tag - 8, sizeof(W));
+   unsigned int const Before = Tag - Start < 8 ? 8 - (Tag - Start) : 0;
+   W &= 0xDFDFDFDFDFDFDFDFULL << (8 * Before);
+   W = ((W & 0x00FF00FF00FF00FFULL) << 1) ^ ((W >> 8) & 0x00FF00FF00FF00FFULL);
+   W = ((W & 0x0000FFFF0000FFFFULL) << 2) ^ ((W >> 16) & 0x0000FFFF0000FFFFULL);
+   W = ((W & 0x00000000FFFFFFFFULL) << 4) ^ (W >> 32);
+   return W & 0xFF;
+#else
+   return PlainAlphaHash(Start, Tag);
+#endif
+}
+static BlockMasksFn *PickBlockMasks()
+{
+#if defined(APT_TAGSCAN_AVX2)
+   __builtin_cpu_init();
+   if (__builtin_cpu_supports("avx2"))
+      return BlockMasksAVX2;
+   return BlockMasksSSE2;
+#elif defined(APT_TAGSCAN_SSE2)
+   return BlockMasksSSE2;
+#else
+   return BlockMasksPlain;
+#endif
+}
+static BlockMasksFn * const BlockMasks = PickBlockMasks();
+
+class TagScanner
+{
+   const char * const &End;
+   const char *Block;
+   TagMasks Masks;
+
+   // Makes the masks cover P, loading the block starting at P if needed
+   inline void Load(const char *P)
+   {
+      if (P >= Block && P - Block < 64)
+	 return;
+      Block = P;
+      if (End - P >= 64)
+	 Masks = BlockMasks(P);
+      else
+	 Masks = PlainMasks(P, End - P);
+   }
+
+   public:
+   /* The first newline at or after P, like memchr(P, '\n', End - P). The
+      masks are only used if the tag name brought in the block already,
+      memchr is better at the long continuation lines. */
+   inline const char *Newline(const char *P)
+   {
+      if (P >= Block && P - Block < 64)
+      {
+	 uint64_t const M = Masks.Newlines >> (P - Block);
+	 if (M != 0)
+	    return P + __builtin_ctzll(M);
+	 P = Block + 64;
+      }
+      if (P >= End)
+	 return 0;
+      return (const char *)memchr(P, '\n', End - P);
+   }
+   // Where AlphaHash(P, End) stops
+   inline const char *TagEnd(const char *P)
+   {
+      for (; P < End; P = Block + 64)
+      {
+	 Load(P);
+	 uint64_t const M = Masks.Colons >> (P - Block);
+	 if (M != 0)
+	    return P + __builtin_ctzll(M);
+      }
+      return End;
+   }
+
+   TagScanner(const char * const &End) : End(End), Block(0)
+   {
+      Masks.Newlines = Masks.Colons = 0;
+   }
+};
+}
+									/*}}}*/
+// TagSection::Field - The well-known fields				/*{{{*/
+// ---------------------------------------------------------------------
+/* The names are in the order of pkgTagSection::Field::Key. A tag is looked
+   up by its AlphaHash plus its length times a multiplier, and the table
+   uses the first multiplier which gives each of the names a slot of its
+   own, so Scan has at most one name to compare for a tag, ignoring the
+   case of the letters like the strncasecmp in Find. */
+namespace {
+static const char * const FieldNames[] = {"Package", "Source", "Version",
+   "Architecture", "Multi-Arch", "Essential", "Important", "Status",
+   "Priority", "Section", "Installed-Size", "Size", "Filename", "MD5sum",
+   "SHA1", "SHA256", "SHA512", "Description", "Description-md5", "Depends",
+   "Pre-Depends", "Suggests", "Recommends", "Conflicts", "Breaks",
+   "Replaces", "Enhances", "Optional", "Provides", "Maintainer", "Homepage",
+   "Binary", "Build-Depends", "Build-Depends-Indep", "Build-Conflicts",
+   "Build-Conflicts-Indep", "Files", "Directory"};
+
+class FieldTable
+{
+   unsigned long Multiplier;
+   unsigned long Lengths[pkgTagSection::Field::Count];
+   // the lowercase names, 0x20 where they have a letter and 0xFF where
+   // they have a character at all, for comparing 8 bytes at a time
+   uint64_t Lower[pkgTagSection::Field::Count][3];
+   uint64_t Fold[pkgTagSection::Field::Count][3];
+   uint64_t Valid[pkgTagSection::Field::Count][3];
+   unsigned char Slots[0x100];
+
+   inline unsigned int Slot(unsigned long Hash, unsigned long Length) const
+   {
+      return (Hash + Length * Multiplier) & 0xFF;
+   }
+   inline bool Same(unsigned int const K, const char *Tag, const char *End) const
+   {
+      if (End - Tag >= 24)
+      {
+	 uint64_t W[3];
+	 memcpy(W, Tag, sizeof(W));
+	 return ((((W[0] | Fold[K][0]) ^ Lower[K][0]) & Valid[K][0]) |
+		 (((W[1] | Fold[K][1]) ^ Lower[K][1]) & Valid[K][1]) |
+		 (((W[2] | Fold[K][2]) ^ Lower[K][2]) & Valid[K][2])) == 0;
+      }
+      return strncasecmp(Tag, FieldNames[K], Lengths[K]) == 0;
+   }
+
+   public:
+   /* The field the tag from Tag to Colon with this AlphaHash is, or Count.
+      End is the end of the readable data after the tag. */
+   inline unsigned int Lookup(const char *Tag, const char *Colon,
+			      const char *End, unsigned long Hash) const
+   {
+      unsigned long const Length = Colon - Tag;
+      unsigned int const K = Slots[Slot(Hash, Length)];
+      if (K == 0 || Lengths[K - 1] != Length || Same(K - 1, Tag, End) == false)
+	 return pkgTagSection::Field::Count;
+      return K - 1;
+   }
+   inline unsigned long Length(unsigned int const K) const {return Lengths[K];};
+
+   FieldTable()
+   {
+      unsigned int const Count = pkgTagSection::Field::Count;
+      assert(sizeof(FieldNames)/sizeof(FieldNames[0]) == Count);
+      for (unsigned int I = 0; I != Count; ++I)
+      {
+	 Lengths[I] = strlen(FieldNames[I]);
+	 assert(Lengths[I] <= sizeof(Lower[I]));
+	 char L[sizeof(Lower[I])], F[sizeof(Fold[I])], V[sizeof(Valid[I])];
+	 memset(L, 0, sizeof(L));
+	 memset(F, 0, sizeof(F));
+	 memset(V, 0, sizeof(V));
+	 for (unsigned long J = 0; J != Lengths[I]; ++J)
+	 {
+	    L[J] = tolower_ascii(FieldNames[I][J]);
+	    F[J] = (L[J] >= 'a' && L[J] <= 'z') ? 0x20 : 0;
+	    V[J] = 0xFF;
+	 }
+	 memcpy(Lower[I], L, sizeof(L));
+	 memcpy(Fold[I], F, sizeof(F));
+	 memcpy(Valid[I], V, sizeof(V));
+      }
+      for (Multiplier = 1; Multiplier != 0x100; ++Multiplier)
+      {
+	 memset(Slots, 0, sizeof(Slots));
+	 unsigned int I = 0;
+	 for (; I != Count; ++I)
+	 {
+	    unsigned int const S = Slot(PlainAlphaHash(FieldNames[I],
+				      FieldNames[I] + Lengths[I]), Lengths[I]);
+	    if (Slots[S] != 0)
+	       break;
+	    Slots[S] = I + 1;
+	 }
+	 if (I == Count)
+	    return;
+      }
+      // a new name collides with the others for every multiplier
+      assert(Multiplier != 0x100);
+   }
+};
+static const FieldTable KnownFields;
+}
+
+const char *pkgTagSection::Field::Name(Key const K)
+{
+   return FieldNames[K];
 }
 									/*}}}*/
 // TagSection::Scan - Scan for the end of the header information	/*{{{*/
@@ -258,10 +981,12 @@ bool pkgTagSection::Scan(const char *Start,unsigned long MaxLength)
    const char *End = Start + MaxLength;
    Stop = Section = Start;
    memset(AlphaIndexes,0,sizeof(AlphaIndexes));
+   memset(FieldIndexes,0,sizeof(FieldIndexes));
 
    if (Stop == 0)
       return false;
 
+   TagScanner Scanner(End);
    TagCount = 0;
    while (TagCount+1 < sizeof(Indexes)/sizeof(Indexes[0]) && Stop < End)
    {
@@ -276,11 +1001,16 @@ bool pkgTagSection::Scan(const char *Start,unsigned long MaxLength)
       if (isspace(Stop[0]) == 0)
       {
 	 Indexes[TagCount++] = Stop - Section;
-	 AlphaIndexes[AlphaHash(Stop,End)] = TagCount;
+	 const char * const Tag = Scanner.TagEnd(Stop);
+	 unsigned long const Hash = (Tag != Stop && Tag - Section >= 8) ?
+	    WordAlphaHash(Stop,Tag) : AlphaHash(Stop,Tag);
+	 AlphaIndexes[Hash] = TagCount;
+	 if (Tag != End && *Tag == ':')
+	    IndexField(Stop,Tag,End,Hash,TagCount);
       }
 
-      Stop = (const char *)memchr(Stop,'\n',End - Stop);
-      
+      Stop = Scanner.Newline(Stop);
+
       if (Stop == 0)
 	 return false;
 
@@ -302,6 +1032,62 @@ bool pkgTagSection::Scan(const char *Start,unsigned long MaxLength)
    return false;
 }
 									/*}}}*/
+// TagSection::Tokens - Record the hash and field key of each tag	/*{{{*/
+// ---------------------------------------------------------------------
+/* The low byte of a token is the AlphaHash of the tag, the high byte the
+   Field::Key it is indexed as, Field::Count for none. */
+void pkgTagSection::Tokens(unsigned short *Tokens,const char *End) const
+{
+   for (unsigned int I = 0; I != TagCount; ++I)
+   {
+      const char * const Tag = Section + Indexes[I];
+      const char *Colon = Tag;
+      for (; Colon != End && *Colon != ':' && *Colon != 0; ++Colon);
+      Tokens[I] = AlphaHash(Tag,Colon) | (Field::Count << 8);
+   }
+   for (unsigned int K = 0; K != Field::Count; ++K)
+      if (FieldIndexes[K] != 0)
+	 Tokens[FieldIndexes[K] - 1] = (Tokens[FieldIndexes[K] - 1] & 0xFF) | (K << 8);
+}
+									/*}}}*/
+// TagSection::Restore - Set up the section from recorded positions	/*{{{*/
+// ---------------------------------------------------------------------
+/* Fields are the Count + 1 positions Scan indexed in the section starting
+   at Start and Tokens what Tokens made of its tags, so nothing has to be
+   looked at in the text itself. */
+void pkgTagSection::Restore(const char *Start,unsigned long Length,
+			    unsigned int const *Fields,
+			    unsigned short const *Tokens,unsigned int Count)
+{
+   Section = Start;
+   Stop = Start + Length;
+   TagCount = Count;
+   memset(AlphaIndexes,0,sizeof(AlphaIndexes));
+   memset(FieldIndexes,0,sizeof(FieldIndexes));
+   for (unsigned int I = 0; I != Count; ++I)
+   {
+      Indexes[I] = Fields[I];
+      AlphaIndexes[Tokens[I] & 0xFF] = I + 1;
+      unsigned int const K = Tokens[I] >> 8;
+      if (K != Field::Count)
+	 FieldIndexes[K] = I + 1;
+   }
+   Indexes[Count] = Fields[Count];
+}
+									/*}}}*/
+// TagSection::IndexField - Note where a well-known field is		/*{{{*/
+// ---------------------------------------------------------------------
+/* Index is the 1-based index of the tag from Tag to Colon, which has the
+   given AlphaHash, End the end of the data the section is in. */
+void pkgTagSection::IndexField(const char *Tag,const char *Colon,
+			       const char *End,unsigned long Hash,
+			       unsigned int Index)
+{
+   unsigned int const K = KnownFields.Lookup(Tag,Colon,End,Hash);
+   if (K != Field::Count)
+      FieldIndexes[K] = Index;
+}
+									/*}}}*/
 // TagSection::TrimRecord - Trim off any garbage before/after a record	/*{{{*/
 // ---------------------------------------------------------------------
 /* There should be exactly 2 newline at the end of the record, no more. */
@@ -385,20 +1171,40 @@ bool pkgTagSection::Find(const char *Tag,const char *&Start,
       if (*C != ':')
 	 continue;
 
-      // Strip off the gunk from the start end
-      Start = C;
-      End = Section + Indexes[I+1];
-      if (Start >= End)
-	 return _error->Error("Internal parsing error");
-      
-      for (; (isspace(*Start) != 0 || *Start == ':') && Start < End; Start++);
-      for (; isspace(End[-1]) != 0 && End > Start; End--);
-      
-      return true;
+      return Value(I,C,Start,End);
    }
    
    Start = End = 0;
    return false;
+}
+bool pkgTagSection::Find(Field::Key const Key,const char *&Start,
+			 const char *&End) const
+{
+   unsigned int const I = FieldIndexes[Key];
+   if (I == 0)
+   {
+      Start = End = 0;
+      return false;
+   }
+   return Value(I - 1,Section + Indexes[I - 1] + KnownFields.Length(Key),Start,End);
+}
+									/*}}}*/
+// TagSection::Value - Get the value of the tag I			/*{{{*/
+// ---------------------------------------------------------------------
+/* Colon is the one after the tag name. */
+bool pkgTagSection::Value(unsigned int I,const char *Colon,
+			  const char *&Start,const char *&End) const
+{
+   // Strip off the gunk from the start end
+   Start = Colon;
+   End = Section + Indexes[I+1];
+   if (Start >= End)
+      return _error->Error("Internal parsing error");
+
+   for (; (isspace(*Start) != 0 || *Start == ':') && Start < End; Start++);
+   for (; isspace(End[-1]) != 0 && End > Start; End--);
+
+   return true;
 }
 									/*}}}*/
 // TagSection::FindS - Find a string					/*{{{*/
@@ -411,18 +1217,22 @@ string pkgTagSection::FindS(const char *Tag) const
    if (Find(Tag,Start,End) == false)
       return string();
    return string(Start,End);      
+}
+string pkgTagSection::FindS(Field::Key const Key) const
+{
+   const char *Start;
+   const char *End;
+   if (Find(Key,Start,End) == false)
+      return string();
+   return string(Start,End);
 }
 									/*}}}*/
 // TagSection::FindI - Find an integer					/*{{{*/
 // ---------------------------------------------------------------------
 /* */
-signed int pkgTagSection::FindI(const char *Tag,signed long Default) const
+static signed int ValueToInt(const char *Start,const char *Stop,
+			     signed long Default)
 {
-   const char *Start;
-   const char *Stop;
-   if (Find(Tag,Start,Stop) == false)
-      return Default;
-
    // Copy it into a temp buffer so we can use strtol
    char S[300];
    if ((unsigned)(Stop - Start) >= sizeof(S))
@@ -436,17 +1246,29 @@ signed int pkgTagSection::FindI(const char *Tag,signed long Default) const
       return Default;
    return Result;
 }
-									/*}}}*/
-// TagSection::FindULL - Find an unsigned long long integer		/*{{{*/
-// ---------------------------------------------------------------------
-/* */
-unsigned long long pkgTagSection::FindULL(const char *Tag, unsigned long long const &Default) const
+signed int pkgTagSection::FindI(const char *Tag,signed long Default) const
 {
    const char *Start;
    const char *Stop;
    if (Find(Tag,Start,Stop) == false)
       return Default;
-
+   return ValueToInt(Start,Stop,Default);
+}
+signed int pkgTagSection::FindI(Field::Key const Key,signed long Default) const
+{
+   const char *Start;
+   const char *Stop;
+   if (Find(Key,Start,Stop) == false)
+      return Default;
+   return ValueToInt(Start,Stop,Default);
+}
+									/*}}}*/
+// TagSection::FindULL - Find an unsigned long long integer		/*{{{*/
+// ---------------------------------------------------------------------
+/* */
+static unsigned long long ValueToULL(const char *Start,const char *Stop,
+				     unsigned long long const &Default)
+{
    // Copy it into a temp buffer so we can use strtoull
    char S[100];
    if ((unsigned)(Stop - Start) >= sizeof(S))
@@ -459,6 +1281,22 @@ unsigned long long pkgTagSection::FindULL(const char *Tag, unsigned long long co
    if (S == End)
       return Default;
    return Result;
+}
+unsigned long long pkgTagSection::FindULL(const char *Tag, unsigned long long const &Default) const
+{
+   const char *Start;
+   const char *Stop;
+   if (Find(Tag,Start,Stop) == false)
+      return Default;
+   return ValueToULL(Start,Stop,Default);
+}
+unsigned long long pkgTagSection::FindULL(Field::Key const Key, unsigned long long const &Default) const
+{
+   const char *Start;
+   const char *Stop;
+   if (Find(Key,Start,Stop) == false)
+      return Default;
+   return ValueToULL(Start,Stop,Default);
 }
 									/*}}}*/
 // TagSection::FindFlag - Locate a yes/no type flag			/*{{{*/
@@ -473,6 +1311,15 @@ bool pkgTagSection::FindFlag(const char *Tag,unsigned long &Flags,
       return true;
    return FindFlag(Flags, Flag, Start, Stop);
 }
+bool pkgTagSection::FindFlag(Field::Key const Key,unsigned long &Flags,
+			     unsigned long Flag) const
+{
+   const char *Start;
+   const char *Stop;
+   if (Find(Key,Start,Stop) == false)
+      return true;
+   return FindFlag(Flags, Flag, Start, Stop);
+}
 bool pkgTagSection::FindFlag(unsigned long &Flags, unsigned long Flag,
 					char const* Start, char const* Stop)
 {
@@ -25,6 +25,7 @@
 #include <stdio.h>
 
 #include <string>
+#include <vector>
 
 #ifndef APT_8_CLEANER_HEADERS
 #include <apt-pkg/fileutl.h>
@@ -34,10 +35,31 @@ class FileFd;
 
 class pkgTagSection
 {
+   public:
+   /** \brief the well-known control fields
+
+       Scan notes where each of these is in the section, so finding them
+       by key is a single array access instead of the hash, probe and
+       compare Find does for a tag name. */
+   struct Field
+   {
+      enum Key {Package, Source, Version, Architecture, MultiArch, Essential,
+	 Important, Status, Priority, Section, InstalledSize, Size, Filename,
+	 MD5Sum, SHA1, SHA256, SHA512, Description, DescriptionMD5, Depends,
+	 PreDepends, Suggests, Recommends, Conflicts, Breaks, Replaces,
+	 Enhances, Optional, Provides, Maintainer, Homepage, Binary,
+	 BuildDepends, BuildDependsIndep, BuildConflicts, BuildConflictsIndep,
+	 Files, Directory, Count};
+      /** \brief the name of the field as it is written in the files */
+      static const char *Name(Key const K);
+   };
+
+   private:
    const char *Section;
    // We have a limit of 256 tags per section.
    unsigned int Indexes[256];
    unsigned int AlphaIndexes[0x100];
+   unsigned int FieldIndexes[Field::Count];
    unsigned int TagCount;
    // dpointer placeholder (for later in case we need it)
    void *d;
@@ -51,6 +73,10 @@ class pkgTagSection
 	 Res = ((unsigned long)(*Text) & 0xDF) ^ (Res << 1);
       return Res & 0xFF;
    }
+   APT_HIDDEN void IndexField(const char *Tag,const char *Colon,const char *End,
+			      unsigned long Hash,unsigned int Index);
+   APT_HIDDEN bool Value(unsigned int I,const char *Colon,
+			 const char *&Start,const char *&End) const;
 
    protected:
    const char *Stop;
@@ -69,7 +95,21 @@ class pkgTagSection
 		 unsigned long Flag) const;
    bool static FindFlag(unsigned long &Flags, unsigned long Flag,
 				const char* Start, const char* Stop);
+
+   bool Find(Field::Key const Key,const char *&Start, const char *&End) const;
+   std::string FindS(Field::Key const Key) const;
+   signed int FindI(Field::Key const Key,signed long Default = 0) const;
+   unsigned long long FindULL(Field::Key const Key, unsigned long long const &Default = 0) const;
+   bool FindFlag(Field::Key const Key,unsigned long &Flags,
+		 unsigned long Flag) const;
+
    bool Scan(const char *Start,unsigned long MaxLength);
+   /** \brief the AlphaHash and Field::Key of each tag as Restore takes them
+
+       End is the end of the data the section was scanned in. */
+   void Tokens(unsigned short *Tokens,const char *End) const;
+   void Restore(const char *Start,unsigned long Length,unsigned int const *Fields,
+		unsigned short const *Tokens,unsigned int Count);
    inline unsigned long size() const {return Stop - Section;};
    void Trim();
    virtual void TrimRecord(bool BeforeRecord, const char* &End);
@@ -90,14 +130,67 @@ class pkgTagSection
    virtual ~pkgTagSection() {};
 };
 
+/** \brief a tag file read and split into sections ahead of time
+
+    Load reads the complete file into memory and records where every
+    section and each of its fields start, exactly as pkgTagFile::Step
+    would find them. A pkgTagFile created with it steps through the
+    recorded sections without scanning the text again. Uncompressed files
+    are mapped instead of read. Load only uses the error stack, which is
+    per thread, so it can run in a thread of its own.
+
+    With more than one job a large file is cut at blank lines into chunks
+    which are split in threads of their own; the sections of the chunks
+    are put together in the order of the file, so they are the same as
+    if the file had been split in one go. */
+class pkgTagFileMap;
+class pkgTagFilePreload
+{
+   friend class pkgTagFile;
+
+   public:
+   struct Record
+   {
+      unsigned long long Start;
+      unsigned long Length;
+      unsigned long Fields;
+      unsigned int Count;
+   };
+
+   private:
+   struct Chunk;
+
+   char *Buffer;
+   unsigned long long Size;
+   pkgTagFileMap *Map;
+   std::vector<Record> Records;
+   std::vector<unsigned int> Fields;
+   // the Tokens of the sections, indexed like their Fields
+   std::vector<unsigned short> Tokens;
+
+   APT_HIDDEN bool Read(FileFd &Fd);
+   APT_HIDDEN const char *Text(unsigned long long const Pos,const char *&End) const;
+   APT_HIDDEN void Split(Chunk &C) const;
+   APT_HIDDEN static void *RunChunk(void *Arg);
+
+   public:
+
+   bool Load(std::string const &File,unsigned int const Jobs = 1);
+
+   pkgTagFilePreload();
+   ~pkgTagFilePreload();
+};
+
 class pkgTagFilePrivate;
 class pkgTagFile
 {
    pkgTagFilePrivate *d;
 
+   APT_HIDDEN void Init(unsigned long long Size);
    APT_HIDDEN bool Fill();
    APT_HIDDEN bool Resize();
    APT_HIDDEN bool Resize(unsigned long long const newSize);
+   APT_HIDDEN bool Restore(pkgTagSection &Tag, unsigned long const Record);
 
    public:
 
@@ -106,6 +199,8 @@ class pkgTagFile
    bool Jump(pkgTagSection &Tag,unsigned long long Offset);
 
    pkgTagFile(FileFd *F,unsigned long long Size = 32*1024);
+   /** \brief step through the sections of Preload (if not NULL) instead of F */
+   pkgTagFile(FileFd *F,pkgTagFilePreload *Preload);
    virtual ~pkgTagFile();
 };
 
@@ -40,3 +40,28 @@ pkgVersioningSystem *pkgVersioningSystem::GetVS(const char *Label)
    return 0;
 }
 									/*}}}*/
+// pkgVS::MakeVersionKey - Parse a version for the cache		/*{{{*/
+// ---------------------------------------------------------------------
+/* Versioning systems which don't know better store an unusable key, so
+   that their versions are always compared as strings. */
+void pkgVersioningSystem::MakeVersionKey(const char *,const char *,
+					 pkgCache::VersionKey &Key)
+{
+   memset(&Key, 0, sizeof(Key));
+   Key.Epoch = pkgCache::VersionKey::NoEpoch;
+}
+									/*}}}*/
+// pkgVS::CmpVersionKey - Compare versions with their keys		/*{{{*/
+int pkgVersioningSystem::CmpVersionKey(pkgCache::VersionKey const &,const char *A,
+				       pkgCache::VersionKey const &,const char *B)
+{
+   return CmpVersion(A, B);
+}
+									/*}}}*/
+// pkgVS::CheckDepKey - Check a dependency with the keys of the versions	/*{{{*/
+bool pkgVersioningSystem::CheckDepKey(pkgCache::VersionKey const &,const char *PkgVer,
+				      int Op,pkgCache::VersionKey const &,const char *DepVer)
+{
+   return CheckDep(PkgVer, Op, DepVer);
+}
+									/*}}}*/
@@ -21,6 +21,7 @@
 #define PKGLIB_VERSION_H
 
 #include <apt-pkg/strutl.h>
+#include <apt-pkg/pkgcache.h>
 #include <string>
 
 #ifndef APT_8_CLEANER_HEADERS
@@ -45,6 +46,14 @@ class pkgVersioningSystem
    virtual int DoCmpReleaseVer(const char *A,const char *Aend,
 			       const char *B,const char *Bend) = 0;
    virtual std::string UpstreamVersion(const char *A) = 0;
+
+   // Versions in the cache come with a key, see pkgCache::VersionKey
+   virtual void MakeVersionKey(const char *A,const char *Aend,
+			       pkgCache::VersionKey &Key);
+   virtual int CmpVersionKey(pkgCache::VersionKey const &AKey,const char *A,
+			     pkgCache::VersionKey const &BKey,const char *B);
+   virtual bool CheckDepKey(pkgCache::VersionKey const &PkgKey,const char *PkgVer,int Op,
+			    pkgCache::VersionKey const &DepKey,const char *DepVer);
    
    // See if the given VS is compatible with this one.. 
    virtual bool TestCompatibility(pkgVersioningSystem const &Against) 
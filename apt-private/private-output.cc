@@ -347,6 +347,9 @@ bool ShowList(ostream &out,string Title,string List,string VersionsList)
  */
 static void ShowBrokenPackage(ostream &out, pkgCacheFile * const Cache, pkgCache::PkgIterator const &Pkg, bool const Now)
 {
+   if ((*Cache)->IsStateComputed(Pkg) == false)
+      return;
+
    if (Now == true)
    {
       if ((*Cache)[Pkg].NowBroken() == false)
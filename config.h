@@ -24,7 +24,7 @@
 /* #undef HAVE_MOUNT_H */
 
 /* Define if we have enabled pthread support */
-/* #undef HAVE_PTHREAD */
+#define HAVE_PTHREAD 1
 
 /* If there is no socklen_t, define this for the netdb shim */
 /* #undef NEED_SOCKLEN_T_DEFINE */
@@ -13,7 +13,11 @@
 #include <apt-pkg/indexfile.h>
 #include <apt-pkg/indexrecords.h>
 #include <apt-pkg/init.h>
+#include <apt-pkg/md5.h>
+#include <apt-pkg/metaindex.h>
+#include <apt-pkg/pkgcachegen.h>
 #include <apt-pkg/pkgrecords.h>
+#include <apt-pkg/policy.h>
 #include <apt-pkg/pkgsystem.h>
 #include <apt-pkg/progress.h>
 #include <apt-pkg/sourcelist.h>
@@ -33,21 +37,26 @@
 #include <apt-private/private-output.h>
 
 #include <errno.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/statfs.h>
 #include <sys/statvfs.h>
+#include <sys/un.h>
 #include <sys/wait.h>
 #include <unistd.h>
 #include <algorithm>
 #include <fstream>
 #include <iostream>
+#include <map>
 #include <set>
+#include <sstream>
 #include <string>
 #include <vector>
 
@@ -103,6 +112,18 @@ static bool TryToInstallBuildDep(pkgCache::PkgIterator Pkg,
 }
 
 
+// InstallBuildDep - Install a package satisfying a build-dependency
+// ---------------------------------------------------------------------
+/* */
+static void InstallBuildDep(pkgCache::PkgIterator const &Pkg,
+                            pkgCacheFile &Cache, pkgProblemResolver &Fix)
+{
+   TryToInstallBuildDep(Pkg,Cache,Fix,false,false,false);
+   if (_config->FindB("APT::Get::Build-Dep-Automatic", false) == true)
+      Cache->MarkAuto(Pkg, true);
+}
+
+
 const char *BuildDepType(unsigned char const &Type)
 {
    const char *fields[] = {
@@ -117,10 +138,10 @@ const char *BuildDepType(unsigned char const &Type)
 }
 
 
-bool ParseFileDeb822(string File,
-                     std::vector<pkgSrcRecords::Parser::BuildDepRec> &BuildDeps,
-                     bool const &ArchOnly,
-                     bool const &StripMultiArch)
+bool ParseDeb822(FileFd &Fd,
+                 std::vector<pkgSrcRecords::Parser::BuildDepRec> &BuildDeps,
+                 bool const &ArchOnly,
+                 bool const &StripMultiArch)
 {
    pkgTagSection Tags;
    pkgSrcRecords::Parser::BuildDepRec rec;
@@ -133,435 +154,1685 @@ bool ParseFileDeb822(string File,
 
    BuildDeps.clear();
 
-   // see if we can read the file
-   _error->PushToStack();
+   pkgTagFile Sources(&Fd);
+   if (_error->PendingError() == true)
+      return false;
+
+   // read step by step
+   while (Sources.Step(Tags) == true)
+   {
+      for (unsigned int I = 0; I < 4; I++)
+      {
+         if (ArchOnly && (I == 1 || I == 3))
+            continue;
+
+         const char *Start, *Stop;
+         if (Tags.Find(fields[I], Start, Stop) == false)
+            continue;
+
+         while (1)
+         {
+            Start = debListParser::ParseDepends(Start, Stop, 
+               rec.Package,rec.Version,rec.Op,true,StripMultiArch,true);
+	 
+            if (Start == 0) 
+               return _error->Error("Problem parsing dependency: %s", fields[I]);
+
+            rec.Type = I;
+            if (rec.Package != "")
+            {
+               BuildDeps.push_back(rec);
+            }
+	 
+            if (Start == Stop) 
+               break;
+         }
+      }
+   }
+   return true;
+}
+
+
+// CheckHostArch - Validate the requested host architecture
+// ---------------------------------------------------------------------
+/* Multi-Arch qualifiers are only kept in the parsed dependencies if we are
+   cross-building, so the caller gets told which way to parse. */
+static bool CheckHostArch(string const &hostArch, bool &StripMultiArch)
+{
+   if (hostArch.empty() == false)
+   {
+      std::vector<std::string> archs = APT::Configuration::getArchitectures();
+      if (std::find(archs.begin(), archs.end(), hostArch) == archs.end())
+         return _error->Error(_("No architecture information available for %s. See apt.conf(5) APT::Architectures for setup"), hostArch.c_str());
+      StripMultiArch = false;
+   }
+   else
+      StripMultiArch = true;
+   return true;
+}
+
+
+// ParseBuildDeps - Read the build-dependencies from a control file
+// ---------------------------------------------------------------------
+/* */
+static bool ParseBuildDeps(FileFd &Fd, string const &hostArch,
+                           bool const StripMultiArch,
+                           vector<pkgSrcRecords::Parser::BuildDepRec> &BuildDeps)
+{
+   bool const ArchOnly = _config->FindB("APT::Get::Arch-Only", false);
+   if (hostArch.empty() == true)
+      return ParseDeb822(Fd, BuildDeps, ArchOnly, StripMultiArch);
+
+   // FIXME: Can't specify architecture to use for [wildcard] matching, so switch default arch temporary
+   std::string nativeArch = _config->Find("APT::Architecture");
+   _config->Set("APT::Architecture", hostArch);
+   bool const Success = ParseDeb822(Fd, BuildDeps, ArchOnly, StripMultiArch);
+   _config->Set("APT::Architecture", nativeArch);
+   return Success;
+}
+
+
+// InstallBuildDeps - Mark the build-dependencies of one source
+// ---------------------------------------------------------------------
+/* This marks everything needed to satisfy BuildDeps in the depcache of
+   Cache and runs the problem resolver over it. The broken packages are
+   shown on Err if that fails. */
+static bool InstallBuildDeps(CacheFile &Cache, string const &Src,
+                             vector<pkgSrcRecords::Parser::BuildDepRec> &BuildDeps,
+                             string const &hostArch, bool const StripMultiArch,
+                             ostream &Err)
+{
+   // Also ensure that build-essential packages are present
+   Configuration::Item const *Opts = _config->Tree("APT::Build-Essential");
+   if (Opts) 
+      Opts = Opts->Child;
+   for (; Opts; Opts = Opts->Next)
+   {
+      if (Opts->Value.empty() == true)
+         continue;
+
+      pkgSrcRecords::Parser::BuildDepRec rec;
+      rec.Package = Opts->Value;
+      rec.Type = pkgSrcRecords::Parser::BuildDependIndep;
+      rec.Op = 0;
+      BuildDeps.push_back(rec);
+   }
+   
+   if (BuildDeps.empty() == true)
+   {
+      ioprintf(Err,_("%s has no build depends.\n"),Src.c_str());
+      return true;
+   }
+
+   // Install the requested packages
+   vector <pkgSrcRecords::Parser::BuildDepRec>::iterator D;
+   pkgProblemResolver Fix(Cache);
+   bool skipAlternatives = false; // skip remaining alternatives in an or group
+   bool const tryAlternatives = _config->FindB("APT::Resolve-Dep::Try-Alternatives", true);
+   pkgCache::PkgIterator const NoPkg(Cache, 0);
+   pkgCache::PkgIterator FirstBroken = NoPkg; // first alternative breaking others
+   for (D = BuildDeps.begin(); D != BuildDeps.end(); ++D)
+   {
+      bool hasAlternatives = (((*D).Op & pkgCache::Dep::Or) == pkgCache::Dep::Or);
+
+      // the last or group ended without an alternative which didn't break
+      // other packages, so go with the first which could be installed
+      if (FirstBroken.end() == false && ((D - 1)->Op & pkgCache::Dep::Or) != pkgCache::Dep::Or)
+      {
+         InstallBuildDep(FirstBroken, Cache, Fix);
+         FirstBroken = NoPkg;
+      }
+
+      if (skipAlternatives == true)
+      {
+         /*
+          * if there are alternatives, we've already picked one, so skip
+          * the rest
+          *
+          * The alternatives of a group are tried in order: if installing
+          * one breaks other packages, the depcache is rolled back to a
+          * checkpoint and the next one is tried. If all of them break
+          * something, the first which could be installed is used.
+          */
+         if (!hasAlternatives)
+            skipAlternatives = false; // end of or group
+         continue;
+      }
+
+      if ((*D).Type == pkgSrcRecords::Parser::BuildConflict ||
+          (*D).Type == pkgSrcRecords::Parser::BuildConflictIndep)
+      {
+         pkgCache::GrpIterator Grp = Cache->FindGrp((*D).Package);
+         // Build-conflicts on unknown packages are silently ignored
+         if (Grp.end() == true)
+            continue;
+
+         for (pkgCache::PkgIterator Pkg = Grp.PackageList(); Pkg.end() == false; Pkg = Grp.NextPkg(Pkg))
+         {
+            pkgCache::VerIterator IV = (*Cache)[Pkg].InstVerIter(*Cache);
+            /*
+             * Remove if we have an installed version that satisfies the
+             * version criteria
+             */
+            if (IV.end() == false &&
+                Cache->VS().CheckDep(IV.VerStr(),(*D).Op,(*D).Version.c_str()) == true)
+               TryToInstallBuildDep(Pkg,Cache,Fix,true,false);
+         }
+      }
+      else // BuildDep || BuildDepIndep
+      {
+         if (_config->FindB("Debug::BuildDeps",false) == true)
+            cerr << "Looking for " << (*D).Package << "...\n";
+
+         pkgCache::PkgIterator Pkg;
+
+         // Cross-Building?
+         if (StripMultiArch == false && D->Type != pkgSrcRecords::Parser::BuildDependIndep)
+         {
+            size_t const colon = D->Package.find(":");
+            if (colon != string::npos)
+            {
+               if (strcmp(D->Package.c_str() + colon, ":any") == 0 || strcmp(D->Package.c_str() + colon, ":native") == 0)
+                  Pkg = Cache->FindPkg(D->Package.substr(0,colon));
+               else
+                  Pkg = Cache->FindPkg(D->Package);
+            }
+            else
+               Pkg = Cache->FindPkg(D->Package, hostArch);
+
+            // a bad version either is invalid or doesn't satify dependency
+            #define BADVER(Ver) (Ver.end() == true || \
+                  (D->Version.empty() == false && \
+                  Cache->VS().CheckDep(Ver.VerStr(),D->Op,D->Version.c_str()) == false))
+
+            APT::VersionList verlist;
+            if (Pkg.end() == false)
+            {
+               pkgCache::VerIterator Ver = (*Cache)[Pkg].InstVerIter(*Cache);
+               if (BADVER(Ver) == false)
+                  verlist.insert(Ver);
+               Ver = (*Cache)[Pkg].CandidateVerIter(*Cache);
+               if (BADVER(Ver) == false)
+                  verlist.insert(Ver);
+            }
+            if (verlist.empty() == true)
+            {
+               pkgCache::PkgIterator BuildPkg = Cache->FindPkg(D->Package, "native");
+               if (BuildPkg.end() == false && Pkg != BuildPkg)
+               {
+                  pkgCache::VerIterator Ver = (*Cache)[BuildPkg].InstVerIter(*Cache);
+                  if (BADVER(Ver) == false)
+                     verlist.insert(Ver);
+                  Ver = (*Cache)[BuildPkg].CandidateVerIter(*Cache);
+                  if (BADVER(Ver) == false)
+                     verlist.insert(Ver);
+               }
+            }
+            #undef BADVER
+
+            string forbidden;
+            // We need to decide if host or build arch, so find a version we can look at
+            APT::VersionList::const_iterator Ver = verlist.begin();
+            for (; Ver != verlist.end(); ++Ver)
+            {
+               forbidden.clear();
+               if (Ver->MultiArch == pkgCache::Version::None || Ver->MultiArch == pkgCache::Version::All)
+               {
+                  if (colon == string::npos)
+                     Pkg = Ver.ParentPkg().Group().FindPkg(hostArch);
+                  else if (strcmp(D->Package.c_str() + colon, ":any") == 0)
+                     forbidden = "Multi-Arch: none";
+                  else if (strcmp(D->Package.c_str() + colon, ":native") == 0)
+                     Pkg = Ver.ParentPkg().Group().FindPkg("native");
+               }
+               else if (Ver->MultiArch == pkgCache::Version::Same)
+               {
+                  if (colon == string::npos)
+                     Pkg = Ver.ParentPkg().Group().FindPkg(hostArch);
+                  else if (strcmp(D->Package.c_str() + colon, ":any") == 0)
+                     forbidden = "Multi-Arch: same";
+                  else if (strcmp(D->Package.c_str() + colon, ":native") == 0)
+                     Pkg = Ver.ParentPkg().Group().FindPkg("native");
+               }
+               else if ((Ver->MultiArch & pkgCache::Version::Foreign) == pkgCache::Version::Foreign)
+               {
+                  if (colon == string::npos)
+                     Pkg = Ver.ParentPkg().Group().FindPkg("native");
+                  else if (strcmp(D->Package.c_str() + colon, ":any") == 0 ||
+                           strcmp(D->Package.c_str() + colon, ":native") == 0)
+                     forbidden = "Multi-Arch: foreign";
+               }
+               else if ((Ver->MultiArch & pkgCache::Version::Allowed) == pkgCache::Version::Allowed)
+               {
+                  if (colon == string::npos)
+                     Pkg = Ver.ParentPkg().Group().FindPkg(hostArch);
+                  else if (strcmp(D->Package.c_str() + colon, ":any") == 0)
+                  {
+                     // prefer any installed over preferred non-installed architectures
+                     pkgCache::GrpIterator Grp = Ver.ParentPkg().Group();
+                     // we don't check for version here as we are better of with upgrading than remove and install
+                     for (Pkg = Grp.PackageList(); Pkg.end() == false; Pkg = Grp.NextPkg(Pkg))
+                        if (Pkg.CurrentVer().end() == false)
+                           break;
+                     if (Pkg.end() == true)
+                        Pkg = Grp.FindPreferredPkg(true);
+                  }
+                  else if (strcmp(D->Package.c_str() + colon, ":native") == 0)
+                     Pkg = Ver.ParentPkg().Group().FindPkg("native");
+               }
+
+               if (forbidden.empty() == false)
+               {
+                  if (_config->FindB("Debug::BuildDeps",false) == true)
+                     cerr << D->Package.substr(colon, string::npos) << " is not allowed from " << forbidden << " package " << (*D).Package << " (" << Ver.VerStr() << ")" << endl;
+                  continue;
+               }
+
+               //we found a good version
+               break;
+            }
+            if (Ver == verlist.end())
+            {
+               if (_config->FindB("Debug::BuildDeps",false) == true)
+                  cerr << " No multiarch info as we have no satisfying installed nor candidate for " << D->Package << " on build or host arch" << endl;
+
+               if (forbidden.empty() == false)
+               {
+                  if (hasAlternatives || FirstBroken.end() == false)
+                     continue;
+                  return _error->Error(_("%s dependency for %s can't be satisfied "
+                                         "because %s is not allowed on '%s' packages"),
+                                       BuildDepType(D->Type), Src.c_str(),
+                                       D->Package.c_str(), forbidden.c_str());
+               }
+            }
+         }
+         else
+            Pkg = Cache->FindPkg(D->Package);
+
+         if (Pkg.end() == true || (Pkg->VersionList == 0 && Pkg->ProvidesList == 0))
+         {
+            if (_config->FindB("Debug::BuildDeps",false) == true)
+               cerr << " (not found)" << (*D).Package << endl;
+
+            if (hasAlternatives || FirstBroken.end() == false)
+               continue;
+
+            return _error->Error(_("%s dependency for %s cannot be satisfied "
+                                   "because the package %s cannot be found"),
+                                 BuildDepType((*D).Type),Src.c_str(),
+                                 (*D).Package.c_str());
+         }
+
+         pkgCache::VerIterator IV = (*Cache)[Pkg].InstVerIter(*Cache);
+         if (IV.end() == false)
+         {
+            if (_config->FindB("Debug::BuildDeps",false) == true)
+               cerr << "  Is installed\n";
+
+            if (D->Version.empty() == true ||
+                Cache->VS().CheckDep(IV.VerStr(),(*D).Op,(*D).Version.c_str()) == true)
+            {
+               skipAlternatives = hasAlternatives;
+               FirstBroken = NoPkg;
+               continue;
+            }
+
+            if (_config->FindB("Debug::BuildDeps",false) == true)
+               cerr << "    ...but the installed version doesn't meet the version requirement\n";
+
+            if (((*D).Op & pkgCache::Dep::LessEq) == pkgCache::Dep::LessEq)
+               return _error->Error(_("Failed to satisfy %s dependency for %s: Installed package %s is too new"),
+                                    BuildDepType((*D).Type), Src.c_str(), Pkg.FullName(true).c_str());
+         }
+
+         // Only consider virtual packages if there is no versioned dependency
+         if ((*D).Version.empty() == true)
+         {
+            /*
+             * If this is a virtual package, we need to check the list of
+             * packages that provide it and see if any of those are
+             * installed
+             */
+            pkgCache::PrvIterator Prv = Pkg.ProvidesList();
+            for (; Prv.end() != true; ++Prv)
+            {
+               if (_config->FindB("Debug::BuildDeps",false) == true)
+                  cerr << "  Checking provider " << Prv.OwnerPkg().FullName() << endl;
+
+               if ((*Cache)[Prv.OwnerPkg()].InstVerIter(*Cache).end() == false)
+                  break;
+            }
+
+            if (Prv.end() == false)
+            {
+               if (_config->FindB("Debug::BuildDeps",false) == true)
+                  cerr << "  Is provided by installed package " << Prv.OwnerPkg().FullName() << endl;
+               skipAlternatives = hasAlternatives;
+               FirstBroken = NoPkg;
+               continue;
+            }
+         }
+         else // versioned dependency
+         {
+            pkgCache::VerIterator CV = (*Cache)[Pkg].CandidateVerIter(*Cache);
+            if (CV.end() == true ||
+               Cache->VS().CheckDep(CV.VerStr(),(*D).Op,(*D).Version.c_str()) == false)
+            {
+               if (hasAlternatives || FirstBroken.end() == false)
+                  continue;
+               else if (CV.end() == false)
+                  return _error->Error(_("%s dependency for %s cannot be satisfied "
+                                         "because candidate version of package %s "
+                                         "can't satisfy version requirements"),
+                                       BuildDepType(D->Type), Src.c_str(),
+                                       D->Package.c_str());
+               else
+                  return _error->Error(_("%s dependency for %s cannot be satisfied "
+                                         "because package %s has no candidate version"),
+                                       BuildDepType(D->Type), Src.c_str(),
+                                       D->Package.c_str());
+            }
+         }
+
+         // with alternatives left to try mark speculatively
+         bool const speculate = tryAlternatives == true &&
+            (hasAlternatives == true || FirstBroken.end() == false);
+         unsigned long const Broken = Cache->BrokenCount();
+         if (speculate == true)
+            Fix.Checkpoint();
+         bool const Installed = TryToInstallBuildDep(Pkg,Cache,Fix,false,false,false);
+         if (speculate == true && Installed == true && Cache->BrokenCount() > Broken)
+         {
+            if (_config->FindB("Debug::BuildDeps",false) == true)
+               cerr << "  Breaks other packages, trying alternatives\n";
+            Fix.Rollback();
+            if (FirstBroken.end() == true)
+               FirstBroken = Pkg;
+            continue;
+         }
+         if (speculate == true)
+            Fix.Commit();
+
+         if (Installed == true)
+         {
+            // We successfully installed something; skip remaining alternatives
+            skipAlternatives = hasAlternatives;
+            FirstBroken = NoPkg;
+            if (_config->FindB("APT::Get::Build-Dep-Automatic", false) == true)
+               Cache->MarkAuto(Pkg, true);
+            continue;
+         }
+         else if (hasAlternatives || FirstBroken.end() == false)
+         {
+            if (_config->FindB("Debug::BuildDeps",false) == true)
+               cerr << "  Unsatisfiable, trying alternatives\n";
+            continue;
+         }
+         else
+         {
+            return _error->Error(_("Failed to satisfy %s dependency for %s: %s"),
+                                 BuildDepType((*D).Type),
+                                 Src.c_str(),
+                                 (*D).Package.c_str());
+         }
+      }
+   }
+
+   if (FirstBroken.end() == false)
+      InstallBuildDep(FirstBroken, Cache, Fix);
+
+   if (Fix.Resolve(true) == false)
+      _error->Discard();
+   
+   // Now we check the state of the packages,
+   if (Cache->BrokenCount() != 0)
+   {
+      ShowBroken(Err, Cache, false);
+      return _error->Error(_("Build-dependencies for %s could not be satisfied."),Src.c_str());
+   }
+   return true;
+}
+
+
+// ShowNewInstalls - Print the packages to install sorted by name
+// ---------------------------------------------------------------------
+/* */
+static void ShowNewInstalls(CacheFile &Cache, ostream &out)
+{
+   for (unsigned J = 0; J < Cache->Head().PackageCount; J++)
+   {
+      pkgCache::PkgIterator I(Cache,Cache.List[J]);
+      if (Cache->IsStateComputed(I) == true && Cache[I].NewInstall() == true)
+      {
+         out << I.FullName(true)
+             << ":"
+             << Cache[I].CandidateVerIter(Cache).Arch()
+             << "="
+             << string(Cache[I].CandVersion)
+             << endl;
+      }
+   }
+}
+
+
+// HashAdd - Add a string or a number to a hash
+// ---------------------------------------------------------------------
+/* */
+static void HashAdd(MD5Summation &Sum, string const &S)
+{
+   // including the terminator keeps "ab","c" and "a","bc" apart
+   Sum.Add(S.c_str(), S.length() + 1);
+}
+static void HashAdd(MD5Summation &Sum, unsigned long const Value)
+{
+   Sum.Add((const unsigned char *) &Value, sizeof(Value));
+}
+
+
+// HashResolver - Add the resolver and the options it uses to a hash
+// ---------------------------------------------------------------------
+/* Version has to be increased by the caller whenever the resolution or
+   the results it stores change. The number of jobs and the state file
+   don't change any result, so they are left out. */
+static void HashResolver(MD5Summation &Sum, unsigned long const Version)
+{
+   HashAdd(Sum, Version);
+   HashAdd(Sum, PACKAGE_VERSION);
+
+   std::ostringstream Config;
+   _config->Dump(Config, "APT", "%f \"%v\";\n", true);
+   _config->Dump(Config, "pkgProblemResolver", "%f \"%v\";\n", true);
+   std::istringstream In(Config.str());
+   for (string Line; getline(In, Line);)
+      if (Line.compare(0, 23, "APT::Resolve-Dep::Jobs ") != 0 &&
+          Line.compare(0, 24, "APT::Resolve-Dep::State ") != 0)
+         HashAdd(Sum, Line);
+}
+
+
+// WriteLinesField - Write a field with text of any number of lines
+// ---------------------------------------------------------------------
+/* The value of the field is the number of lines, the lines follow
+   indented by a space. Empty lines and lines starting with a dot get an
+   extra dot in front. */
+static void WriteLinesField(ostream &Out, char const * const Field, string const &Text)
+{
+   vector<string> Lines;
+   for (string::size_type Start = 0; Start < Text.length();)
+   {
+      string::size_type End = Text.find('\n', Start);
+      if (End == string::npos)
+         End = Text.length();
+      Lines.push_back(Text.substr(Start, End - Start));
+      Start = End + 1;
+   }
+
+   Out << Field << ": " << Lines.size() << "\n";
+   for (vector<string>::const_iterator L = Lines.begin(); L != Lines.end(); ++L)
+   {
+      Out << ' ';
+      if (L->empty() == true || (*L)[0] == '.')
+         Out << '.';
+      Out << *L << "\n";
+   }
+}
+
+
+// ReadLinesField - Read a field written by WriteLinesField
+// ---------------------------------------------------------------------
+/* */
+static bool ReadLinesField(pkgTagSection const &Section, char const * const Field, string &Text)
+{
+   const char *Start, *Stop, *End;
+   if (Section.Find(Field, Start, Stop) == false)
+      return false;
+   Section.GetSection(Stop, End);
+
+   Text.clear();
+   unsigned long Count = strtoul(Start, 0, 10);
+   Start = (const char *) memchr(Start, '\n', End - Start);
+   for (; Count != 0 && Start != 0 && Start + 1 < End; --Count)
+   {
+      Start += 2;
+      if (Start < End && *Start == '.')
+         ++Start;
+      Stop = (const char *) memchr(Start, '\n', End - Start);
+      if (Stop == 0)
+         Stop = End;
+      Text.append(Start, Stop).append("\n");
+      Start = (Stop == End) ? 0 : Stop;
+   }
+   return Count == 0;
+}
+
+
+// ResultCacheKey - Identify a run by everything its result depends on
+// ---------------------------------------------------------------------
+/* The key covers the version of the resolver, the parsed
+   build-dependencies of all control files (but not their names, so that
+   files with the same build-dependencies share a result), the names of
+   those which can't be parsed, the configuration and size
+   and modification time of every file the cache, the policy and the auto
+   flags are built from, the same way the cache itself is checked for
+   being up to date. It can be computed without opening the cache. An
+   empty key is returned if it can't be computed, the errors are left to
+   the run without a result cache to report. */
+static string ResultCacheKey(CommandLine &CmdL)
+{
+   MD5Summation Sum;
+   _error->PushToStack();
+
+   // increase whenever the resolution or the stored results change
+   HashResolver(Sum, 2);
+
+   bool StripMultiArch;
+   string const hostArch = _config->Find("APT::Get::Host-Architecture");
+   if (CheckHostArch(hostArch, StripMultiArch) == true)
+   {
+      for (const char **I = CmdL.FileList; *I != 0; I++)
+      {
+         vector<pkgSrcRecords::Parser::BuildDepRec> BuildDeps;
+         FileFd Fd(*I, FileFd::ReadOnly);
+         if (Fd.Failed() == true || ParseBuildDeps(Fd, hostArch, StripMultiArch, BuildDeps) == false)
+         {
+            /* the run fails at this file, which has to be told from an
+               empty one; the errors of opening it name the real file */
+            HashAdd(Sum, ~0UL);
+            HashAdd(Sum, *I);
+            _error->Discard();
+            continue;
+         }
+         HashAdd(Sum, BuildDeps.size());
+         for (vector<pkgSrcRecords::Parser::BuildDepRec>::const_iterator D = BuildDeps.begin();
+              D != BuildDeps.end(); ++D)
+         {
+            HashAdd(Sum, D->Package);
+            HashAdd(Sum, D->Version);
+            HashAdd(Sum, (D->Type << 8) | D->Op);
+         }
+      }
+   }
+   HashAdd(Sum, APT::Configuration::getBuildProfilesString());
+
+   std::ostringstream Config;
+   _config->Dump(Config, "Dir", "%f \"%v\";\n", true);
+   HashAdd(Sum, Config.str());
+
+   pkgSourceList List;
+   std::vector<pkgIndexFile *> Indexes;
+   if (_error->PendingError() == false && List.ReadMainList() == true)
+   {
+      for (pkgSourceList::const_iterator I = List.begin(); I != List.end(); ++I)
+      {
+         std::vector<pkgIndexFile *> *Files = (*I)->GetIndexFiles();
+         for (std::vector<pkgIndexFile *>::const_iterator J = Files->begin(); J != Files->end(); ++J)
+            if ((*J)->HasPackages() == true)
+               Indexes.push_back(*J);
+      }
+      _system->AddStatusFiles(Indexes);
+   }
+
+   std::vector<std::string> Files;
+   for (std::vector<pkgIndexFile *>::const_iterator I = Indexes.begin(); I != Indexes.end(); ++I)
+      Files.push_back((*I)->IndexFileName());
+   Files.push_back(_config->FindFile("Dir::State::extended_states"));
+   Files.push_back(_config->FindFile("Dir::Etc::Preferences"));
+   string const Parts = _config->FindDir("Dir::Etc::PreferencesParts");
+   if (DirectoryExists(Parts) == true)
+   {
+      std::vector<std::string> const Prefs = GetListOfFilesInDir(Parts, "pref", true, true);
+      Files.insert(Files.end(), Prefs.begin(), Prefs.end());
+   }
+   for (std::vector<std::string>::const_iterator F = Files.begin(); F != Files.end(); ++F)
+   {
+      struct stat St;
+      HashAdd(Sum, *F);
+      if (F->empty() == true || stat(F->c_str(), &St) != 0)
+         continue;
+      HashAdd(Sum, St.st_size);
+      HashAdd(Sum, St.st_mtime);
+   }
+
+   bool const Failed = _error->PendingError();
+   _error->RevertToStack();
+   if (Failed == true)
+      return string();
+   return Sum.Result().Value();
+}
+
+
+// ResultFileName - The name a control file is stored as in a result
+// ---------------------------------------------------------------------
+/* Results are shared by runs with the same build-dependencies in files of
+   other names, so they refer to the I-th control file by this instead. */
+static string ResultFileName(unsigned int const I)
+{
+   std::ostringstream Name;
+   Name << "@@file" << I << "@@";
+   return Name.str();
+}
+
+
+// InsertFileNames - Replace the names of ResultFileName by the real ones
+// ---------------------------------------------------------------------
+/* */
+static string InsertFileNames(CommandLine &CmdL, string Text)
+{
+   for (unsigned int I = 0; I < CmdL.FileSize(); ++I)
+   {
+      string const Name = ResultFileName(I);
+      for (string::size_type Pos = 0; (Pos = Text.find(Name, Pos)) != string::npos;)
+      {
+         Text.replace(Pos, Name.length(), CmdL.FileList[I]);
+         Pos += strlen(CmdL.FileList[I]);
+      }
+   }
+   return Text;
+}
+
+
+// ReplayResult - Show a result from the result cache
+// ---------------------------------------------------------------------
+/* Broken and Output are printed as they were and the errors and warnings
+   of the run are added again for the caller to report, all with the names
+   of the control files of this run. */
+static void ReplayResult(CommandLine &CmdL, string const &Broken,
+                         string const &Messages, string const &Output)
+{
+   cerr << InsertFileNames(CmdL, Broken);
+   cout << InsertFileNames(CmdL, Output);
+
+   std::vector<std::pair<GlobalError::MsgType, string> > Msgs;
+   std::istringstream In(InsertFileNames(CmdL, Messages));
+   for (string Line; getline(In, Line);)
+   {
+      GlobalError::MsgType Type;
+      switch (Line.length() < 3 || Line.compare(1, 2, ": ") != 0 ? 0 : Line[0])
+      {
+         case 'E': Type = GlobalError::ERROR; break;
+         case 'W': Type = GlobalError::WARNING; break;
+         case 'N': Type = GlobalError::NOTICE; break;
+         case 'D': Type = GlobalError::DEBUG; break;
+         default:
+            // continuation of a message spanning multiple lines
+            if (Msgs.empty() == false)
+               Msgs.back().second.append("\n").append(Line);
+            continue;
+      }
+      Msgs.push_back(std::make_pair(Type, Line.substr(3)));
+   }
+   for (std::vector<std::pair<GlobalError::MsgType, string> >::const_iterator M = Msgs.begin();
+        M != Msgs.end(); ++M)
+      _error->Insert(M->first, "%s", M->second.c_str());
+}
+
+
+// ReadResult - Show the result stored in the result cache if there is one
+// ---------------------------------------------------------------------
+/* */
+static bool ReadResult(CommandLine &CmdL, string const &File)
+{
+   if (FileExists(File) == false)
+      return false;
+
+   _error->PushToStack();
+   FileFd Fd(File, FileFd::ReadOnly);
+   pkgTagFile Tags(&Fd);
+   pkgTagSection Section;
+   string Broken, Messages, Output;
+   bool const Okay = _error->PendingError() == false &&
+                     Tags.Step(Section) == true &&
+                     ReadLinesField(Section, "Broken", Broken) == true &&
+                     ReadLinesField(Section, "Messages", Messages) == true &&
+                     ReadLinesField(Section, "Output", Output) == true;
+   // a damaged entry is just a miss
+   _error->RevertToStack();
+   if (Okay == false)
+      return false;
+
+   ReplayResult(CmdL, Broken, Messages, Output);
+   return true;
+}
+
+
+// WriteResult - Store the result of a run in the result cache
+// ---------------------------------------------------------------------
+/* */
+static bool WriteResult(string const &File, string const &Broken,
+                        string const &Messages, string const &Output)
+{
+   std::ostringstream Stanza;
+   WriteLinesField(Stanza, "Broken", Broken);
+   WriteLinesField(Stanza, "Messages", Messages);
+   WriteLinesField(Stanza, "Output", Output);
+   string const S = Stanza.str();
+
+   FileFd Fd;
+   return Fd.Open(File, FileFd::WriteAtomic, 0644) == true &&
+          Fd.Write(S.c_str(), S.length()) == true &&
+          Fd.Close() == true;
+}
+
+
+// ResolveBuildDeps - Resolve the build-dependencies of all control files
+// ---------------------------------------------------------------------
+/* Resolved is set once everything but the control files themselves has
+   been checked, so that whatever happens after it depends only on the
+   input of the run. The I-th file is called Names[I] in the output. */
+static bool ResolveBuildDeps(CommandLine &CmdL, vector<string> const &Names,
+                             bool &Resolved, ostream &Out, ostream &Err)
+{
+   CacheFile Cache;
+
+   if (Cache.Open(true) == false)
+      return false;
+
+   if (CmdL.FileSize() == 0)
+      return _error->Error(_("Must specify at least one source file to check builddeps for"));
+   
+   // Read the source list
+   if (Cache.BuildSourceList() == false)
+      return false;
+
+   bool StripMultiArch;
+   string hostArch = _config->Find("APT::Get::Host-Architecture");
+   if (CheckHostArch(hostArch, StripMultiArch) == false)
+      return false;
+   Resolved = true;
+
+   for (unsigned int I = 0; I < CmdL.FileSize(); I++)
+   {
+      string const &Src = Names[I];
+
+      // Process the build-dependencies
+      vector<pkgSrcRecords::Parser::BuildDepRec> BuildDeps;
+      FileFd Fd(CmdL.FileList[I], FileFd::ReadOnly);
+      if (Fd.Failed() == true || ParseBuildDeps(Fd, hostArch, StripMultiArch, BuildDeps) == false)
+         return _error->Error(_("Unable to get build-dependency information for %s"),Src.c_str());
+
+      if (InstallBuildDeps(Cache, Src, BuildDeps, hostArch, StripMultiArch, Err) == false)
+         return false;
+   }
+
+   ShowNewInstalls(Cache, Out);
+   return true;
+}
+
+
+// DoBuildDep - Resolve the build-dependencies of all control files
+// ---------------------------------------------------------------------
+/* With APT::Resolve-Dep::Result-Cache the result is looked up in this
+   directory first, keyed by everything it depends on. On a hit the cache
+   isn't even opened, otherwise the result is stored there afterwards. */
+static bool DoBuildDep(CommandLine &CmdL)
+{
+   _config->Set("APT::Install-Recommends", false);
+
+   bool Resolved = false;
+   string const ResultCache = _config->Find("APT::Resolve-Dep::Result-Cache");
+   string const Key = (ResultCache.empty() == true || CmdL.FileSize() == 0) ?
+                      string() : ResultCacheKey(CmdL);
+   vector<string> Names;
+   if (Key.empty() == true)
+   {
+      Names.assign(CmdL.FileList, CmdL.FileList + CmdL.FileSize());
+      return ResolveBuildDeps(CmdL, Names, Resolved, cout, cerr);
+   }
+
+   string const File = flCombine(ResultCache, Key);
+   if (ReadResult(CmdL, File) == true)
+      return _error->PendingError() == false;
+
+   for (unsigned int I = 0; I < CmdL.FileSize(); ++I)
+      Names.push_back(ResultFileName(I));
+   std::ostringstream Out, Err, Messages;
+   ResolveBuildDeps(CmdL, Names, Resolved, Out, Err);
+   if (Resolved == false)
+      return false;
+   _error->DumpErrors(Messages, GlobalError::DEBUG);
+
+   _error->PushToStack();
+   if (WriteResult(File, Err.str(), Messages.str(), Out.str()) == false)
+   {
+      _error->RevertToStack();
+      _error->Warning(_("Could not store the result in %s"), File.c_str());
+   }
+   else
+      _error->MergeWithStack();
+
+   ReplayResult(CmdL, Err.str(), Messages.str(), Out.str());
+   return _error->PendingError() == false;
+}
+
+
+// ResolveParsed - Resolve parsed build-dependencies of a control file
+// ---------------------------------------------------------------------
+/* The output of the resolution as well as all errors are written to Out
+   and the exit code we would use for it is returned. */
+static int ResolveParsed(CacheFile &Cache, string const &Src,
+                         vector<pkgSrcRecords::Parser::BuildDepRec> &BuildDeps,
+                         bool const StripMultiArch, ostream &Out)
+{
+   string const hostArch = _config->Find("APT::Get::Host-Architecture");
+   bool const Okay = InstallBuildDeps(Cache, Src, BuildDeps, hostArch, StripMultiArch, Out);
+   if (Okay == true)
+      ShowNewInstalls(Cache, Out);
+
+   int const Status = (Okay == false || _error->PendingError() == true) ? 100 : 0;
+   _error->DumpErrors(Out);
+   return Status;
+}
+
+
+// ResolveControlFile - Resolve the build-dependencies of a control file
+// ---------------------------------------------------------------------
+/* Like ResolveParsed, but reads the control file from Fd first */
+static int ResolveControlFile(CacheFile &Cache, string const &Src, FileFd &Fd,
+                              bool const StripMultiArch, ostream &Out)
+{
+   string const hostArch = _config->Find("APT::Get::Host-Architecture");
+   vector<pkgSrcRecords::Parser::BuildDepRec> BuildDeps;
+   if (Fd.IsOpen() == false || Fd.Failed() == true ||
+       ParseBuildDeps(Fd, hostArch, StripMultiArch, BuildDeps) == false)
+   {
+      _error->Error(_("Unable to get build-dependency information for %s"),Src.c_str());
+      _error->DumpErrors(Out);
+      return 100;
+   }
+   return ResolveParsed(Cache, Src, BuildDeps, StripMultiArch, Out);
+}
+
+
+// WorkerCacheFile - A CacheFile with a depcache of its own
+// ---------------------------------------------------------------------
+/* The mapped cache, the policy and the sorted package list are read-only
+   while resolving, so they are borrowed from the CacheFile the worker is
+   created for. Only the depcache is private and gets its initial state
+   from a snapshot instead of being generated again. */
+class WorkerCacheFile : public CacheFile
+{
+   public:
+   bool Open(CacheFile &Main, pkgDepCache::StateSnapshot const &Initial)
+   {
+      Cache = Main;
+      Policy = Main.Policy;
+      SrcList = Main;
+      List = Main.List;
+      DCache = new pkgDepCache(Cache, Policy);
+      return DCache->RestoreState(Initial);
+   }
+
+   ~WorkerCacheFile()
+   {
+      // all of these belong to the CacheFile we borrowed them from
+      Cache = NULL;
+      Policy = NULL;
+      SrcList = NULL;
+      List = NULL;
+   }
+};
+
+
+// BatchItem - A control file or source resolved in batch mode
+// ---------------------------------------------------------------------
+/* Header is printed in front of the Status line to tell the items apart,
+   Closure is only set if the queue fingerprints the items. */
+struct BatchItem
+{
+   string Src;
+   string Header;
+   vector<pkgSrcRecords::Parser::BuildDepRec> BuildDeps;
+   bool Parsed;
+   bool Done;
+   int Status;
+   string Output;
+   string Closure;
+
+   BatchItem() : Parsed(false), Done(false), Status(100) {};
+};
+
+
+// BatchQueue - The items of a batch run shared between the workers
+// ---------------------------------------------------------------------
+/* Workers take the next item to resolve from the queue and mark it as
+   done, the printer waits for them in order. If Fingerprint is set the
+   workers compute the closure of each item and take the result from
+   Previous instead of resolving if it hasn't changed. */
+struct BatchQueue
+{
+   vector<BatchItem> Items;
+   vector<BatchItem>::size_type Next;
+   pkgDepCache::StateSnapshot Initial;
+   bool StripMultiArch;
+   bool Fingerprint;
+   map<string, BatchItem> Previous;
+
+   pthread_mutex_t Lock;
+   pthread_cond_t ItemDone;
+
+   BatchQueue() : Next(0), StripMultiArch(true), Fingerprint(false)
+   {
+      pthread_mutex_init(&Lock, NULL);
+      pthread_cond_init(&ItemDone, NULL);
+   }
+   ~BatchQueue()
+   {
+      pthread_cond_destroy(&ItemDone);
+      pthread_mutex_destroy(&Lock);
+   }
+};
+
+
+// ClosureHash - Fingerprint everything resolving an item could look at
+// ---------------------------------------------------------------------
+/* Starting from the build-dependencies and build-essential this walks the
+   groups of all packages named, the dependencies and provides of their
+   installed and candidate versions, the providers of virtual packages and
+   the installed packages depending on any of them. If none of this has
+   changed resolving the item again gives the same result. */
+static void QueueGroup(pkgCache::GrpIterator Grp, vector<bool> &Seen,
+                       vector<pkgCache::PkgIterator> &Todo)
+{
+   if (Grp.end() == true || Seen[Grp->ID] == true)
+      return;
+   Seen[Grp->ID] = true;
+   for (pkgCache::PkgIterator Pkg = Grp.PackageList(); Pkg.end() == false; Pkg = Grp.NextPkg(Pkg))
+      Todo.push_back(Pkg);
+}
+static void HashVersion(MD5Summation &Sum, pkgCache::VerIterator const &Ver,
+                        vector<bool> &Seen, vector<pkgCache::PkgIterator> &Todo)
+{
+   HashAdd(Sum, Ver.VerStr());
+   HashAdd(Sum, Ver.Arch());
+   HashAdd(Sum, Ver->MultiArch);
+   HashAdd(Sum, Ver->Priority);
+   for (pkgCache::DepIterator D = Ver.DependsList(); D.end() == false; ++D)
+   {
+      HashAdd(Sum, D.TargetPkg().FullName());
+      HashAdd(Sum, (D->Type << 8) | D->CompareOp);
+      HashAdd(Sum, D.TargetVer() == 0 ? "" : D.TargetVer());
+      QueueGroup(D.TargetPkg().Group(), Seen, Todo);
+   }
+   for (pkgCache::PrvIterator Prv = Ver.ProvidesList(); Prv.end() == false; ++Prv)
+   {
+      HashAdd(Sum, Prv.ParentPkg().FullName());
+      QueueGroup(Prv.ParentPkg().Group(), Seen, Todo);
+   }
+}
+static string ClosureHash(CacheFile &Cache, BatchItem const &Item)
+{
+   pkgDepCache &DCache = *Cache;
+   pkgCache &PCache = DCache.GetCache();
+   vector<bool> Seen(PCache.Head().GroupCount, false);
+   vector<pkgCache::PkgIterator> Todo;
+   MD5Summation Sum;
+
+   HashAdd(Sum, Item.Header);
+   HashAdd(Sum, _config->Find("APT::Get::Host-Architecture"));
+   std::vector<std::string> const Archs = APT::Configuration::getArchitectures();
+   for (std::vector<std::string>::const_iterator A = Archs.begin(); A != Archs.end(); ++A)
+      HashAdd(Sum, *A);
+
+   vector<string> Names;
+   for (vector<pkgSrcRecords::Parser::BuildDepRec>::const_iterator D = Item.BuildDeps.begin();
+        D != Item.BuildDeps.end(); ++D)
+   {
+      HashAdd(Sum, D->Package);
+      HashAdd(Sum, D->Version);
+      HashAdd(Sum, (D->Type << 8) | D->Op);
+      Names.push_back(D->Package.substr(0, D->Package.find(':')));
+   }
+   Configuration::Item const *Opts = _config->Tree("APT::Build-Essential");
+   for (Opts = (Opts == 0) ? 0 : Opts->Child; Opts != 0; Opts = Opts->Next)
+   {
+      HashAdd(Sum, Opts->Value);
+      Names.push_back(Opts->Value);
+   }
+   for (vector<string>::const_iterator N = Names.begin(); N != Names.end(); ++N)
+      QueueGroup(PCache.FindGrp(*N), Seen, Todo);
+
+   while (Todo.empty() == false)
+   {
+      pkgCache::PkgIterator const Pkg = Todo.back();
+      Todo.pop_back();
+
+      HashAdd(Sum, Pkg.FullName());
+      HashAdd(Sum, Pkg->Flags);
+      pkgCache::VerIterator const Cur = Pkg.CurrentVer();
+      pkgCache::VerIterator const Cand = DCache[Pkg].CandidateVerIter(DCache);
+      HashAdd(Sum, (Cur.end() == false) | ((Cand.end() == false) << 1));
+      if (Cur.end() == false)
+         HashVersion(Sum, Cur, Seen, Todo);
+      if (Cand.end() == false && Cand != Cur)
+         HashVersion(Sum, Cand, Seen, Todo);
+
+      for (pkgCache::PrvIterator Prv = Pkg.ProvidesList(); Prv.end() == false; ++Prv)
+      {
+         HashAdd(Sum, Prv.OwnerPkg().FullName());
+         HashAdd(Sum, Prv.OwnerVer().VerStr());
+         QueueGroup(Prv.OwnerPkg().Group(), Seen, Todo);
+      }
+      for (pkgCache::DepIterator D = Pkg.RevDependsList(); D.end() == false; ++D)
+      {
+         pkgCache::PkgIterator const Parent = D.ParentPkg();
+         if (D.ParentVer() != Parent.CurrentVer())
+            continue;
+         HashAdd(Sum, Parent.FullName());
+         QueueGroup(Parent.Group(), Seen, Todo);
+      }
+   }
+   return Sum.Result().Value();
+}
+
+
+// BatchWorker - Resolve items of the queue until none are left
+// ---------------------------------------------------------------------
+/* Each worker resolves on its own CacheFile starting each item from the
+   initial depcache state of the queue. Errors are collected per thread by
+   _error, so they end up in the output of the item they belong to. */
+struct BatchWorker
+{
+   CacheFile *Cache;
+   BatchQueue *Queue;
+   pthread_t Thread;
+};
+static void *RunBatchWorker(void *Arg)
+{
+   BatchWorker &Worker = *((BatchWorker *) Arg);
+   BatchQueue &Queue = *Worker.Queue;
+   while (true)
+   {
+      pthread_mutex_lock(&Queue.Lock);
+      vector<BatchItem>::size_type const Cur = Queue.Next++;
+      pthread_mutex_unlock(&Queue.Lock);
+      if (Cur >= Queue.Items.size())
+         break;
+
+      BatchItem &Item = Queue.Items[Cur];
+      if (Item.Parsed == true)
+      {
+         ostringstream Out;
+         if ((*Worker.Cache)->RestoreState(Queue.Initial) == false)
+         {
+            _error->DumpErrors(Out);
+            Item.Status = 100;
+            Item.Output = Out.str();
+         }
+         else
+         {
+            map<string, BatchItem>::const_iterator Old = Queue.Previous.end();
+            if (Queue.Fingerprint == true)
+            {
+               Item.Closure = ClosureHash(*Worker.Cache, Item);
+               Old = Queue.Previous.find(Item.Header);
+            }
+            if (Old != Queue.Previous.end() && Old->second.Closure == Item.Closure)
+            {
+               Item.Status = Old->second.Status;
+               Item.Output = Old->second.Output;
+            }
+            else
+            {
+               Item.Status = ResolveParsed(*Worker.Cache, Item.Src, Item.BuildDeps,
+                                           Queue.StripMultiArch, Out);
+               Item.Output = Out.str();
+            }
+         }
+      }
+
+      pthread_mutex_lock(&Queue.Lock);
+      Item.Done = true;
+      pthread_cond_broadcast(&Queue.ItemDone);
+      pthread_mutex_unlock(&Queue.Lock);
+   }
+   return NULL;
+}
+
+
+// WriteBatchState - Append the result of an item to a state file
+// ---------------------------------------------------------------------
+/* The result is stored as a stanza with the header of the item, its
+   closure, status and output. */
+static bool WriteBatchState(FileFd &State, BatchItem const &Item)
+{
+   std::ostringstream Stanza;
+   Stanza << Item.Header << "\n"
+          << "Closure: " << Item.Closure << "\n"
+          << "Status: " << Item.Status << "\n";
+   WriteLinesField(Stanza, "Output", Item.Output);
+   Stanza << "\n";
+   string const S = Stanza.str();
+   return State.Write(S.c_str(), S.length());
+}
+
+
+// WriteBatchStateHeader - Start a state file for the results of items
+// ---------------------------------------------------------------------
+/* The first stanza of a state file identifies the resolver which stored
+   the results. */
+static bool WriteBatchStateHeader(FileFd &State, string const &Resolver)
+{
+   string const S = "Resolver: " + Resolver + "\n\n";
+   return State.Write(S.c_str(), S.length());
+}
+
+
+// ReadBatchState - Read the results stored by WriteBatchState
+// ---------------------------------------------------------------------
+/* Header builds the header of an item from its stanza as the results are
+   looked up by it. If the file was written by another Resolver none of
+   its results are used. */
+static bool ReadBatchState(string const &File, string const &Resolver,
+                           map<string, BatchItem> &Results,
+                           string (*Header)(pkgTagSection const &))
+{
+   if (FileExists(File) == false)
+      return true;
+
    FileFd Fd(File, FileFd::ReadOnly);
-   if (Fd.Failed()) {
+   pkgTagFile Tags(&Fd);
+   if (_error->PendingError() == true)
       return false;
-   }
-   pkgTagFile Sources(&Fd);
 
-   if (_error->PendingError() == true)
+   pkgTagSection Section;
+   if (Tags.Step(Section) == false || Section.FindS("Resolver") != Resolver)
+      return _error->PendingError() == false;
+   while (Tags.Step(Section) == true)
    {
-      _error->RevertToStack();
-      return false;
+      BatchItem Item;
+      Item.Header = Header(Section);
+      Item.Closure = Section.FindS("Closure");
+      Item.Status = Section.FindI(pkgTagSection::Field::Status, 100);
+      if (ReadLinesField(Section, "Output", Item.Output) == false)
+         return _error->Error(_("Malformed stanza for %s in %s"), Item.Header.c_str(), File.c_str());
+      Results[Item.Header] = Item;
    }
-   _error->MergeWithStack();
-   
-   // read step by step
-   while (Sources.Step(Tags) == true)
-   {
-      for (unsigned int I = 0; I < 4; I++)
-      {
-         if (ArchOnly && (I == 1 || I == 3))
-            continue;
-
-         const char *Start, *Stop;
-         if (Tags.Find(fields[I], Start, Stop) == false)
-            continue;
+   return _error->PendingError() == false;
+}
 
-         while (1)
-         {
-            Start = debListParser::ParseDepends(Start, Stop, 
-               rec.Package,rec.Version,rec.Op,true,StripMultiArch,true);
-	 
-            if (Start == 0) 
-               return _error->Error("Problem parsing dependency: %s", fields[I]);
 
-            rec.Type = I;
-            if (rec.Package != "")
-            {
-               BuildDeps.push_back(rec);
-            }
-	 
-            if (Start == Stop) 
-               break;
-         }
+// RunBatch - Resolve all items of the queue with the given number of jobs
+// ---------------------------------------------------------------------
+/* The items are printed in order as soon as they are resolved and if
+   State is open their results are written to it as well. Returns the
+   number of items whose build-dependencies could not be satisfied. */
+static unsigned long RunBatch(CacheFile &Cache, BatchQueue &Queue, int Jobs, FileFd *State)
+{
+   // fill the static cache in here before the workers read it
+   APT::Configuration::getArchitectures();
+   Cache->SaveState(Queue.Initial);
+
+   if (Jobs < 1)
+      Jobs = 1;
+   if ((unsigned int) Jobs > Queue.Items.size())
+      Jobs = std::max<size_t>(Queue.Items.size(), 1);
+
+   vector<WorkerCacheFile *> WorkerCaches;
+   vector<BatchWorker> Workers(Jobs);
+   int Started = 0;
+   for (; Jobs > 1 && Started < Jobs; ++Started)
+   {
+      WorkerCacheFile *Worker = new WorkerCacheFile;
+      WorkerCaches.push_back(Worker);
+      Workers[Started].Cache = Worker;
+      Workers[Started].Queue = &Queue;
+      if (Worker->Open(Cache, Queue.Initial) == false ||
+          pthread_create(&Workers[Started].Thread, NULL, RunBatchWorker, &Workers[Started]) != 0)
+      {
+         _error->Warning(_("Could not create a worker thread"));
+         break;
       }
    }
-   return true;
+   // without any worker we are the only one
+   if (Started == 0)
+   {
+      Workers[0].Cache = &Cache;
+      Workers[0].Queue = &Queue;
+      RunBatchWorker(&Workers[0]);
+   }
+
+   unsigned long Failed = 0;
+   for (vector<BatchItem>::iterator Item = Queue.Items.begin();
+        Item != Queue.Items.end(); ++Item)
+   {
+      pthread_mutex_lock(&Queue.Lock);
+      while (Item->Done == false)
+         pthread_cond_wait(&Queue.ItemDone, &Queue.Lock);
+      pthread_mutex_unlock(&Queue.Lock);
+
+      if (Item->Status != 0)
+         ++Failed;
+      cout << Item->Header << "\n"
+           << "Status: " << Item->Status << "\n\n"
+           << Item->Output << endl;
+      if (State != NULL && Item->Closure.empty() == false)
+         WriteBatchState(*State, *Item);
+      Item->Output.clear();
+      Item->BuildDeps.clear();
+   }
+
+   for (int J = 0; J < Started; ++J)
+      pthread_join(Workers[J].Thread, NULL);
+   for (vector<WorkerCacheFile *>::iterator W = WorkerCaches.begin();
+        W != WorkerCaches.end(); ++W)
+      delete *W;
+   return Failed;
 }
 
 
-static bool DoBuildDep(CommandLine &CmdL)
+// DoBatch - Resolve each control file on its own
+// ---------------------------------------------------------------------
+/* Every file is resolved starting from the state the depcache had right
+   after it was opened, which is restored from a snapshot between files,
+   and gets its own block of output: a "File:" and a "Status:" line with
+   the exit code a run for just this file would have had, an empty line,
+   the usual output and another empty line.
+
+   With APT::Resolve-Dep::Jobs > 1 the files are resolved by that many
+   threads, each with its own depcache on the shared cache. The control
+   files are parsed upfront as parsing changes the configuration. */
+static bool DoBatch(CommandLine &CmdL)
 {
    CacheFile Cache;
 
    _config->Set("APT::Install-Recommends", false);
-   
+
    if (Cache.Open(true) == false)
       return false;
 
-   if (CmdL.FileSize() == 0)
-      return _error->Error(_("Must specify at least one source file to check builddeps for"));
-   
    // Read the source list
    if (Cache.BuildSourceList() == false)
       return false;
 
-   bool StripMultiArch;
-   string hostArch = _config->Find("APT::Get::Host-Architecture");
-   if (hostArch.empty() == false)
-   {
-      std::vector<std::string> archs = APT::Configuration::getArchitectures();
-      if (std::find(archs.begin(), archs.end(), hostArch) == archs.end())
-         return _error->Error(_("No architecture information available for %s. See apt.conf(5) APT::Architectures for setup"), hostArch.c_str());
-      StripMultiArch = false;
-   }
-   else
-      StripMultiArch = true;
+   BatchQueue Queue;
+   string const hostArch = _config->Find("APT::Get::Host-Architecture");
+   if (CheckHostArch(hostArch, Queue.StripMultiArch) == false)
+      return false;
 
-   unsigned J = 0;
-   for (const char **I = CmdL.FileList; *I != 0; I++, J++)
+   Queue.Items.resize(CmdL.FileSize());
+   for (unsigned int I = 0; I < CmdL.FileSize(); I++)
    {
-      string Src = string(*I);
-
-      // Process the build-dependencies
-      vector<pkgSrcRecords::Parser::BuildDepRec> BuildDeps;
-
-      // FIXME: Can't specify architecture to use for [wildcard] matching, so switch default arch temporary
-      if (hostArch.empty() == false)
+      BatchItem &Item = Queue.Items[I];
+      Item.Src = CmdL.FileList[I];
+      Item.Header = "File: " + Item.Src;
+      FileFd Fd(Item.Src, FileFd::ReadOnly);
+      if (Fd.Failed() == false &&
+          ParseBuildDeps(Fd, hostArch, Queue.StripMultiArch, Item.BuildDeps) == true)
       {
-         std::string nativeArch = _config->Find("APT::Architecture");
-         _config->Set("APT::Architecture", hostArch);
-         bool Success = ParseFileDeb822(*I, BuildDeps, _config->FindB("APT::Get::Arch-Only", false), StripMultiArch);
-         _config->Set("APT::Architecture", nativeArch);
-         if (Success == false)
-            return _error->Error(_("Unable to get build-dependency information for %s"),Src.c_str());
+         Item.Parsed = true;
+         continue;
       }
-      else if (ParseFileDeb822(*I, BuildDeps, _config->FindB("APT::Get::Arch-Only", false), StripMultiArch) == false)
-         return _error->Error(_("Unable to get build-dependency information for %s"),Src.c_str());
+      _error->Error(_("Unable to get build-dependency information for %s"),Item.Src.c_str());
+      ostringstream Out;
+      _error->DumpErrors(Out);
+      Item.Output = Out.str();
+   }
 
-      // Also ensure that build-essential packages are present
-      Configuration::Item const *Opts = _config->Tree("APT::Build-Essential");
-      if (Opts) 
-         Opts = Opts->Child;
-      for (; Opts; Opts = Opts->Next)
-      {
-         if (Opts->Value.empty() == true)
-            continue;
+   unsigned long const Failed = RunBatch(Cache, Queue,
+                                         _config->FindI("APT::Resolve-Dep::Jobs", 1), NULL);
+   if (Failed != 0)
+      return _error->Error(_("Build-dependencies for %lu of %u files could not be satisfied."),
+                           Failed, CmdL.FileSize());
+   return true;
+}
 
-         pkgSrcRecords::Parser::BuildDepRec rec;
-         rec.Package = Opts->Value;
-         rec.Type = pkgSrcRecords::Parser::BuildDependIndep;
-         rec.Op = 0;
-         BuildDeps.push_back(rec);
-      }
-      
-      if (BuildDeps.empty() == true)
-      {
-         ioprintf(c1out,_("%s has no build depends.\n"),Src.c_str());
-         continue;
-      }
 
-      // Install the requested packages
-      vector <pkgSrcRecords::Parser::BuildDepRec>::iterator D;
-      pkgProblemResolver Fix(Cache);
-      bool skipAlternatives = false; // skip remaining alternatives in an or group
-      for (D = BuildDeps.begin(); D != BuildDeps.end(); ++D)
-      {
-         bool hasAlternatives = (((*D).Op & pkgCache::Dep::Or) == pkgCache::Dep::Or);
+// DoSweep - Resolve the build-dependencies of every known source
+// ---------------------------------------------------------------------
+/* Walks all records of the deb-src indexes and prints a block as in batch
+   mode for each source, headed by its "Package:" and "Version:" instead
+   of "File:". By default all online CPUs are used.
+
+   With APT::Resolve-Dep::State the results are stored in the given file
+   along with a fingerprint of all packages which could have influenced
+   them, so that the next sweep reuses the results for all sources whose
+   fingerprint is still the same. The file is only used by a sweep with
+   the same resolver and options as the one which wrote it. */
+static string SweepHeader(string const &Package, string const &Version)
+{
+   return "Package: " + Package + "\nVersion: " + Version;
+}
+static string SweepHeader(pkgTagSection const &Section)
+{
+   return SweepHeader(Section.FindS(pkgTagSection::Field::Package),
+                      Section.FindS(pkgTagSection::Field::Version));
+}
+static bool DoSweep(CommandLine &)
+{
+   CacheFile Cache;
 
-         if (skipAlternatives == true)
-         {
-            /*
-             * if there are alternatives, we've already picked one, so skip
-             * the rest
-             *
-             * TODO: this means that if there's a build-dep on A|B and B is
-             * installed, we'll still try to install A; more importantly,
-             * if A is currently broken, we cannot go back and try B. To fix 
-             * this would require we do a Resolve cycle for each package we 
-             * add to the install list. Ugh
-             */
-            if (!hasAlternatives)
-               skipAlternatives = false; // end of or group
-            continue;
-         }
+   _config->Set("APT::Install-Recommends", false);
 
-         if ((*D).Type == pkgSrcRecords::Parser::BuildConflict ||
-             (*D).Type == pkgSrcRecords::Parser::BuildConflictIndep)
-         {
-            pkgCache::GrpIterator Grp = Cache->FindGrp((*D).Package);
-            // Build-conflicts on unknown packages are silently ignored
-            if (Grp.end() == true)
-               continue;
+   if (Cache.Open(true) == false)
+      return false;
 
-            for (pkgCache::PkgIterator Pkg = Grp.PackageList(); Pkg.end() == false; Pkg = Grp.NextPkg(Pkg))
-            {
-               pkgCache::VerIterator IV = (*Cache)[Pkg].InstVerIter(*Cache);
-               /*
-                * Remove if we have an installed version that satisfies the
-                * version criteria
-                */
-               if (IV.end() == false &&
-                   Cache->VS().CheckDep(IV.VerStr(),(*D).Op,(*D).Version.c_str()) == true)
-                  TryToInstallBuildDep(Pkg,Cache,Fix,true,false);
-            }
-         }
-         else // BuildDep || BuildDepIndep
-         {
-            if (_config->FindB("Debug::BuildDeps",false) == true)
-               cerr << "Looking for " << (*D).Package << "...\n";
+   // Read the source list
+   if (Cache.BuildSourceList() == false)
+      return false;
 
-            pkgCache::PkgIterator Pkg;
+   BatchQueue Queue;
+   string const hostArch = _config->Find("APT::Get::Host-Architecture");
+   if (CheckHostArch(hostArch, Queue.StripMultiArch) == false)
+      return false;
 
-            // Cross-Building?
-            if (StripMultiArch == false && D->Type != pkgSrcRecords::Parser::BuildDependIndep)
-            {
-               size_t const colon = D->Package.find(":");
-               if (colon != string::npos)
-               {
-                  if (strcmp(D->Package.c_str() + colon, ":any") == 0 || strcmp(D->Package.c_str() + colon, ":native") == 0)
-                     Pkg = Cache->FindPkg(D->Package.substr(0,colon));
-                  else
-                     Pkg = Cache->FindPkg(D->Package);
-               }
-               else
-                  Pkg = Cache->FindPkg(D->Package, hostArch);
+   string const StateFile = _config->FindFile("APT::Resolve-Dep::State");
+   Queue.Fingerprint = (StateFile.empty() == false);
+   MD5Summation Sum;
+   // increase whenever the resolution or the stored results change
+   HashResolver(Sum, 1);
+   string const Resolver = Sum.Result().Value();
+   if (Queue.Fingerprint == true &&
+       ReadBatchState(StateFile, Resolver, Queue.Previous, SweepHeader) == false)
+      return false;
 
-               // a bad version either is invalid or doesn't satify dependency
-               #define BADVER(Ver) (Ver.end() == true || \
-                     (D->Version.empty() == false && \
-                     Cache->VS().CheckDep(Ver.VerStr(),D->Op,D->Version.c_str()) == false))
+   pkgSrcRecords SrcRecs(*Cache.GetSourceList());
+   if (_error->PendingError() == true)
+      return false;
 
-               APT::VersionList verlist;
-               if (Pkg.end() == false)
-               {
-                  pkgCache::VerIterator Ver = (*Cache)[Pkg].InstVerIter(*Cache);
-                  if (BADVER(Ver) == false)
-                     verlist.insert(Ver);
-                  Ver = (*Cache)[Pkg].CandidateVerIter(*Cache);
-                  if (BADVER(Ver) == false)
-                     verlist.insert(Ver);
-               }
-               if (verlist.empty() == true)
-               {
-                  pkgCache::PkgIterator BuildPkg = Cache->FindPkg(D->Package, "native");
-                  if (BuildPkg.end() == false && Pkg != BuildPkg)
-                  {
-                     pkgCache::VerIterator Ver = (*Cache)[BuildPkg].InstVerIter(*Cache);
-                     if (BADVER(Ver) == false)
-                        verlist.insert(Ver);
-                     Ver = (*Cache)[BuildPkg].CandidateVerIter(*Cache);
-                     if (BADVER(Ver) == false)
-                        verlist.insert(Ver);
-                  }
-               }
-               #undef BADVER
+   bool const ArchOnly = _config->FindB("APT::Get::Arch-Only", false);
+   // FIXME: Can't specify architecture to use for [wildcard] matching, so switch default arch temporary
+   std::string const nativeArch = _config->Find("APT::Architecture");
+   if (hostArch.empty() == false)
+      _config->Set("APT::Architecture", hostArch);
 
-               string forbidden;
-               // We need to decide if host or build arch, so find a version we can look at
-               APT::VersionList::const_iterator Ver = verlist.begin();
-               for (; Ver != verlist.end(); ++Ver)
-               {
-                  forbidden.clear();
-                  if (Ver->MultiArch == pkgCache::Version::None || Ver->MultiArch == pkgCache::Version::All)
-                  {
-                     if (colon == string::npos)
-                        Pkg = Ver.ParentPkg().Group().FindPkg(hostArch);
-                     else if (strcmp(D->Package.c_str() + colon, ":any") == 0)
-                        forbidden = "Multi-Arch: none";
-                     else if (strcmp(D->Package.c_str() + colon, ":native") == 0)
-                        Pkg = Ver.ParentPkg().Group().FindPkg("native");
-                  }
-                  else if (Ver->MultiArch == pkgCache::Version::Same)
-                  {
-                     if (colon == string::npos)
-                        Pkg = Ver.ParentPkg().Group().FindPkg(hostArch);
-                     else if (strcmp(D->Package.c_str() + colon, ":any") == 0)
-                        forbidden = "Multi-Arch: same";
-                     else if (strcmp(D->Package.c_str() + colon, ":native") == 0)
-                        Pkg = Ver.ParentPkg().Group().FindPkg("native");
-                  }
-                  else if ((Ver->MultiArch & pkgCache::Version::Foreign) == pkgCache::Version::Foreign)
-                  {
-                     if (colon == string::npos)
-                        Pkg = Ver.ParentPkg().Group().FindPkg("native");
-                     else if (strcmp(D->Package.c_str() + colon, ":any") == 0 ||
-                              strcmp(D->Package.c_str() + colon, ":native") == 0)
-                        forbidden = "Multi-Arch: foreign";
-                  }
-                  else if ((Ver->MultiArch & pkgCache::Version::Allowed) == pkgCache::Version::Allowed)
-                  {
-                     if (colon == string::npos)
-                        Pkg = Ver.ParentPkg().Group().FindPkg(hostArch);
-                     else if (strcmp(D->Package.c_str() + colon, ":any") == 0)
-                     {
-                        // prefer any installed over preferred non-installed architectures
-                        pkgCache::GrpIterator Grp = Ver.ParentPkg().Group();
-                        // we don't check for version here as we are better of with upgrading than remove and install
-                        for (Pkg = Grp.PackageList(); Pkg.end() == false; Pkg = Grp.NextPkg(Pkg))
-                           if (Pkg.CurrentVer().end() == false)
-                              break;
-                        if (Pkg.end() == true)
-                           Pkg = Grp.FindPreferredPkg(true);
-                     }
-                     else if (strcmp(D->Package.c_str() + colon, ":native") == 0)
-                        Pkg = Ver.ParentPkg().Group().FindPkg("native");
-                  }
+   std::set<string> Seen;
+   // Step hands out the parser as const, but BuildDepends isn't
+   for (pkgSrcRecords::Parser *Parse; (Parse = const_cast<pkgSrcRecords::Parser *>(SrcRecs.Step())) != 0;)
+   {
+      BatchItem Item;
+      Item.Src = Parse->Package();
+      Item.Header = SweepHeader(Item.Src, Parse->Version());
+      // the same source can be in more than one index
+      if (Seen.insert(Item.Header).second == false)
+         continue;
+      Item.Parsed = Parse->BuildDepends(Item.BuildDeps, ArchOnly, Queue.StripMultiArch);
+      if (Item.Parsed == false)
+      {
+         _error->Error(_("Unable to get build-dependency information for %s"),Item.Src.c_str());
+         ostringstream Out;
+         _error->DumpErrors(Out);
+         Item.Output = Out.str();
+      }
+      Queue.Items.push_back(Item);
+   }
+   _config->Set("APT::Architecture", nativeArch);
+   if (_error->PendingError() == true)
+      return false;
 
-                  if (forbidden.empty() == false)
-                  {
-                     if (_config->FindB("Debug::BuildDeps",false) == true)
-                        cerr << D->Package.substr(colon, string::npos) << " is not allowed from " << forbidden << " package " << (*D).Package << " (" << Ver.VerStr() << ")" << endl;
-                     continue;
-                  }
+   FileFd State;
+   if (Queue.Fingerprint == true &&
+       (State.Open(StateFile, FileFd::WriteAtomic, 0644) == false ||
+        WriteBatchStateHeader(State, Resolver) == false))
+      return false;
 
-                  //we found a good version
-                  break;
-               }
-               if (Ver == verlist.end())
-               {
-                  if (_config->FindB("Debug::BuildDeps",false) == true)
-                     cerr << " No multiarch info as we have no satisfying installed nor candidate for " << D->Package << " on build or host arch" << endl;
+   int const Jobs = _config->FindI("APT::Resolve-Dep::Jobs", sysconf(_SC_NPROCESSORS_ONLN));
+   unsigned long const Failed = RunBatch(Cache, Queue, Jobs,
+                                         Queue.Fingerprint == true ? &State : NULL);
+   if (Queue.Fingerprint == true && State.Close() == false)
+      return false;
 
-                  if (forbidden.empty() == false)
-                  {
-                     if (hasAlternatives)
-                        continue;
-                     return _error->Error(_("%s dependency for %s can't be satisfied "
-                                            "because %s is not allowed on '%s' packages"),
-                                          BuildDepType(D->Type), Src.c_str(),
-                                          D->Package.c_str(), forbidden.c_str());
-                  }
-               }
-            }
-            else
-               Pkg = Cache->FindPkg(D->Package);
+   if (Failed != 0)
+      return _error->Error(_("Build-dependencies for %lu of %lu sources could not be satisfied."),
+                           Failed, (unsigned long) Queue.Items.size());
+   return true;
+}
 
-            if (Pkg.end() == true || (Pkg->VersionList == 0 && Pkg->ProvidesList == 0))
-            {
-               if (_config->FindB("Debug::BuildDeps",false) == true)
-                  cerr << " (not found)" << (*D).Package << endl;
 
-               if (hasAlternatives)
-                  continue;
+// ReadRequestHeader - Read the header of a request from a client
+// ---------------------------------------------------------------------
+/* The header is a list of "Field: value" lines terminated by an empty
+   line. It is read bytewise so that the control file following it is
+   still unread in the socket and can be handed to pkgTagFile as is. */
+static bool ReadRequestHeader(int const Client)
+{
+   string Line;
+   while (true)
+   {
+      char C;
+      ssize_t const Res = read(Client, &C, 1);
+      if (Res < 0 && errno == EINTR)
+         continue;
+      if (Res < 0)
+         return _error->Errno("read", _("Reading the request failed"));
+      if (Res == 0)
+         return _error->Error(_("Request header is incomplete"));
+      if (C != '\n')
+      {
+         Line.append(1, C);
+         continue;
+      }
 
-               return _error->Error(_("%s dependency for %s cannot be satisfied "
-                                      "because the package %s cannot be found"),
-                                    BuildDepType((*D).Type),Src.c_str(),
-                                    (*D).Package.c_str());
-            }
+      Line = APT::String::Strip(Line);
+      if (Line.empty() == true)
+         return true;
+
+      size_t const colon = Line.find(':');
+      if (colon == string::npos)
+         return _error->Error(_("Malformed request header line: %s"), Line.c_str());
+      string const Field = APT::String::Strip(Line.substr(0, colon));
+      string const Value = APT::String::Strip(Line.substr(colon + 1));
+
+      if (strcasecmp(Field.c_str(), "Host-Architecture") == 0)
+         _config->Set("APT::Get::Host-Architecture", Value);
+      else if (strcasecmp(Field.c_str(), "Build-Profiles") == 0)
+         _config->Set("APT::Build-Profiles", Value);
+      else if (strcasecmp(Field.c_str(), "Arch-Only") == 0)
+         _config->Set("APT::Get::Arch-Only", StringToBool(Value, false));
+      else
+         _error->Warning(_("Ignoring unknown request field %s"), Field.c_str());
+      Line.clear();
+   }
+}
 
-            pkgCache::VerIterator IV = (*Cache)[Pkg].InstVerIter(*Cache);
-            if (IV.end() == false)
-            {
-               if (_config->FindB("Debug::BuildDeps",false) == true)
-                  cerr << "  Is installed\n";
 
-               if (D->Version.empty() == true ||
-                   Cache->VS().CheckDep(IV.VerStr(),(*D).Op,(*D).Version.c_str()) == true)
-               {
-                  skipAlternatives = hasAlternatives;
-                  continue;
-               }
+// ServeRequest - Resolve a single request of a client
+// ---------------------------------------------------------------------
+/* This runs in a child forked off the server, so the depcache it modifies
+   is a private copy of the pristine one the server holds and changes to
+   the configuration done by the request die with the child. The reply is
+   a "Status:" line with the exit code we would have used, an empty line
+   and the output of a normal run. */
+static int ServeRequest(CacheFile &Cache, int const Client)
+{
+   ostringstream Out;
+   string const Src = "request";
 
-               if (_config->FindB("Debug::BuildDeps",false) == true)
-                  cerr << "    ...but the installed version doesn't meet the version requirement\n";
+   int Status = 100;
+   bool StripMultiArch = true;
+   if (ReadRequestHeader(Client) == true &&
+       CheckHostArch(_config->Find("APT::Get::Host-Architecture"), StripMultiArch) == true)
+   {
+      FileFd Fd;
+      Fd.OpenDescriptor(Client, FileFd::ReadOnly);
+      Status = ResolveControlFile(Cache, Src, Fd, StripMultiArch, Out);
+   }
+   else
+      _error->DumpErrors(Out);
+
+   // the client expects us to read everything it sent before we reply
+   char Buffer[4096];
+   ssize_t Res;
+   do
+      Res = read(Client, Buffer, sizeof(Buffer));
+   while (Res > 0 || (Res < 0 && errno == EINTR));
+
+   ostringstream Reply;
+   Reply << "Status: " << Status << "\n\n" << Out.str();
+   string const Data = Reply.str();
+   FileFd::Write(Client, Data.c_str(), Data.length());
+   return Status;
+}
 
-               if (((*D).Op & pkgCache::Dep::LessEq) == pkgCache::Dep::LessEq)
-                  return _error->Error(_("Failed to satisfy %s dependency for %s: Installed package %s is too new"),
-                                       BuildDepType((*D).Type), Src.c_str(), Pkg.FullName(true).c_str());
-            }
 
-            // Only consider virtual packages if there is no versioned dependency
-            if ((*D).Version.empty() == true)
-            {
-               /*
-                * If this is a virtual package, we need to check the list of
-                * packages that provide it and see if any of those are
-                * installed
-                */
-               pkgCache::PrvIterator Prv = Pkg.ProvidesList();
-               for (; Prv.end() != true; ++Prv)
-               {
-                  if (_config->FindB("Debug::BuildDeps",false) == true)
-                     cerr << "  Checking provider " << Prv.OwnerPkg().FullName() << endl;
+// DoServe - Answer requests on a unix socket with a loaded cache
+// ---------------------------------------------------------------------
+/* Opening the cache is the most expensive part of a run, so in this mode
+   we do it once and fork a child for each connection which inherits the
+   mapped cache and the initialized depcache. Before a request is handed
+   to a child we check that the cache still matches the index files on
+   disk and reopen it if not. The cache is only read, so we don't take
+   the dpkg lock which would block every other apt run while we serve. */
+static bool DoServe(CommandLine &)
+{
+   string const Path = _config->Find("APT::Resolve-Dep::Serve");
+   _config->Set("APT::Install-Recommends", false);
 
-                  if ((*Cache)[Prv.OwnerPkg()].InstVerIter(*Cache).end() == false)
-                     break;
-               }
+   struct sockaddr_un Addr;
+   memset(&Addr, 0, sizeof(Addr));
+   Addr.sun_family = AF_UNIX;
+   if (Path.length() >= sizeof(Addr.sun_path))
+      return _error->Error(_("Socket path %s is too long"), Path.c_str());
+   strcpy(Addr.sun_path, Path.c_str());
+
+   int const Sock = socket(AF_UNIX, SOCK_STREAM, 0);
+   if (Sock < 0)
+      return _error->Errno("socket", _("Could not create a socket"));
+   SetCloseExec(Sock, true);
+   unlink(Path.c_str());
+   if (bind(Sock, (struct sockaddr *)&Addr, sizeof(Addr)) != 0)
+   {
+      _error->Errno("bind", _("Could not bind to %s"), Path.c_str());
+      close(Sock);
+      return false;
+   }
+   if (listen(Sock, SOMAXCONN) != 0)
+   {
+      _error->Errno("listen", _("Could not listen on %s"), Path.c_str());
+      close(Sock);
+      return false;
+   }
 
-               if (Prv.end() == false)
-               {
-                  if (_config->FindB("Debug::BuildDeps",false) == true)
-                     cerr << "  Is provided by installed package " << Prv.OwnerPkg().FullName() << endl;
-                  skipAlternatives = hasAlternatives;
-                  continue;
-               }
-            }
-            else // versioned dependency
-            {
-               pkgCache::VerIterator CV = (*Cache)[Pkg].CandidateVerIter(*Cache);
-               if (CV.end() == true ||
-                  Cache->VS().CheckDep(CV.VerStr(),(*D).Op,(*D).Version.c_str()) == false)
-               {
-                  if (hasAlternatives)
-                     continue;
-                  else if (CV.end() == false)
-                     return _error->Error(_("%s dependency for %s cannot be satisfied "
-                                            "because candidate version of package %s "
-                                            "can't satisfy version requirements"),
-                                          BuildDepType(D->Type), Src.c_str(),
-                                          D->Package.c_str());
-                  else
-                     return _error->Error(_("%s dependency for %s cannot be satisfied "
-                                            "because package %s has no candidate version"),
-                                          BuildDepType(D->Type), Src.c_str(),
-                                          D->Package.c_str());
-               }
-            }
+   // clients connecting while we open the cache wait in the backlog
+   CacheFile *Cache = new CacheFile;
+   if (Cache->Open(false) == false || Cache->BuildSourceList() == false)
+   {
+      delete Cache;
+      close(Sock);
+      unlink(Path.c_str());
+      return false;
+   }
 
-            if (TryToInstallBuildDep(Pkg,Cache,Fix,false,false,false) == true)
-            {
-               // We successfully installed something; skip remaining alternatives
-               skipAlternatives = hasAlternatives;
-               if (_config->FindB("APT::Get::Build-Dep-Automatic", false) == true)
-                  Cache->MarkAuto(Pkg, true);
-               continue;
-            }
-            else if (hasAlternatives)
-            {
-               if (_config->FindB("Debug::BuildDeps",false) == true)
-                  cerr << "  Unsatisfiable, trying alternatives\n";
-               continue;
-            }
-            else
+   // children are never waited for
+   signal(SIGCHLD, SIG_IGN);
+
+   while (true)
+   {
+      int const Client = accept(Sock, 0, 0);
+      if (Client < 0)
+      {
+         if (errno == EINTR || errno == ECONNABORTED)
+            continue;
+         _error->Errno("accept", _("Could not accept a connection on %s"), Path.c_str());
+         delete Cache;
+         close(Sock);
+         unlink(Path.c_str());
+         return false;
+      }
+
+      pkgSourceList List;
+      if (List.ReadMainList() == false ||
+          pkgCacheGenerator::IsStatusCacheValid(List, *Cache) == false)
+      {
+         _error->Discard();
+         if (_config->FindB("Debug::Resolve-Dep::Serve", false) == true)
+            cerr << "Index files changed, reopening the cache" << endl;
+         CacheFile * const NewCache = new CacheFile;
+         if (NewCache->Open(false) == true && NewCache->BuildSourceList() == true)
+         {
+            delete Cache;
+            Cache = NewCache;
+         }
+         else
+         {
+            /* keep answering from the old cache, the next request tries
+               again; the child passes the reasons on to its client */
+            delete NewCache;
+            vector<string> Reasons;
+            while (_error->empty(GlobalError::DEBUG) == false)
             {
-               return _error->Error(_("Failed to satisfy %s dependency for %s: %s"),
-                                    BuildDepType((*D).Type),
-                                    Src.c_str(),
-                                    (*D).Package.c_str());
+               string Msg;
+               _error->PopMessage(Msg);
+               Reasons.push_back(Msg);
             }
+            for (vector<string>::const_iterator R = Reasons.begin(); R != Reasons.end(); ++R)
+               _error->Warning(_("Could not reopen the cache, answering from the old one: %s"), R->c_str());
          }
       }
 
-      if (Fix.Resolve(true) == false)
-         _error->Discard();
-      
-      // Now we check the state of the packages,
-      if (Cache->BrokenCount() != 0)
+      pid_t const Child = fork();
+      if (Child == 0)
       {
-         ShowBroken(cerr, Cache, false);
-         return _error->Error(_("Build-dependencies for %s could not be satisfied."),*I);
+         close(Sock);
+         _exit(ServeRequest(*Cache, Client));
       }
+      if (Child < 0)
+         _error->Errno("fork", _("Could not fork a child for a request"));
+      close(Client);
+      _error->DumpErrors();
    }
+   return true;
+}
 
-   for (unsigned J = 0; J < Cache->Head().PackageCount; J++)
+// ShowHashTableStats - Show the occupancy of one of the hash tables
+// ---------------------------------------------------------------------
+/* Entries with the same full hash in one chain have to be told apart by
+   comparing their names, they are counted as collisions. */
+template<class T>
+static void ShowHashTableStats(char const * const Type, T * const StartP,
+      map_ptrloc const * const Table, unsigned long const Size,
+      map_ptrloc T::*Next)
+{
+   unsigned long Used = 0;
+   unsigned long Entries = 0;
+   unsigned long Longest = 0;
+   unsigned long Collisions = 0;
+   for (unsigned long I = 0; I != Size; ++I)
    {
-      pkgCache::PkgIterator I(Cache,Cache.List[J]);
-      if (Cache[I].NewInstall() == true)
+      if (Table[I] == 0)
+         continue;
+      ++Used;
+      unsigned long Length = 0;
+      T const *Last = 0;
+      for (T const *P = StartP + Table[I]; P != StartP; P = StartP + P->*Next)
       {
-         cout << I.FullName(true)
-              << ":"
-              << Cache[I].CandidateVerIter(Cache).Arch()
-              << "="
-              << string(Cache[I].CandVersion)
-              << endl;
+         ++Length;
+         if (Last != 0 && Last->Hash == P->Hash && Last->Name != P->Name)
+            ++Collisions;
+         Last = P;
       }
+      Entries += Length;
+      Longest = std::max(Longest, Length);
    }
+   cout << "Total buckets in " << Type << ": " << Size << endl;
+   cout << "  Used: " << Used << endl;
+   cout << "  Unused: " << Size - Used << endl;
+   cout << "  Load factor: " << Entries / (double) Size << endl;
+   cout << "  Average used chain: " << (Used == 0 ? 0 : Entries / (double) Used) << endl;
+   cout << "  Longest chain: " << Longest << endl;
+   cout << "  Hash collisions: " << Collisions << endl;
+}
 
+// DoCacheStats - Show statistics of the package cache
+// ---------------------------------------------------------------------
+/* */
+static bool DoCacheStats(CommandLine &)
+{
+   pkgCacheFile Cache;
+   pkgCache * const PkgCache = Cache.GetPkgCache();
+   if (PkgCache == NULL)
+      return false;
+
+   pkgCache::Header const &H = *PkgCache->HeaderP;
+   cout << "Groups: " << H.GroupCount << endl;
+   cout << "Packages: " << H.PackageCount << endl;
+   cout << "Versions: " << H.VersionCount << endl;
+   cout << "Dependencies: " << H.DependsCount << endl;
+   cout << "Cache size: " << H.CacheFileSize << endl;
+   ShowHashTableStats("GrpHashTable", PkgCache->GrpP, H.GrpHashTableP(),
+                      H.HashTableSize, &pkgCache::Group::Next);
+   ShowHashTableStats("PkgHashTable", PkgCache->PkgP, H.PkgHashTableP(),
+                      H.HashTableSize, &pkgCache::Package::NextPackage);
    return true;
 }
 
@@ -615,12 +1886,22 @@ static bool ShowHelp(CommandLine &)
 
    cerr << _(
       "Usage: apt-resolve-dep [options] controlfile\n"
+      "       apt-resolve-dep [options] --serve=socket\n"
+      "       apt-resolve-dep [options] --sweep\n"
       "\n"
       "Resolve build dependencies from a control file (or .dsc file).\n"
       "\n"
       "Options:\n"
       "  -a                       host architecture\n"
       "  -P                       build profiles\n"
+      "      --batch              resolve each control file on its own\n"
+      "  -j, --jobs=N             resolve N control files in parallel (implies --batch)\n"
+      "      --serve=SOCKET       answer requests on a unix socket\n"
+      "      --result-cache=DIR   reuse results of earlier runs stored in DIR\n"
+      "      --shared-cache=DIR   share the package cache of the same indexes in DIR\n"
+      "      --sweep              resolve every source of the deb-src indexes\n"
+      "      --state=FILE         reuse unchanged results of the last sweep\n"
+      "      --cache-stats        show statistics of the package cache\n"
       "  -c, --config-file=VALUE  read this configuration file\n"
       "  -o, --option=VALUE       set an arbitrary configuration option, eg -o dir::cache=/tmp\n"
       "      --version            print version number\n"
@@ -641,6 +1922,14 @@ int main(int argc,const char *argv[])
    addArg('P', "build-profiles", "APT::Build-Profiles", CommandLine::HasArg);
    addArg(0, "purge", "APT::Get::Purge", 0);
    addArg(0, "solver", "APT::Solver", CommandLine::HasArg);
+   addArg(0, "serve", "APT::Resolve-Dep::Serve", CommandLine::HasArg);
+   addArg(0, "batch", "APT::Resolve-Dep::Batch", 0);
+   addArg('j', "jobs", "APT::Resolve-Dep::Jobs", CommandLine::HasArg);
+   addArg(0, "sweep", "APT::Resolve-Dep::Sweep", 0);
+   addArg(0, "state", "APT::Resolve-Dep::State", CommandLine::HasArg);
+   addArg(0, "result-cache", "APT::Resolve-Dep::Result-Cache", CommandLine::HasArg);
+   addArg(0, "shared-cache", "Dir::Cache::Shared", CommandLine::HasArg);
+   addArg(0, "cache-stats", "APT::Resolve-Dep::Cache-Stats", 0);
 
    // options without a command
    addArg('h', "help", "help", 0);
@@ -678,7 +1967,10 @@ int main(int argc,const char *argv[])
       return 0;
    }
 
-   if (CmdL.FileSize() == 0)
+   if (CmdL.FileSize() == 0 &&
+       _config->Find("APT::Resolve-Dep::Serve").empty() == true &&
+       _config->FindB("APT::Resolve-Dep::Sweep", false) == false &&
+       _config->FindB("APT::Resolve-Dep::Cache-Stats", false) == false)
    {
       cerr << "error: no control files specific" << endl;
       return 2;
@@ -693,7 +1985,22 @@ int main(int argc,const char *argv[])
    // Setup the output streams
    InitOutput();
 
-   DoBuildDep(CmdL);
+   if (_config->FindB("APT::Resolve-Dep::Cache-Stats", false) == true)
+      DoCacheStats(CmdL);
+   else if (_config->Find("APT::Resolve-Dep::Serve").empty() == false)
+      DoServe(CmdL);
+   else if (_config->FindB("APT::Resolve-Dep::Sweep", false) == true)
+      DoSweep(CmdL);
+   else if (_config->FindB("APT::Resolve-Dep::Batch", false) == true ||
+            _config->Exists("APT::Resolve-Dep::Jobs") == true)
+      DoBatch(CmdL);
+   else
+   {
+      /* The other modes set up one state for many requests, a single
+         run only needs the state of the packages it looks at */
+      _config->CndSet("APT::DepCache::Lazy", true);
+      DoBuildDep(CmdL);
+   }
 
    // Print any errors or warnings found during parsing
    bool const Errors = _error->PendingError();